@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 by the xf86-input-wacom contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _WACOM_CAPTURE_H_
+#define _WACOM_CAPTURE_H_
+
+#include <stdint.h>
+
+/**
+ * File format of a binary wacom-record capture (wacom-record --capture).
+ * This is not a stable format, it may only be converted by the
+ * wacom-record built from the same tree (wacom-record --convert).
+ *
+ * A capture is a struct wacom_capture_header followed by records until
+ * the end of the file, all in host byte order. Each record is a struct
+ * wacom_capture_record followed by record.length bytes of payload.
+ */
+
+#define WACOM_CAPTURE_MAGIC "WCMCAPTR"
+#define WACOM_CAPTURE_VERSION 1
+
+struct wacom_capture_header {
+	char magic[8];			/* WACOM_CAPTURE_MAGIC, not terminated */
+	uint32_t version;		/* WACOM_CAPTURE_VERSION */
+	uint32_t reserved;
+};
+
+enum wacom_capture_kind {
+	/* YAML text, copied to the output as-is */
+	WACOM_CAPTURE_TEXT = 1,
+	/* an evdev frame up to and including its SYN_REPORT, the last
+	 * frame of a device may lack it if the capture stopped mid-frame,
+	 * payload: struct wacom_capture_evdev[] */
+	WACOM_CAPTURE_FRAME,
+	/* payload of the following: struct wacom_capture_event */
+	WACOM_CAPTURE_PROXIMITY,	/* a: proximity in */
+	WACOM_CAPTURE_MOTION,		/* a: is absolute */
+	WACOM_CAPTURE_BUTTON,		/* a: button, b: is press */
+	WACOM_CAPTURE_KEY,		/* a: keycode, b: is press, no axes */
+};
+
+struct wacom_capture_record {
+	uint32_t length;		/* bytes of payload that follow */
+	uint16_t kind;			/* enum wacom_capture_kind */
+	uint16_t source;		/* id of the device, 0 for TEXT */
+	uint64_t time;			/* CLOCK_MONOTONIC capture time in us,
+					 * not part of the converted YAML */
+};
+
+struct wacom_capture_evdev {
+	int64_t sec;
+	int32_t usec;
+	uint16_t type;
+	uint16_t code;
+	int32_t value;
+	int32_t reserved;
+};
+
+struct wacom_capture_event {
+	int32_t a, b;
+	uint32_t mask;			/* WacomEventAxis */
+	int32_t x, y;
+	int32_t pressure;
+	int32_t tilt_x, tilt_y;
+	int32_t rotation;
+	int32_t throttle;
+	int32_t wheel;
+	int32_t ring, ring2;
+};
+
+#endif
+
+/* vim: set noexpandtab tabstop=8 shiftwidth=8: */
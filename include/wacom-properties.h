@@ -70,9 +70,19 @@
 /* 32 bit, 1 value */
 #define WACOM_PROP_PRESSURE_THRESHOLD "Wacom Pressure Threshold"
 
-/* 32 bit, 2 values, suppress, sample */
+/* 32 bit, 8 values, suppress, sample, followed by the device's suppress thresholds
+   for position, tilt, pressure, throttle, rotation and wheels. A threshold
+   of 0 uses the suppress value. Setting only the first 2 values leaves the
+   thresholds unchanged. */
 #define WACOM_PROP_SAMPLE "Wacom Sample and Suppress"
 
+/* 32 bit, 3 values, filter (0 == average, 1 == One-Euro),
+   One-Euro minimum cutoff in mHz, One-Euro beta in 1/1000 Hz per mm/s */
+#define WACOM_PROP_FILTER "Wacom Filter"
+
+/* 32 bit, 1 value, prediction horizon in ms, 0 disables prediction */
+#define WACOM_PROP_PREDICTION "Wacom Prediction"
+
 /* BOOL, 1 value */
 #define WACOM_PROP_TOUCH "Wacom Enable Touch"
 
@@ -112,6 +122,27 @@
 /* 32 bit, 1 values */
 #define WACOM_PROP_PANSCROLL_THRESHOLD "Wacom Panscroll Threshold"
 
+/* CARD32, 9 values, read-only. Counters shared by all tools of a tablet:
+   evdev events read, SYN_REPORT frames, SYN_DROPPED received, events dropped
+   because the event queue was full, times all channels were in use, reads
+   that could not keep up with the device. Followed by counters of this tool:
+   events dropped by suppression, events reduced to motion by suppression,
+   events dropped because the serial did not match. Counters wrap. */
+#define WACOM_PROP_STATISTICS "Wacom Statistics"
+
+/* CARD32, 80 values, read-only. Histograms of the time from the kernel
+   timestamp of a frame until it was read, parsed, dispatched to this tool,
+   filtered and until each event was sent, 16 buckets per stage. Bucket n
+   counts latencies of 2^n to 2^(n+1) - 1 us, the first bucket includes 0 and
+   the last one all longer latencies. Counters wrap. */
+#define WACOM_PROP_LATENCY "Wacom Latency"
+
+/* 32 bit, 1 value. Writing a nonzero value dumps the flight recorder to a
+   file in /tmp, the file name is written to the log. Writes within 10s of
+   the last dump are ignored. Only present if the flight recorder is
+   enabled. */
+#define WACOM_PROP_FLIGHT_RECORDER "Wacom Flight Recorder"
+
 /* The following are tool types used by the driver in WACOM_PROP_TOOL_TYPE
  * or in the 'type' field for XI1 clients. Clients may check for one of
  * these types to identify tool types.
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2024 by the xf86-input-wacom contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _WACOM_RECORDER_H_
+#define _WACOM_RECORDER_H_
+
+#include <stdint.h>
+
+/**
+ * File format of a flight recorder dump. This is not a stable format,
+ * it may only be decoded by the tools built from the same tree.
+ *
+ * A dump is a struct wacom_recorder_header followed by header.count
+ * struct wacom_record, oldest first, all in host byte order.
+ */
+
+#define WACOM_RECORDER_MAGIC "WCMFLREC"
+#define WACOM_RECORDER_VERSION 1
+
+struct wacom_recorder_header {
+	char magic[8];			/* WACOM_RECORDER_MAGIC, not terminated */
+	uint32_t version;		/* WACOM_RECORDER_VERSION */
+	uint32_t record_size;		/* sizeof(struct wacom_record) */
+	uint32_t count;			/* number of records that follow */
+	uint32_t lost;			/* records overwritten before the dump */
+	uint32_t vendor_id;
+	uint32_t product_id;
+};
+
+enum wacom_record_kind {
+	/* v: sec, usec, type, code, value */
+	WACOM_RECORD_EVDEV = 1,
+	/* channel chosen for a frame, v: device_type, serial, device_id, proximity */
+	WACOM_RECORD_CHANNEL,
+	/* state after filtering and prediction,
+	 * v: x, y, pressure, tiltx, tilty, buttons */
+	WACOM_RECORD_FILTER,
+	/* v: enum wacom_record_suppress */
+	WACOM_RECORD_SUPPRESS,
+	/* state sent to the frontend, v: x, y, pressure, tiltx, tilty, buttons */
+	WACOM_RECORD_EMIT,
+};
+
+enum wacom_record_suppress {
+	WACOM_RECORD_SUPPRESS_NONE,
+	WACOM_RECORD_SUPPRESS_ALL,
+	WACOM_RECORD_SUPPRESS_NON_MOTION,
+};
+
+#define WACOM_RECORD_NO_CHANNEL 0xff
+
+/* The device_type of CHANNEL records and in the flags of FILTER and EMIT
+ * records */
+#define WACOM_RECORD_STYLUS 0x01
+#define WACOM_RECORD_TOUCH 0x02
+#define WACOM_RECORD_CURSOR 0x04
+#define WACOM_RECORD_ERASER 0x08
+#define WACOM_RECORD_PAD 0x10
+
+/* flags of FILTER and EMIT records */
+#define WACOM_RECORD_FLAG_PROXIMITY 0x1
+#define WACOM_RECORD_TYPE_SHIFT 8 /* device type in the upper byte */
+
+struct wacom_record {
+	uint32_t time;			/* CLOCK_MONOTONIC processing time in us, wraps */
+	uint8_t kind;			/* enum wacom_record_kind */
+	uint8_t channel;		/* or WACOM_RECORD_NO_CHANNEL */
+	uint16_t flags;
+	int32_t v[6];
+};
+
+#endif
+
+/* vim: set noexpandtab tabstop=8 shiftwidth=8: */
@@ -147,8 +147,15 @@ void wcmSetFd(WacomDevicePtr priv, int fd);
 /* Update the driver implementation's name, if any */
 void wcmSetName(WacomDevicePtr priv, const char *name);
 
+/* The driver's clock for all timing decisions, e.g. tap and idle timeouts,
+ * it must be the same clock WacomTimers run on. A frontend replaying
+ * recorded events may return a simulated clock here, see wcmSimClock.h */
 uint32_t wcmTimeInMillis(void);
 
+/* Wait until the input thread, if any, has left event processing. Data
+ * it may have been reading can be freed afterwards. */
+void wcmSyncInputThread(void);
+
 static inline void wcmAxisSet(WacomAxisData *data,
 			      enum WacomAxisType which, int value)
 {
@@ -278,6 +285,35 @@ void wcmEmitProximity(WacomDevicePtr priv, bool is_proximity_in,
 		      const WacomAxisData *axes);
 void wcmEmitTouch(WacomDevicePtr priv, int type, unsigned int touchid, int x, int y);
 
+enum WacomFrameEventType {
+	WACOM_FRAME_PROXIMITY,	/* state: proximity in */
+	WACOM_FRAME_MOTION,
+	WACOM_FRAME_BUTTON,	/* code: button, state: is press */
+	WACOM_FRAME_KEY,	/* code: keycode, state: is press */
+};
+
+typedef struct {
+	enum WacomFrameEventType type;
+	int code;
+	bool state;
+	bool is_absolute;	/* motion and button only */
+	bool has_axes;		/* sent with the frame's axes, otherwise none */
+} WacomFrameEvent;
+
+#define WCM_MAX_FRAME_EVENTS 32
+
+/* All events the driver sends for one device state. All events with
+ * has_axes share the same axes, so they need to be converted only once */
+typedef struct {
+	WacomAxisData axes;
+	unsigned int nevents;
+	WacomFrameEvent events[WCM_MAX_FRAME_EVENTS];
+} WacomFrame;
+
+/* Send the events of the frame in order, the result must be the same as
+ * calling wcmEmitProximity/Motion/Button/Keycode for each of them */
+void wcmEmitFrame(WacomDevicePtr priv, const WacomFrame *frame);
+
 
 struct input_event;
 void wcmNotifyEvdev(WacomDevicePtr priv, const struct input_event *event);
@@ -309,6 +345,7 @@ void wcmOptSetStr(WacomDevicePtr priv, const char *key, const char *value);
 void wcmOptSetInt(WacomDevicePtr priv, const char *key, int value);
 void wcmOptSetBool(WacomDevicePtr priv, const char *key, bool value);
 
+/* Timers fire relative to wcmTimeInMillis(), millis is the time they fired at */
 typedef struct _WacomTimer *WacomTimerPtr;
 
 /* Return the new (relative) time in millis to set the timer for or 0 */
@@ -11,8 +11,13 @@ DRIVER_SOURCES= \
 	$(top_srcdir)/src/wcmFilter.h \
 	$(top_srcdir)/src/wcmPressureCurve.c \
 	$(top_srcdir)/src/wcmPressureCurve.h \
+	$(top_srcdir)/src/wcmRecorder.c \
+	$(top_srcdir)/src/wcmRecorder.h \
+	$(top_srcdir)/src/wcmSimClock.c \
+	$(top_srcdir)/src/wcmSimClock.h \
 	$(top_srcdir)/src/xf86WacomDefs.h \
 	$(top_srcdir)/src/wcmUSB.c \
 	$(top_srcdir)/src/wcmValidateDevice.c \
 	$(top_srcdir)/src/wcmTouchFilter.c \
-	$(top_srcdir)/src/wcmTouchFilter.h
+	$(top_srcdir)/src/wcmTouchFilter.h \
+	$(top_srcdir)/src/wcmTrace.h
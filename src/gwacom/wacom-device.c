@@ -28,6 +28,8 @@
 
 
 #include "xf86Wacom.h"
+#include "wcmRecorder.h"
+#include "wcmSimClock.h"
 
 struct _WacomOptions {
 	GObject parent_instance;
@@ -184,6 +186,7 @@ enum {
 	SIGNAL_MOTION,
 	SIGNAL_TOUCH,
 	SIGNAL_PROXIMITY,
+	SIGNAL_FRAME,
 
 	SIGNAL_LOGMSG, /* A log message from the driver */
 	SIGNAL_DBGMSG, /* A debug message from the driver */
@@ -317,6 +320,41 @@ void wacom_device_set_runtime_option(WacomDevice *device, const char *name, cons
 	}
 }
 
+gboolean wacom_device_dump_flight_recorder(WacomDevice *device, const char *path)
+{
+	gboolean rc;
+	int fd;
+
+	fd = open(path, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0644);
+	if (fd < 0)
+		return FALSE;
+
+	rc = wcmRecorderDump(device->priv->common, fd);
+	if (close(fd) < 0)
+		rc = FALSE;
+	return rc;
+}
+
+_Static_assert((int)WLATENCY_READ == (int)LATENCY_READ, "Mismatching enum");
+_Static_assert((int)WLATENCY_PARSE == (int)LATENCY_PARSE, "Mismatching enum");
+_Static_assert((int)WLATENCY_DISPATCH == (int)LATENCY_DISPATCH, "Mismatching enum");
+_Static_assert((int)WLATENCY_FILTER == (int)LATENCY_FILTER, "Mismatching enum");
+_Static_assert((int)WLATENCY_EMIT == (int)LATENCY_EMIT, "Mismatching enum");
+_Static_assert(WACOM_LATENCY_BUCKETS == LATENCY_BUCKETS, "Mismatching bucket count");
+_Static_assert((int)WFRAME_PROXIMITY == (int)WACOM_FRAME_PROXIMITY, "Mismatching enum");
+_Static_assert((int)WFRAME_MOTION == (int)WACOM_FRAME_MOTION, "Mismatching enum");
+_Static_assert((int)WFRAME_BUTTON == (int)WACOM_FRAME_BUTTON, "Mismatching enum");
+_Static_assert((int)WFRAME_KEY == (int)WACOM_FRAME_KEY, "Mismatching enum");
+
+void wacom_device_get_latency(WacomDevice *device, WacomLatencyStage stage,
+			      guint32 buckets[WACOM_LATENCY_BUCKETS])
+{
+	g_return_if_fail(stage >= WLATENCY_READ && stage <= WLATENCY_EMIT);
+
+	for (int i = 0; i < WACOM_LATENCY_BUCKETS; i++)
+		buckets[i] = device->priv->wcmLatency[stage][i];
+}
+
 /****************** Driver layer *****************/
 
 int
@@ -542,6 +580,50 @@ void wcmEmitButton(WacomDevicePtr priv, bool is_absolute, int button, bool is_pr
 	g_signal_emit(device, signals[SIGNAL_BUTTON], 0, is_absolute, button, is_press, axes);
 }
 
+void wcmEmitFrame(WacomDevicePtr priv, const WacomFrame *frame)
+{
+	WacomDevice *device = priv->frontend;
+	static const WacomAxisData none;
+	WacomFrameEntry entries[WCM_MAX_FRAME_EVENTS];
+
+	/* Callers that only know the single event signals get those */
+	if (!g_signal_has_handler_pending(device, signals[SIGNAL_FRAME], 0, FALSE)) {
+		for (unsigned int i = 0; i < frame->nevents; i++) {
+			const WacomFrameEvent *event = &frame->events[i];
+			const WacomAxisData *axes = event->has_axes ? &frame->axes : &none;
+
+			switch (event->type) {
+			case WACOM_FRAME_PROXIMITY:
+				wcmEmitProximity(priv, event->state, axes);
+				break;
+			case WACOM_FRAME_MOTION:
+				wcmEmitMotion(priv, event->is_absolute, axes);
+				break;
+			case WACOM_FRAME_BUTTON:
+				wcmEmitButton(priv, event->is_absolute, event->code,
+					      event->state, axes);
+				break;
+			case WACOM_FRAME_KEY:
+				wcmEmitKeycode(priv, event->code, event->state);
+				break;
+			}
+		}
+		return;
+	}
+
+	for (unsigned int i = 0; i < frame->nevents; i++) {
+		entries[i] = (WacomFrameEntry) {
+			.type = (WacomFrameEntryType)frame->events[i].type,
+			.code = frame->events[i].code,
+			.state = frame->events[i].state,
+			.is_absolute = frame->events[i].is_absolute,
+			.has_axes = frame->events[i].has_axes,
+		};
+	}
+
+	g_signal_emit(device, signals[SIGNAL_FRAME], 0, &frame->axes, frame->nevents, entries);
+}
+
 void wcmEmitTouch(WacomDevicePtr priv, int type, unsigned int touchid, int x, int y)
 {
 	WacomDevice *device = priv->frontend;
@@ -560,6 +642,13 @@ void wcmEmitTouch(WacomDevicePtr priv, int type, unsigned int touchid, int x, in
 void wcmNotifyEvdev(WacomDevicePtr priv, const struct input_event *event)
 {
 	WacomDevice *device = priv->frontend;
+	WacomSimClockPtr clock = wacom_driver_get_simulated_clock();
+
+	/* Called before the event is processed, so timers that expired
+	 * before this frame fire first, just like they would in real time */
+	if (clock)
+		wcmSimClockNotifyEvent(clock, event);
+
 	g_signal_emit(device, signals[SIGNAL_EVDEV], 0, event);
 }
 
@@ -684,8 +773,10 @@ void wcmClose(WacomDevicePtr priv)
 	device->fd = -1;
 }
 
-/* FIXME: the bits we emulate in the driver don't depend on timers, so we just
- * have a stub timer implementation that does nothing */
+/* Timers only fire on the simulated clock. In real time gwacom keeps the
+ * stub timers that never fire, the bits we emulate in the driver don't
+ * depend on them and callers don't expect e.g. tap clicks from the main
+ * loop. */
 WacomTimerPtr wcmTimerNew(void)
 {
 	return calloc(1, 1);
@@ -693,15 +784,24 @@ WacomTimerPtr wcmTimerNew(void)
 
 void wcmTimerFree(WacomTimerPtr timer)
 {
-	g_free(timer);
+	wcmTimerCancel(timer);
+	free(timer);
 }
 
 void wcmTimerCancel(WacomTimerPtr timer)
 {
+	WacomSimClockPtr clock = wacom_driver_get_simulated_clock();
+
+	if (clock)
+		wcmSimClockCancelTimer(clock, timer);
 }
 
 void wcmTimerSet(WacomTimerPtr timer, uint32_t millis, WacomTimerCallback func, void *userdata)
 {
+	WacomSimClockPtr clock = wacom_driver_get_simulated_clock();
+
+	if (clock)
+		wcmSimClockSetTimer(clock, timer, millis, func, userdata);
 }
 
 void wcmUpdateSerialProperty(WacomDevicePtr priv) {}
@@ -752,7 +852,17 @@ void wcmQueueHotplug(WacomDevicePtr priv, const char* name, const char *type, un
 
 uint32_t wcmTimeInMillis(void)
 {
-	return (uint32_t)g_get_monotonic_time();
+	WacomSimClockPtr clock = wacom_driver_get_simulated_clock();
+
+	if (clock)
+		return wcmSimClockMillis(clock);
+
+	return (uint32_t)(g_get_monotonic_time() / 1000);
+}
+
+void wcmSyncInputThread(void)
+{
+	/* events are processed in the main loop, there is no input thread */
 }
 
 /****************** GObject boilerplate *****************/
@@ -926,6 +1036,27 @@ wacom_device_class_init(WacomDeviceClass *klass)
 			     /* is_prox_in, axes */
 			     2, G_TYPE_BOOLEAN, WACOM_TYPE_EVENT_DATA);
 
+	/**
+	 * WacomDevice::frame:
+	 * @device: the device that sent the events
+	 * @axes: a WacomEventData pointer
+	 * @nentries: the number of entries
+	 * @entries: (array length=nentries): a WacomFrameEntry array
+	 *
+	 * The frame signal is emitted with all events the device sends for
+	 * one hardware state, in order. Entries with has_axes share @axes.
+	 * While a handler is connected, the proximity, motion, button and
+	 * keycode signals are only emitted for events outside of a frame,
+	 * e.g. those sent by timers.
+	 */
+	signals[SIGNAL_FRAME] =
+		g_signal_new("frame",
+			     G_TYPE_FROM_CLASS(klass),
+			     G_SIGNAL_RUN_FIRST,
+			     0, NULL, NULL, NULL, G_TYPE_NONE,
+			     /* axes, nentries, entries */
+			     3, WACOM_TYPE_EVENT_DATA, G_TYPE_UINT, G_TYPE_POINTER);
+
 	/**
 	 * WacomDevice::log-message:
 	 * @device: the device that sent the event
@@ -114,6 +114,33 @@ typedef enum {
 	_WAXIS_LAST = WAXIS_SCROLL_Y,
 } WacomEventAxis;
 
+typedef enum {
+	WLATENCY_READ,
+	WLATENCY_PARSE,
+	WLATENCY_DISPATCH,
+	WLATENCY_FILTER,
+	WLATENCY_EMIT,
+} WacomLatencyStage;
+
+#define WACOM_LATENCY_BUCKETS 16
+
+typedef enum {
+	WFRAME_PROXIMITY,
+	WFRAME_MOTION,
+	WFRAME_BUTTON,
+	WFRAME_KEY,
+} WacomFrameEntryType;
+
+/* One event of the frame signal, sent with the frame's axes if has_axes
+ * is set and without any axes otherwise */
+typedef struct {
+	WacomFrameEntryType type;
+	int code;		/* button or keycode */
+	gboolean state;		/* proximity in or is press */
+	gboolean is_absolute;	/* motion and button */
+	gboolean has_axes;
+} WacomFrameEntry;
+
 /* The pointer argument to all the event signals. If the mask is set for
  * a given axis, that value contains the current state of the axis */
 typedef struct {
@@ -210,6 +237,31 @@ WacomOptions *wacom_device_get_options(WacomDevice *device);
  */
 void wacom_device_set_runtime_option(WacomDevice *device, const char *name, const char *value);
 
+/**
+ * wacom_device_dump_flight_recorder:
+ * @path: the file to write to, it is created or truncated
+ *
+ * Write the flight recorder of this device to a file. The flight recorder
+ * holds the most recent events and how they were processed, see the
+ * "FlightRecorder" option. Use wacom-recorder-decode to convert the file
+ * into YAML.
+ *
+ * Returns: FALSE if the file could not be written, with errno set
+ */
+gboolean wacom_device_dump_flight_recorder(WacomDevice *device, const char *path);
+
+/**
+ * wacom_device_get_latency:
+ * @stage: the processing stage
+ * @buckets: (array fixed-size=16) (out caller-allocates): the histogram
+ *
+ * Get the histogram of the time from the kernel timestamp of a frame until
+ * it reached the given stage. Bucket n counts latencies of 2^n to
+ * 2^(n+1) - 1 us, the last bucket all longer latencies.
+ */
+void wacom_device_get_latency(WacomDevice *device, WacomLatencyStage stage,
+			      guint32 buckets[WACOM_LATENCY_BUCKETS]);
+
 /* The following getters are only available after wacom_device_setup() */
 
 int wacom_device_get_num_buttons(WacomDevice *device);
@@ -22,6 +22,7 @@
 #include "wacom-private.h"
 
 #include "xf86Wacom.h"
+#include "wcmSimClock.h"
 
 struct _WacomDriver {
 	GObject parent_instance;
@@ -36,6 +37,9 @@ enum {
 };
 static guint signals[LAST_SIGNAL] = { 0 };
 
+/* wcmTimeInMillis() has no context, so neither can the clock */
+static WacomSimClockPtr sim_clock;
+
 G_DEFINE_TYPE (WacomDriver, wacom_driver, G_TYPE_OBJECT)
 
 int wcmForeachDevice(WacomDevicePtr priv, WacomDeviceCallback func, void *data)
@@ -75,6 +79,27 @@ wacom_driver_get_devices(WacomDriver *driver)
 	return g_list_copy(driver->devices);
 }
 
+void
+wacom_driver_use_simulated_clock(WacomDriver *driver, guint64 start_usec)
+{
+	g_return_if_fail(sim_clock == NULL);
+
+	sim_clock = wcmSimClockNew(start_usec);
+}
+
+void
+wacom_driver_advance_clock(WacomDriver *driver, guint64 usec)
+{
+	if (sim_clock)
+		wcmSimClockAdvance(sim_clock, usec);
+}
+
+WacomSimClockPtr
+wacom_driver_get_simulated_clock(void)
+{
+	return sim_clock;
+}
+
 void
 wacom_driver_add_device(WacomDriver *driver, WacomDevice *device)
 {
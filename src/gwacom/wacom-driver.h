@@ -43,6 +43,34 @@ WacomDriver *wacom_driver_new(void);
  */
 GList *wacom_driver_get_devices(WacomDriver *driver);
 
+/**
+ * wacom_driver_use_simulated_clock:
+ * @driver: the driver instance
+ * @start_usec: the initial time in microseconds
+ *
+ * Switch the driver to a simulated clock that only advances with the
+ * timestamps of the events it processes. Timers, e.g. the tap-to-click
+ * timeout, fire when an event's timestamp passes their deadline, before
+ * that event is processed. Recorded events can then be replayed at any
+ * speed with the same gesture decisions as in real time. Without the
+ * simulated clock timers never fire.
+ *
+ * The clock is shared by all drivers in this process. Call this before
+ * the first device is added.
+ */
+void wacom_driver_use_simulated_clock(WacomDriver *driver, guint64 start_usec);
+
+/**
+ * wacom_driver_advance_clock:
+ * @driver: the driver instance
+ * @usec: the new time in microseconds
+ *
+ * Advance the simulated clock to @usec and fire all timers due until then,
+ * e.g. to flush a pending tap at the end of a replay. This does nothing
+ * unless wacom_driver_use_simulated_clock() was called.
+ */
+void wacom_driver_advance_clock(WacomDriver *driver, guint64 usec);
+
 G_END_DECLS
 
 
@@ -27,3 +27,6 @@ void *wacom_device_get_impl(WacomDevice *device);
 
 void wacom_driver_add_device(WacomDriver *driver, WacomDevice *device);
 void wacom_driver_remove_device(WacomDriver *driver, WacomDevice *device);
+
+/* NULL unless wacom_driver_use_simulated_clock() was called */
+struct _WacomSimClock *wacom_driver_get_simulated_clock(void);
@@ -20,10 +20,13 @@
 #include <config.h>
 
 #include <unistd.h>
+#include <stdlib.h>
 #include "xf86Wacom.h"
 #include "Xwacom.h"
 #include "wcmFilter.h"
+#include "wcmRecorder.h"
 #include "wcmTouchFilter.h"
+#include "wcmTrace.h"
 #include <xkbsrv.h>
 #include <xf86_OSproc.h>
 
@@ -95,6 +98,88 @@ Bool wcmDevSwitchModeCall(WacomDevicePtr priv, Bool absolute)
 	return TRUE;
 }
 
+/*****************************************************************************
+ * Event emission --
+ *   While wcmSendEvents runs, the events are collected in priv->frame and
+ *   sent with a single wcmEmitFrame(). Events from anywhere else, e.g.
+ *   timers, are sent right away.
+ ****************************************************************************/
+
+static void wcmFlushFrame(WacomDevicePtr priv)
+{
+	WacomFrame *frame = priv->frame;
+
+	if (!frame->nevents)
+		return;
+
+	wcmLatencyRecord(priv, LATENCY_EMIT);
+	wcmEmitFrame(priv, frame);
+	frame->nevents = 0;
+	memset(&frame->axes, 0, sizeof(frame->axes));
+}
+
+static void frameAdd(WacomDevicePtr priv, enum WacomFrameEventType type,
+		     int code, bool state, bool is_absolute, const WacomAxisData *axes)
+{
+	WacomFrame *frame = priv->frame;
+	bool has_axes = axes && axes->mask;
+	WacomFrameEvent *event;
+
+	/* A frame has a single set of axes, pan scrolling sends its own */
+	if (frame->nevents == WCM_MAX_FRAME_EVENTS ||
+	    (has_axes && frame->axes.mask &&
+	     memcmp(axes, &frame->axes, sizeof(*axes)) != 0))
+		wcmFlushFrame(priv);
+
+	if (has_axes && !frame->axes.mask)
+		frame->axes = *axes;
+
+	event = &frame->events[frame->nevents++];
+	event->type = type;
+	event->code = code;
+	event->state = state;
+	event->is_absolute = is_absolute;
+	event->has_axes = has_axes;
+}
+
+static void emitProximity(WacomDevicePtr priv, bool is_proximity_in,
+			  const WacomAxisData *axes)
+{
+	if (priv->frame)
+		frameAdd(priv, WACOM_FRAME_PROXIMITY, 0, is_proximity_in, FALSE, axes);
+	else
+		wcmEmitProximity(priv, is_proximity_in, axes);
+}
+
+static void emitMotion(WacomDevicePtr priv, bool is_absolute, const WacomAxisData *axes)
+{
+	if (priv->frame)
+		frameAdd(priv, WACOM_FRAME_MOTION, 0, FALSE, is_absolute, axes);
+	else {
+		wcmLatencyRecord(priv, LATENCY_EMIT);
+		wcmEmitMotion(priv, is_absolute, axes);
+	}
+}
+
+static void emitButton(WacomDevicePtr priv, bool is_absolute, int button, bool is_press,
+		       const WacomAxisData *axes)
+{
+	if (priv->frame)
+		frameAdd(priv, WACOM_FRAME_BUTTON, button, is_press, is_absolute, axes);
+	else {
+		wcmLatencyRecord(priv, LATENCY_EMIT);
+		wcmEmitButton(priv, is_absolute, button, is_press, axes);
+	}
+}
+
+static void emitKeycode(WacomDevicePtr priv, int keycode, int state)
+{
+	if (priv->frame)
+		frameAdd(priv, WACOM_FRAME_KEY, keycode, state, FALSE, NULL);
+	else
+		wcmEmitKeycode(priv, keycode, state);
+}
+
 static int wcmButtonPerNotch(WacomDevicePtr priv, int value, int threshold, int btn_positive, int btn_negative)
 {
 	int mode = is_absolute(priv);
@@ -104,8 +189,8 @@ static int wcmButtonPerNotch(WacomDevicePtr priv, int value, int threshold, int
 	WacomAxisData axes = {0};
 
 	for (i = 0; i < abs(notches); i++) {
-		wcmEmitButton(priv, mode, button, 1, &axes);
-		wcmEmitButton(priv, mode, button, 0, &axes);
+		emitButton(priv, mode, button, 1, &axes);
+		emitButton(priv, mode, button, 0, &axes);
 	}
 
 	return value % threshold;
@@ -145,7 +230,7 @@ static void wcmPanscroll(WacomDevicePtr priv, const WacomDeviceState *ds, int x,
 		WacomAxisData axes = {0};
 		wcmAxisSet(&axes, WACOM_AXIS_SCROLL_X, -delta_x * PANSCROLL_INCREMENT/threshold);
 		wcmAxisSet(&axes, WACOM_AXIS_SCROLL_Y, -delta_y * PANSCROLL_INCREMENT/threshold);
-		wcmEmitMotion(priv, FALSE, &axes);
+		emitMotion(priv, FALSE, &axes);
 	} else {
 		int accumulated_x = priv->wcmPanscrollState.x + delta_x;
 		int accumulated_y = priv->wcmPanscrollState.y + delta_y;
@@ -185,13 +270,86 @@ void wcmResetWheelAction(WacomDevicePtr priv, int index)
 	wcmActionCopy(&priv->wheel_actions[index], &new_action);
 }
 
-/* Main event hanlding function */
-int wcmReadPacket(WacomDevicePtr priv)
+/*****************************************************************************
+ * wcmReadFrames --
+ *   read() straight into the aligned event buffer and hand all complete
+ *   frames to the model by pointer. A partial frame at the end of the read
+ *   is moved to the front of the buffer and completed by the next read.
+ ****************************************************************************/
+
+static int wcmReadFrames(WacomDevicePtr priv)
 {
 	WacomCommonPtr common = priv->common;
-	int len, pos, cnt, remaining;
+	const size_t evsize = sizeof(struct input_event);
+	unsigned int nevents, consumed, nframes = 0;
+	ssize_t len;
 
-	DBG(10, common, "fd=%d\n", wcmGetFd(priv));
+	if (!common->evbuf)
+	{
+		void *buf;
+
+		if (posix_memalign(&buf, EVENT_BUFFER_ALIGN, EVENT_BUFFER_SIZE * evsize))
+			return -ENOMEM;
+		common->evbuf = buf;
+		common->evcount = 0;
+	}
+
+	/* A frame larger than the whole buffer can never complete. Its rest
+	 * is still to come, so replace it with a SYN_DROPPED the way the
+	 * kernel reports its own drops: the model drops everything up to
+	 * the next SYN_REPORT and resyncs. */
+	if (common->evcount >= EVENT_BUFFER_SIZE)
+	{
+		struct input_event *dropped = common->evbuf;
+
+		wcmLogSafe(priv, W_ERROR, "%s: Exceeded event buffer (%u), dropping events\n",
+			   priv->name, common->evcount);
+		common->wcmQueueOverflows += common->evcount;
+		*dropped = common->evbuf[common->evcount - 1];
+		dropped->type = EV_SYN;
+		dropped->code = SYN_DROPPED;
+		dropped->value = 0;
+		common->evcount = 1;
+	}
+
+	SYSCALL((len = read(wcmGetFd(priv), common->evbuf + common->evcount,
+			    (EVENT_BUFFER_SIZE - common->evcount) * evsize)));
+
+	if (len <= 0)
+	{
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		return -errno;
+	}
+
+	common->wcmReadTimeUs = wcmTimeInMicros();
+
+	/* evdev only ever returns whole events */
+	nevents = common->evcount + len / evsize;
+	consumed = common->wcmModel->ParseFrames(priv, common->evbuf, nevents, &nframes);
+	common->wcmFramesPerRead = nframes;
+
+	DBG(10, common, "read %zu events, %u frames, %u events pending\n",
+	    (size_t)len / evsize, nframes, nevents - consumed);
+
+	if (consumed < nevents && consumed > 0)
+		memmove(common->evbuf, common->evbuf + consumed,
+			(nevents - consumed) * evsize);
+	common->evcount = nevents - consumed;
+
+	return len;
+}
+
+/*****************************************************************************
+ * wcmReadBytes --
+ *   read() into the byte buffer and let the model parse as many packets as
+ *   are complete, for models without ParseFrames.
+ ****************************************************************************/
+
+static int wcmReadBytes(WacomDevicePtr priv)
+{
+	WacomCommonPtr common = priv->common;
+	int len, pos, cnt, remaining;
 
 	remaining = sizeof(common->buffer) - common->bufpos;
 
@@ -207,6 +365,8 @@ int wcmReadPacket(WacomDevicePtr priv)
 		return -errno;
 	}
 
+	common->wcmReadTimeUs = wcmTimeInMicros();
+
 	/* account for new data */
 	common->bufpos += len;
 	DBG(10, common, "buffer has %d bytes\n", common->bufpos);
@@ -240,6 +400,24 @@ int wcmReadPacket(WacomDevicePtr priv)
 	return pos;
 }
 
+/* Main event hanlding function */
+int wcmReadPacket(WacomDevicePtr priv)
+{
+	WacomCommonPtr common = priv->common;
+	int rc;
+
+	DBG(10, common, "fd=%d\n", wcmGetFd(priv));
+	WCM_PROBE1(read_entry, priv->name);
+
+	if (common->wcmModel->ParseFrames)
+		rc = wcmReadFrames(priv);
+	else
+		rc = wcmReadBytes(priv);
+
+	WCM_PROBE2(read_exit, priv->name, rc);
+	return rc;
+}
+
 
 /*****************************************************************************
  * wcmSendButtons --
@@ -327,7 +505,7 @@ static void wcmSendKeys (WacomDevicePtr priv, unsigned int current, unsigned int
 					break;
 			}
 			if (key)
-				wcmEmitKeycode(priv, key + 8, state);
+				emitKeycode(priv, key + 8, state);
 		}
 	}
 }
@@ -377,8 +555,8 @@ static void sendAction(WacomDevicePtr priv,  const WacomDeviceState* ds,
 						/* Don't send clicks in scroll mode */
 					}
 					else {
-						wcmEmitButton(priv, is_absolute(priv), btn_no,
-							      is_press, axes);
+						emitButton(priv, is_absolute(priv), btn_no,
+							   is_press, axes);
 					}
 				}
 				break;
@@ -386,7 +564,7 @@ static void sendAction(WacomDevicePtr priv,  const WacomDeviceState* ds,
 				{
 					int key_code = (action & AC_CODE);
 					int is_press = (action & AC_KEYBTNPRESS);
-					wcmEmitKeycode(priv, key_code, is_press);
+					emitKeycode(priv, key_code, is_press);
 				}
 				break;
 			case AC_MODETOGGLE:
@@ -419,8 +597,10 @@ static void sendAction(WacomDevicePtr priv,  const WacomDeviceState* ds,
 						break;
 
 					if (countPresses(btn_no, &keys[i], nkeys - i))
-						wcmEmitButton(priv, is_absolute(priv), btn_no,
-							      FALSE, axes);
+					{
+						emitButton(priv, is_absolute(priv), btn_no,
+							   FALSE, axes);
+					}
 				}
 				break;
 			case AC_KEY:
@@ -432,7 +612,7 @@ static void sendAction(WacomDevicePtr priv,  const WacomDeviceState* ds,
 						break;
 
 					if (countPresses(key_code, &keys[i], nkeys - i))
-						wcmEmitKeycode(priv, key_code, 0);
+						emitKeycode(priv, key_code, 0);
 				}
 				break;
 			case AC_PANSCROLL:
@@ -718,14 +898,14 @@ static void
 wcmSendPadEvents(WacomDevicePtr priv, const WacomDeviceState* ds, const WacomAxisData *axes)
 {
 	if (!priv->oldState.proximity && ds->proximity)
-		wcmEmitProximity(priv, TRUE, axes);
+		emitProximity(priv, TRUE, axes);
 
 	if (axes->mask || ds->buttons || ds->relwheel || ds->relwheel2 ||
 	    (ds->abswheel != priv->oldState.abswheel) || (ds->abswheel2 != priv->oldState.abswheel2))
 	{
 		sendCommonEvents(priv, ds, axes);
 
-		wcmEmitMotion(priv, TRUE, axes);
+		emitMotion(priv, TRUE, axes);
 	}
 	else
 	{
@@ -736,7 +916,7 @@ wcmSendPadEvents(WacomDevicePtr priv, const WacomDeviceState* ds, const WacomAxi
 	wcmSendKeys(priv, ds->keys, priv->oldState.keys);
 
 	if (priv->oldState.proximity && !ds->proximity)
-		wcmEmitProximity(priv, FALSE, axes);
+		emitProximity(priv, FALSE, axes);
 }
 
 /* Send events for all tools but pads */
@@ -787,13 +967,13 @@ wcmSendNonPadEvents(WacomDevicePtr priv, const WacomDeviceState *ds,
 	if (ds->proximity)
 	{
 		if (!priv->oldState.proximity)
-			wcmEmitProximity(priv, TRUE, axes);
+			emitProximity(priv, TRUE, axes);
 
 		/* Move the cursor to where it should be before sending button events */
 		if(!(priv->flags & BUTTONS_ONLY_FLAG) &&
 		   !(priv->flags & SCROLLMODE_FLAG && (!is_absolute(priv) || priv->oldState.buttons & 1)))
 		{
-			wcmEmitMotion(priv, is_absolute(priv), axes);
+			emitMotion(priv, is_absolute(priv), axes);
 			/* For relative events, do not repost
 			 * the valuators.  Otherwise, a button
 			 * event in sendCommonEvents will move the
@@ -817,7 +997,7 @@ wcmSendNonPadEvents(WacomDevicePtr priv, const WacomDeviceState *ds,
 			wcmSendButtons(priv, ds, buttons, axes);
 
 		if (priv->oldState.proximity)
-			wcmEmitProximity(priv, FALSE, axes);
+			emitProximity(priv, FALSE, axes);
 	} /* not in proximity */
 }
 
@@ -836,23 +1016,68 @@ wcmUpdateSerial(WacomDevicePtr priv, unsigned int serial, int id)
 	wcmUpdateSerialProperty(priv);
 }
 
+/*****************************************************************************
+ * wcmLatencyRecord --
+ *   Log-bucketed histograms of the time from the kernel timestamp of a
+ *   frame to each stage of its processing. Only frames with a monotonic
+ *   kernel timestamp are counted, events sent from timers are not.
+ ****************************************************************************/
+
+static inline void latencyAdd(WacomDevicePtr priv, enum WacomLatencyStage stage,
+			      uint64_t when)
+{
+	uint64_t frame = priv->common->wcmFrameTimeUs;
+	uint64_t delta;
+	int bucket = 0;
+
+	if (when < frame)
+		return;
+
+	delta = when - frame;
+	if (delta > 1)
+		bucket = min(63 - __builtin_clzll(delta), LATENCY_BUCKETS - 1);
+	priv->wcmLatency[stage][bucket]++;
+}
+
+void wcmLatencyRecord(WacomDevicePtr priv, enum WacomLatencyStage stage)
+{
+	if (priv->common->wcmFrameTimeUs)
+		latencyAdd(priv, stage, wcmTimeInMicros());
+}
+
 /*****************************************************************************
  * wcmSendEvents --
  *   Send events according to the device state.
  ****************************************************************************/
 
+/* Only format the axes when someone is listening, this runs for every event */
+static inline void dumpSendEvents(WacomDevicePtr priv, const WacomDeviceState* ds,
+				  const WacomAxisData *axes)
+{
+	char dump[1024];
+
+	if (!DBG_ENABLED(6, priv))
+		return;
+
+	wcmAxisDump(axes, dump, sizeof(dump));
+	DBG(6, priv, "%s o_prox=%d\tprox=%d\t%s\tid=%d"
+		"\tserial=%u\tbutton=%s\tbuttons=%u\n",
+		is_absolute(priv) ? "abs" : "rel", priv->oldState.proximity,
+		ds->proximity, dump, ds->device_id, ds->serial_num,
+		ds->buttons ? "true" : "false", ds->buttons);
+}
+
 void wcmSendEvents(WacomDevicePtr priv, const WacomDeviceState* ds)
 {
-#ifdef DEBUG
-	int is_button = !!(ds->buttons);
-#endif
 	int type = ds->device_type;
 	int id = ds->device_id;
 	unsigned int serial = ds->serial_num;
 	int x = ds->x;
 	int y = ds->y;
 	WacomAxisData axes = {0};
-	char dump[1024];
+	WacomFrame frame;
+
+	WCM_PROBE5(send_events, priv->name, type, ds->proximity, x, y);
 
 	if (priv->serial && serial != priv->serial)
 	{
@@ -918,12 +1143,8 @@ void wcmSendEvents(WacomDevicePtr priv, const WacomDeviceState* ds)
 		}
 	}
 
-	wcmAxisDump(&axes, dump, sizeof(dump));
-	DBG(6, priv, "%s o_prox=%d\tprox=%d\t%s\tid=%d"
-		"\tserial=%u\tbutton=%s\tbuttons=%u\n",
-		is_absolute(priv) ? "abs" : "rel", priv->oldState.proximity,
-		ds->proximity, dump, id, serial, is_button ? "true" : "false",
-		ds->buttons);
+	dumpSendEvents(priv, ds, &axes);
+	wcmRecordEmit(priv->common, ds, x, y);
 
 	/* when entering prox, replace the zeroed-out oldState with a copy of
 	 * the current state to prevent jumps. reset the prox and button state
@@ -941,6 +1162,10 @@ void wcmSendEvents(WacomDevicePtr priv, const WacomDeviceState* ds)
 		priv->oldState.keys = old_key_state;
 	}
 
+	frame.nevents = 0;
+	frame.axes.mask = 0;
+	priv->frame = &frame;
+
 	if (type == PAD_ID)
 		wcmSendPadEvents(priv, ds, &axes);
 	else {
@@ -949,6 +1174,9 @@ void wcmSendEvents(WacomDevicePtr priv, const WacomDeviceState* ds)
 			wcmSendNonPadEvents(priv, ds, &axes);
 	}
 
+	wcmFlushFrame(priv);
+	priv->frame = NULL;
+
 	if (ds->proximity)
 		wcmUpdateOldState(priv, ds, x, y);
 	else
@@ -960,12 +1188,26 @@ void wcmSendEvents(WacomDevicePtr priv, const WacomDeviceState* ds)
 	}
 }
 
+/**
+ * @return The device's suppress threshold for the given axis. A threshold
+ * of 0 uses the common suppress value, which disables all suppression if 0.
+ */
+static inline int suppressThreshold(const WacomDeviceRec *priv,
+				    enum WacomSuppressAxis axis)
+{
+	const WacomCommonRec *common = priv->common;
+
+	if (!common->wcmSuppress || !priv->wcmSuppressAxis[axis])
+		return common->wcmSuppress;
+	return priv->wcmSuppressAxis[axis];
+}
+
 /**
  * Determine whether device state has changed enough to warrant further
- * processing. The driver's "suppress" setting decides how much
- * movement/state change must occur before we process events to avoid
- * overloading the server with minimal changes (and getting fuzzy events).
- * wcmCheckSuppress ensures that events meet this standard.
+ * processing. The driver's "suppress" settings decide how much
+ * movement/state change must occur on each axis before we process events
+ * to avoid overloading the server with minimal changes (and getting fuzzy
+ * events). wcmCheckSuppress ensures that events meet this standard.
  *
  * @param dsOrig Previous device state
  * @param dsNew Current device state
@@ -975,11 +1217,12 @@ void wcmSendEvents(WacomDevicePtr priv, const WacomDeviceState* ds)
  * @retval SUPPRESS_NON_MOTION Suppress all data but motion data.
  */
 static enum WacomSuppressMode
-wcmCheckSuppress(WacomCommonPtr common,
+wcmCheckSuppress(WacomDevicePtr priv,
 		 const WacomDeviceState* dsOrig,
 		 WacomDeviceState* dsNew)
 {
-	int suppress = common->wcmSuppress;
+	WacomCommonPtr common = priv->common;
+	int suppress;
 	enum WacomSuppressMode returnV = SUPPRESS_NONE;
 
 	/* Ignore all other changes that occur after initial out-of-prox. */
@@ -994,19 +1237,21 @@ wcmCheckSuppress(WacomCommonPtr common,
 	if (dsOrig->stripx != dsNew->stripx) goto out;
 	if (dsOrig->stripy != dsNew->stripy) goto out;
 
-	/* FIXME: we should have different suppress values for different
-	 * axes with vastly different ranges.
-	 */
+	suppress = suppressThreshold(priv, SUPPRESS_AXIS_TILT);
 	if (abs(dsOrig->tiltx - dsNew->tiltx) > suppress) goto out;
 	if (abs(dsOrig->tilty - dsNew->tilty) > suppress) goto out;
+	suppress = suppressThreshold(priv, SUPPRESS_AXIS_PRESSURE);
 	if (abs(dsOrig->pressure - dsNew->pressure) > suppress) goto out;
+	suppress = suppressThreshold(priv, SUPPRESS_AXIS_THROTTLE);
 	if (abs(dsOrig->throttle - dsNew->throttle) > suppress) goto out;
+	suppress = suppressThreshold(priv, SUPPRESS_AXIS_ROTATION);
 	if (abs(dsOrig->rotation - dsNew->rotation) > suppress &&
 	    (1800 - abs(dsOrig->rotation - dsNew->rotation)) >  suppress) goto out;
 
 	/* look for change in absolute wheel position
 	 * or any relative wheel movement
 	 */
+	suppress = suppressThreshold(priv, SUPPRESS_AXIS_WHEEL);
 	if (abs(dsOrig->abswheel  - dsNew->abswheel)  > suppress) goto out;
 	if (abs(dsOrig->abswheel2 - dsNew->abswheel2) > suppress) goto out;
 	if (dsNew->relwheel != 0) goto out;
@@ -1019,6 +1264,7 @@ out:
 	 * pointer x/y, suppress all but cursor movement. This return value
 	 * is used in commonDispatchDevice to short-cut event processing.
 	 */
+	suppress = suppressThreshold(priv, SUPPRESS_AXIS_POSITION);
 	if ((abs(dsOrig->x - dsNew->x) > suppress) ||
 			(abs(dsOrig->y - dsNew->y) > suppress))
 	{
@@ -1138,9 +1384,12 @@ void wcmEvent(WacomCommonPtr common, unsigned int channel,
 	DBG(10, common, "channel = %u\n", channel);
 
 	/* sanity check the channel */
-	if (channel >= MAX_CHANNELS)
+	if (channel >= (unsigned int)common->wcmChannelCount)
 		return;
 
+	WCM_PROBE3(event, channel, pState->device_type, pState->serial_num);
+	wcmRecordChannel(common, channel, pState);
+
 	/* we must copy the state because certain types of filtering
 	 * will need to change the values (ie. for error correction) */
 	ds = *pState;
@@ -1196,10 +1445,7 @@ void wcmEvent(WacomCommonPtr common, unsigned int channel,
 	 * unnecessary quantization, and other annoying effects. */
 
 	/* save channel device state and device to which last event went */
-	memmove(pChannel->valid.states + 1,
-		pChannel->valid.states,
-		sizeof(WacomDeviceState) * (common->wcmRawSample - 1));
-	pChannel->valid.state = ds; /*save last raw sample */
+	wcmChannelPushState(pChannel, &ds); /*save last raw sample */
 	if (pChannel->nSamples < common->wcmRawSample) ++pChannel->nSamples;
 
 	/* arbitrate pointer control */
@@ -1219,7 +1465,7 @@ void wcmEvent(WacomCommonPtr common, unsigned int channel,
 
 	if ((ds.device_type == TOUCH_ID) && common->wcmTouch)
 	{
-		wcmGestureFilter(priv, ds.serial_num - 1);
+		wcmGestureFilter(priv, ds.serial_num - 1, ds.time);
 		/*
 		 * When using XI 2.2 multitouch events don't do common dispatching
 		 * for direct touch devices
@@ -1376,7 +1622,7 @@ static void detectPressureIssue(WacomDevicePtr priv,
 static void commonDispatchDevice(WacomDevicePtr priv,
 				 const WacomChannelPtr pChannel)
 {
-	WacomDeviceState* ds = &pChannel->valid.states[0];
+	const WacomDeviceState *ds = wcmChannelState(pChannel, 0);
 	WacomCommonPtr common = priv->common;
 	WacomDeviceState filtered;
 	enum WacomSuppressMode suppress;
@@ -1393,13 +1639,21 @@ static void commonDispatchDevice(WacomDevicePtr priv,
 		return;
 	}
 
+	if (common->wcmFrameTimeUs)
+	{
+		latencyAdd(priv, LATENCY_READ, common->wcmReadTimeUs);
+		latencyAdd(priv, LATENCY_PARSE, common->wcmParseTimeUs);
+		latencyAdd(priv, LATENCY_DISPATCH, wcmTimeInMicros());
+	}
+
 	DBG(10, common, "device type = %d\n", ds->device_type);
 
-	filtered = pChannel->valid.state;
+	filtered = *ds;
 
 	/* Device transformations come first */
 	if (priv->serial && filtered.serial_num != priv->serial)
 	{
+		priv->wcmSerialMismatch++;
 		DBG(10, priv, "serial number"
 			" is %u but your system configured %u\n",
 			filtered.serial_num, priv->serial);
@@ -1473,12 +1727,28 @@ static void commonDispatchDevice(WacomDevicePtr priv,
 			wcmResetSampleCounter(pChannel);
 
 		wcmFilterCoord(common,pChannel,&filtered);
+
+		/* Snap back to the true position on tip-down and
+		 * button changes so clicks land where the pen is */
+		if (common->wcmPrediction && is_absolute(priv))
+			wcmPredictCoord(priv, pChannel, &filtered,
+					filtered.buttons != priv->oldState.buttons);
 	}
 
+	wcmLatencyRecord(priv, LATENCY_FILTER);
+	wcmRecordFilter(common, pChannel - common->wcmChannel, &filtered);
+
 	/* skip event if we don't have enough movement */
-	suppress = wcmCheckSuppress(common, &priv->oldState, &filtered);
+	suppress = wcmCheckSuppress(priv, &priv->oldState, &filtered);
+	wcmRecordSuppress(common, pChannel - common->wcmChannel, suppress);
+	WCM_PROBE3(suppress, priv->name, pChannel - common->wcmChannel, suppress);
 	if (suppress == SUPPRESS_ALL)
+	{
+		priv->wcmSuppressedAll++;
 		return;
+	}
+	if (suppress == SUPPRESS_NON_MOTION)
+		priv->wcmSuppressedNonMotion++;
 
 	/* Store cursor hardware prox for next use */
 	if (IsCursor(priv))
@@ -1627,16 +1897,19 @@ void wcmSoftOutEvent(WacomDevicePtr priv)
  */
 static int applyPressureCurve(WacomDevicePtr pDev, const WacomDeviceStatePtr pState)
 {
+	/* the curve may be replaced by the main thread at any time */
+	const WacomPressureCurve *curve = __atomic_load_n(&pDev->pPressCurve,
+							  __ATOMIC_ACQUIRE);
 	/* clip the pressure */
 	int p = max(0, pState->pressure);
 
 	p = min(pDev->maxCurve, p);
 
 	/* apply pressure curve function */
-	if (pDev->pPressCurve == NULL)
+	if (curve == NULL)
 		return p;
 	else
-		return pDev->pPressCurve[p];
+		return wcmPressureCurveValue(curve, min(curve->maxCurve, p));
 }
 
 /*****************************************************************************
@@ -1697,6 +1970,10 @@ WacomCommonPtr wcmNewCommon(void)
 			/* transmit position if increment is superior */
 	common->wcmRawSample = DEFAULT_SAMPLES;
 			/* number of raw data to be used to for filtering */
+	common->wcmFilter = FILTER_AVERAGE;
+	common->wcmFilterMinCutoff = DEFAULT_FILTER_MIN_CUTOFF;
+	common->wcmFilterBeta = DEFAULT_FILTER_BETA;
+	common->wcmPrediction = 0;
 	common->wcmPanscrollThreshold = 0;
 	common->wcmPressureRecalibration = 1;
 	return common;
@@ -1714,6 +1991,9 @@ void wcmFreeCommon(WacomCommonPtr *ptr)
 	if (--common->refcnt == 0)
 	{
 		free(common->private);
+		free(common->wcmChannel);
+		free(common->evbuf);
+		wcmRecorderFree(common);
 		while (common->serials)
 		{
 			WacomToolPtr next;
@@ -1821,6 +2101,52 @@ TEST_CASE(test_get_wheel_button)
 }
 
 
+TEST_CASE(test_channel_history)
+{
+	WacomChannel channel = {0};
+	WacomDeviceState ds = {0};
+
+	/* zeroed channel has a zeroed history */
+	for (unsigned int age = 0; age < MAX_SAMPLES; age++)
+		assert(wcmChannelState(&channel, age)->x == 0);
+
+	for (int i = 1; i <= 3 * MAX_SAMPLES / 2; i++)
+	{
+		ds.x = i;
+		wcmChannelPushState(&channel, &ds);
+
+		for (int age = 0; age < MAX_SAMPLES; age++)
+		{
+			int expected = (i - age > 0) ? i - age : 0;
+			assert(wcmChannelState(&channel, age)->x == expected);
+		}
+	}
+
+	/* ages past the ring read as zeroed, they don't wrap around */
+	assert(wcmChannelState(&channel, MAX_SAMPLES)->x == 0);
+	assert(wcmChannelState(&channel, MAX_SAMPLES + 1)->x == 0);
+
+	/* writes to the current state land in the history */
+	wcmChannelCurrentState(&channel)->buttons = 1;
+	ds.x++;
+	wcmChannelPushState(&channel, &ds);
+	assert(wcmChannelState(&channel, 0)->buttons == 0);
+	assert(wcmChannelState(&channel, 1)->buttons == 1);
+
+	/* a cleared history reads as zeroed until written again */
+	wcmChannelClearHistory(&channel);
+	for (unsigned int age = 0; age < MAX_SAMPLES; age++)
+		assert(wcmChannelState(&channel, age)->x == 0);
+	for (unsigned int i = 0; i < MAX_SAMPLES; i++)
+		assert(channel.valid.states[i].x != 0);
+
+	ds.x = 42;
+	wcmChannelPushState(&channel, &ds);
+	assert(wcmChannelState(&channel, 0)->x == 42);
+	for (unsigned int age = 1; age < MAX_SAMPLES; age++)
+		assert(wcmChannelState(&channel, age)->x == 0);
+}
+
 TEST_CASE(test_common_ref)
 {
 	WacomCommonPtr common;
@@ -1949,20 +2275,22 @@ TEST_CASE(test_normalize_pressure)
 TEST_CASE(test_suppress)
 {
 	enum WacomSuppressMode rc;
+	WacomDeviceRec priv = {0};
 	WacomCommonRec common = {0};
 	WacomDeviceState old = {0},
 			 new = {0};
 
+	priv.common = &common;
 	common.wcmSuppress = 2;
 
-	rc = wcmCheckSuppress(&common, &old, &new);
+	rc = wcmCheckSuppress(&priv, &old, &new);
 	assert(rc == SUPPRESS_ALL);
 
 	/* proximity, buttons and strip send for any change */
 
 #define test_any_suppress(field) \
 	old.field = 1; \
-	rc = wcmCheckSuppress(&common, &old, &new); \
+	rc = wcmCheckSuppress(&priv, &old, &new); \
 	assert(rc == SUPPRESS_NONE); \
 	new.field = old.field;
 
@@ -1979,16 +2307,16 @@ TEST_CASE(test_suppress)
 	/* test negative and positive transition */
 #define test_above_suppress(field) \
 	old.field = common.wcmSuppress; \
-	rc = wcmCheckSuppress(&common, &old, &new); \
+	rc = wcmCheckSuppress(&priv, &old, &new); \
 	assert(rc == SUPPRESS_ALL); \
 	old.field = common.wcmSuppress + 1; \
-	rc = wcmCheckSuppress(&common, &old, &new); \
+	rc = wcmCheckSuppress(&priv, &old, &new); \
 	assert(rc == SUPPRESS_NONE); \
 	old.field = -common.wcmSuppress; \
-	rc = wcmCheckSuppress(&common, &old, &new); \
+	rc = wcmCheckSuppress(&priv, &old, &new); \
 	assert(rc == SUPPRESS_ALL); \
 	old.field = -common.wcmSuppress - 1; \
-	rc = wcmCheckSuppress(&common, &old, &new); \
+	rc = wcmCheckSuppress(&priv, &old, &new); \
 	assert(rc == SUPPRESS_NONE); \
 	new.field = old.field;
 
@@ -2001,13 +2329,13 @@ TEST_CASE(test_suppress)
 
 	/* any movement on relwheel counts */
 	new.relwheel = 1;
-	rc = wcmCheckSuppress(&common, &old, &new);
+	rc = wcmCheckSuppress(&priv, &old, &new);
 	assert(rc == SUPPRESS_NONE);
 	new.relwheel = 0;
 
 	/* any movement on relwheel2 counts */
 	new.relwheel2 = 1;
-	rc = wcmCheckSuppress(&common, &old, &new);
+	rc = wcmCheckSuppress(&priv, &old, &new);
 	assert(rc == SUPPRESS_NONE);
 	new.relwheel2 = 0;
 
@@ -2015,19 +2343,19 @@ TEST_CASE(test_suppress)
 
 	/* not enough movement */
 	new.x = common.wcmSuppress;
-	rc = wcmCheckSuppress(&common, &old, &new);
+	rc = wcmCheckSuppress(&priv, &old, &new);
 	assert(rc == SUPPRESS_ALL);
 	assert(old.x == new.x);
 	assert(old.y == new.y);
 
 	/* only x axis above thresh */
 	new.x = common.wcmSuppress + 1;
-	rc = wcmCheckSuppress(&common, &old, &new);
+	rc = wcmCheckSuppress(&priv, &old, &new);
 	assert(rc == SUPPRESS_NON_MOTION);
 
 	/* x and other field above thres */
 	new.pressure = ~old.pressure;
-	rc = wcmCheckSuppress(&common, &old, &new);
+	rc = wcmCheckSuppress(&priv, &old, &new);
 	assert(rc == SUPPRESS_NONE);
 
 	new.pressure = old.pressure;
@@ -2035,21 +2363,393 @@ TEST_CASE(test_suppress)
 
 	/* y axis movement */
 	new.y = common.wcmSuppress;
-	rc = wcmCheckSuppress(&common, &old, &new);
+	rc = wcmCheckSuppress(&priv, &old, &new);
 	assert(rc == SUPPRESS_ALL);
 	assert(old.x == new.x);
 	assert(old.y == new.y);
 
 	new.y = common.wcmSuppress + 1;
-	rc = wcmCheckSuppress(&common, &old, &new);
+	rc = wcmCheckSuppress(&priv, &old, &new);
 	assert(rc == SUPPRESS_NON_MOTION);
 
 	new.pressure = ~old.pressure;
-	rc = wcmCheckSuppress(&common, &old, &new);
+	rc = wcmCheckSuppress(&priv, &old, &new);
 	assert(rc == SUPPRESS_NONE);
 	new.pressure = old.pressure;
 }
 
+TEST_CASE(test_suppress_axis)
+{
+	enum WacomSuppressMode rc;
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	WacomDeviceState old = {0},
+			 new = {0};
+
+	priv.common = &common;
+	common.wcmSuppress = 2;
+	priv.wcmSuppressAxis[SUPPRESS_AXIS_POSITION] = 10;
+	priv.wcmSuppressAxis[SUPPRESS_AXIS_PRESSURE] = 1;
+	old.proximity = new.proximity = 1;
+
+	/* position uses its own threshold */
+	new.x = 10;
+	rc = wcmCheckSuppress(&priv, &old, &new);
+	assert(rc == SUPPRESS_ALL);
+	assert(new.x == old.x);
+
+	new.y = 11;
+	rc = wcmCheckSuppress(&priv, &old, &new);
+	assert(rc == SUPPRESS_NON_MOTION);
+	new.y = old.y;
+
+	/* pressure passes below the common threshold */
+	new.pressure = 2;
+	rc = wcmCheckSuppress(&priv, &old, &new);
+	assert(rc == SUPPRESS_NONE);
+	new.pressure = 1;
+	rc = wcmCheckSuppress(&priv, &old, &new);
+	assert(rc == SUPPRESS_ALL);
+	new.pressure = old.pressure;
+
+	/* unset axes fall back to the common threshold */
+	new.tiltx = 2;
+	rc = wcmCheckSuppress(&priv, &old, &new);
+	assert(rc == SUPPRESS_ALL);
+	new.tiltx = 3;
+	rc = wcmCheckSuppress(&priv, &old, &new);
+	assert(rc == SUPPRESS_NONE);
+	new.tiltx = old.tiltx;
+
+	/* the thresholds are per device, another tool on the same tablet
+	 * uses the common threshold */
+	{
+		WacomDeviceRec other = {0};
+
+		other.common = &common;
+		new.x = 10;
+		rc = wcmCheckSuppress(&other, &old, &new);
+		assert(rc == SUPPRESS_NON_MOTION);
+		new.x = old.x;
+	}
+
+	/* Suppress 0 disables suppression on all axes */
+	common.wcmSuppress = 0;
+	new.x = 1;
+	rc = wcmCheckSuppress(&priv, &old, &new);
+	assert(rc == SUPPRESS_NON_MOTION);
+	assert(new.x == 1);
+}
+
+TEST_CASE(test_serial_mismatch)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	WacomChannel channel = {0};
+	WacomDeviceState ds = { .device_type = STYLUS_ID, .proximity = 1,
+				.serial_num = 7 };
+
+	priv.common = &common;
+	priv.flags = STYLUS_ID;
+	priv.serial = 5;
+
+	wcmChannelPushState(&channel, &ds);
+	commonDispatchDevice(&priv, &channel);
+	assert(priv.wcmSerialMismatch == 1);
+	commonDispatchDevice(&priv, &channel);
+	assert(priv.wcmSerialMismatch == 2);
+
+	/* events without a device type are dropped before the serial check */
+	ds.device_type = 0;
+	wcmChannelPushState(&channel, &ds);
+	commonDispatchDevice(&priv, &channel);
+	assert(priv.wcmSerialMismatch == 2);
+}
+
+TEST_CASE(test_latency_buckets)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	const struct {
+		uint64_t delta;
+		int bucket;
+	} cases[] = {
+		{ 0, 0 }, { 1, 0 }, { 2, 1 }, { 3, 1 }, { 4, 2 },
+		{ 1000, 9 }, { 32767, 14 }, { 32768, 15 }, { 1 << 30, 15 },
+	};
+
+	priv.common = &common;
+
+	/* outside of a frame nothing is counted */
+	wcmLatencyRecord(&priv, LATENCY_EMIT);
+	for (int b = 0; b < LATENCY_BUCKETS; b++)
+		assert(priv.wcmLatency[LATENCY_EMIT][b] == 0);
+
+	common.wcmFrameTimeUs = 1000000;
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++)
+	{
+		latencyAdd(&priv, LATENCY_FILTER, common.wcmFrameTimeUs + cases[i].delta);
+		assert(priv.wcmLatency[LATENCY_FILTER][cases[i].bucket] > 0);
+		memset(priv.wcmLatency, 0, sizeof(priv.wcmLatency));
+	}
+
+	/* a stage before the frame's timestamp is not counted */
+	latencyAdd(&priv, LATENCY_READ, common.wcmFrameTimeUs - 1);
+	for (int b = 0; b < LATENCY_BUCKETS; b++)
+		assert(priv.wcmLatency[LATENCY_READ][b] == 0);
+
+	/* each stage has its own histogram */
+	latencyAdd(&priv, LATENCY_EMIT, common.wcmFrameTimeUs + 1000);
+	assert(priv.wcmLatency[LATENCY_EMIT][9] == 1);
+	for (int b = 0; b < LATENCY_BUCKETS; b++)
+		assert(priv.wcmLatency[LATENCY_FILTER][b] == 0);
+}
+
+TEST_CASE(test_frame_collect)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	WacomFrame frame = {0};
+	WacomAxisData axes = {0}, none = {0};
+
+	priv.common = &common;
+	priv.frame = &frame;
+	wcmAxisSet(&axes, WACOM_AXIS_X, 100);
+	wcmAxisSet(&axes, WACOM_AXIS_PRESSURE, 50);
+
+	emitProximity(&priv, TRUE, &axes);
+	emitMotion(&priv, FALSE, &axes);
+	emitButton(&priv, FALSE, 3, TRUE, &none);
+	emitKeycode(&priv, 37, 1);
+	emitButton(&priv, TRUE, 1, FALSE, &axes);
+
+	assert(frame.nevents == 5);
+	assert(memcmp(&frame.axes, &axes, sizeof(axes)) == 0);
+
+	assert(frame.events[0].type == WACOM_FRAME_PROXIMITY);
+	assert(frame.events[0].state && frame.events[0].has_axes);
+	assert(frame.events[1].type == WACOM_FRAME_MOTION);
+	assert(!frame.events[1].is_absolute && frame.events[1].has_axes);
+	assert(frame.events[2].type == WACOM_FRAME_BUTTON);
+	assert(frame.events[2].code == 3 && frame.events[2].state);
+	assert(!frame.events[2].has_axes);
+	assert(frame.events[3].type == WACOM_FRAME_KEY);
+	assert(frame.events[3].code == 37 && frame.events[3].state);
+	assert(!frame.events[3].has_axes);
+	assert(frame.events[4].type == WACOM_FRAME_BUTTON);
+	assert(frame.events[4].is_absolute && !frame.events[4].state);
+	assert(frame.events[4].has_axes);
+}
+
+/* Check a post the frontend recorded, only the valuators in mask */
+static void assertPost(const struct wcm_test_post *post, enum WacomFrameEventType type,
+		       int code, int state, unsigned int mask, int x, int scroll_y)
+{
+	assert(post->type == type);
+	assert(post->code == code);
+	assert(post->state == state);
+	assert(post->valuator_mask == mask);
+	assert(post->nvaluators == __builtin_popcount(mask));
+	if (mask & 0x1)
+		assert(post->valuators[0] == x);
+	if (mask & 0x80)
+		assert(post->valuators[7] == scroll_y);
+}
+
+TEST_CASE(test_frame_flush)
+{
+	InputInfoRec pInfo = {0};
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	WacomFrame frame = {0};
+	WacomAxisData a = {0}, b = {0}, none = {0};
+	const struct wcm_test_post *post = wcm_test_posts;
+
+	priv.common = &common;
+	priv.frame = &frame;
+	priv.frontend = &pInfo;
+	priv.valuator_mask = valuator_mask_new(8);
+	wcmAxisSet(&a, WACOM_AXIS_X, 100);
+	wcmAxisSet(&b, WACOM_AXIS_X, 100);
+	wcmAxisSet(&b, WACOM_AXIS_SCROLL_Y, -5);
+
+	/* an event with other axes starts a new frame, events without
+	 * axes don't */
+	wcm_test_nposts = 0;
+	emitMotion(&priv, TRUE, &a);
+	emitButton(&priv, TRUE, 4, TRUE, &none);
+	assert(wcm_test_nposts == 0);
+	emitMotion(&priv, FALSE, &b);
+	assert(wcm_test_nposts == 2);
+	emitButton(&priv, TRUE, 1, TRUE, &a);
+	assert(wcm_test_nposts == 3);
+	wcmFlushFrame(&priv);
+	assert(wcm_test_nposts == 4);
+	assert(frame.nevents == 0);
+
+	assertPost(&post[0], WACOM_FRAME_MOTION, 0, 0, 0x1, 100, 0);
+	assert(post[0].is_absolute);
+	assertPost(&post[1], WACOM_FRAME_BUTTON, 4, 1, 0, 0, 0);
+	assertPost(&post[2], WACOM_FRAME_MOTION, 0, 0, 0x81, 100, -5);
+	assert(!post[2].is_absolute);
+	assertPost(&post[3], WACOM_FRAME_BUTTON, 1, 1, 0x1, 100, 0);
+
+	/* a full frame is sent before the next event */
+	wcm_test_nposts = 0;
+	for (int i = 0; i <= WCM_MAX_FRAME_EVENTS; i++)
+		emitKeycode(&priv, 10 + i, i & 1);
+	assert(wcm_test_nposts == WCM_MAX_FRAME_EVENTS);
+	assertPost(&post[WCM_MAX_FRAME_EVENTS - 1], WACOM_FRAME_KEY,
+		   10 + WCM_MAX_FRAME_EVENTS - 1, 1, 0, 0, 0);
+	assert(frame.nevents == 1);
+	assert(frame.events[0].code == 10 + WCM_MAX_FRAME_EVENTS);
+	wcmFlushFrame(&priv);
+	assert(wcm_test_nposts == WCM_MAX_FRAME_EVENTS + 1);
+	assertPost(&post[WCM_MAX_FRAME_EVENTS], WACOM_FRAME_KEY,
+		   10 + WCM_MAX_FRAME_EVENTS, 0, 0, 0, 0);
+
+	/* a frame mixing events with and without axes posts them in the
+	 * order they came in, each with the axes it was given */
+	{
+		const struct {
+			enum WacomFrameEventType type;
+			int code;
+			int state;
+			unsigned int mask;
+		} sequence[] = {
+			{ WACOM_FRAME_PROXIMITY, 0, 1, 0x1 },
+			{ WACOM_FRAME_BUTTON, 2, 1, 0 },
+			{ WACOM_FRAME_MOTION, 0, 0, 0x1 },
+			{ WACOM_FRAME_KEY, 50, 1, 0 },
+			{ WACOM_FRAME_BUTTON, 2, 0, 0x1 },
+			{ WACOM_FRAME_BUTTON, 3, 1, 0 },
+		};
+
+		wcm_test_nposts = 0;
+		emitProximity(&priv, TRUE, &a);
+		emitButton(&priv, TRUE, 2, TRUE, &none);
+		emitMotion(&priv, TRUE, &a);
+		emitKeycode(&priv, 50, 1);
+		emitButton(&priv, TRUE, 2, FALSE, &a);
+		emitButton(&priv, TRUE, 3, TRUE, &none);
+		assert(wcm_test_nposts == 0);
+		wcmFlushFrame(&priv);
+
+		assert(wcm_test_nposts == ARRAY_SIZE(sequence));
+		for (size_t i = 0; i < ARRAY_SIZE(sequence); i++)
+			assertPost(&post[i], sequence[i].type, sequence[i].code,
+				   sequence[i].state, sequence[i].mask, 100, 0);
+	}
+
+	free(priv.valuator_mask);
+}
+
+
+/* A stylus event with every pen axis set */
+static void benchStylusAxes(WacomAxisData *axes)
+{
+	wcmAxisSet(axes, WACOM_AXIS_X, 12345);
+	wcmAxisSet(axes, WACOM_AXIS_Y, 23456);
+	wcmAxisSet(axes, WACOM_AXIS_PRESSURE, 1024);
+	wcmAxisSet(axes, WACOM_AXIS_TILT_X, -20);
+	wcmAxisSet(axes, WACOM_AXIS_TILT_Y, 35);
+	wcmAxisSet(axes, WACOM_AXIS_WHEEL, 900);
+}
+
+/* The per-event cost of wcmSendEvents at DebugLevel 0, a stylus moving
+ * across the tablet. The frontend posts to the test module's recorder. */
+BENCH_CASE(bench_send_events_debug_off)
+{
+	InputInfoRec pInfo = {0};
+	WacomCommonRec common = {0};
+	WacomDeviceRec priv = {0};
+	WacomDeviceState ds = { .device_type = STYLUS_ID, .device_id = STYLUS_DEVICE_ID,
+				.serial_num = 1, .proximity = 1, .pressure = 1024,
+				.tiltx = -20, .tilty = 35 };
+
+	priv.common = &common;
+	priv.frontend = &pInfo;
+	priv.valuator_mask = valuator_mask_new(8);
+	priv.flags = STYLUS_ID | ABSOLUTE_FLAG;
+	priv.cur_serial = ds.serial_num;
+	priv.cur_device_id = ds.device_id;
+	priv.oldState = ds;
+	priv.bottomX = priv.valuatorMaxX = 44800;
+	priv.bottomY = priv.valuatorMaxY = 29600;
+
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		ds.x = 10000 + (i & 1023);
+		ds.y = 10000 + (i & 511);
+		wcm_test_nposts = 0;
+		wcmSendEvents(&priv, &ds);
+	}
+
+	free(priv.valuator_mask);
+}
+
+/* What every event paid for the axis dump before it was guarded */
+BENCH_CASE(bench_axis_dump)
+{
+	WacomAxisData axes = {0};
+	char dump[1024];
+
+	benchStylusAxes(&axes);
+	for (unsigned int i = 0; i < iterations; i++)
+		wcmAxisDump(&axes, dump, sizeof(dump));
+}
+
+/* A hovering pen that jitters around the suppress threshold */
+BENCH_CASE(bench_check_suppress)
+{
+	WacomCommonRec common = { .wcmSuppress = DEFAULT_SUPPRESS };
+	WacomDeviceRec priv = { .common = &common };
+	WacomDeviceState old = { .device_type = STYLUS_ID, .proximity = 1,
+				 .x = 10000, .y = 10000, .pressure = 100 };
+	WacomDeviceState new = old;
+
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		new.x = old.x + (i & 3);
+		new.pressure = old.pressure + (i & 7);
+		bench_keep(wcmCheckSuppress(&priv, &old, &new));
+	}
+}
+
+/* A touch ring spinning through its wrap-around, and a bitwise strip */
+BENCH_CASE(bench_scroll_delta)
+{
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		bench_keep(getScrollDelta(i % 72, (i + 71) % 72, 71, 0));
+		bench_keep(getScrollDelta(1 << (i % 13), 1 << ((i + 1) % 13), 0, AXIS_BITWISE));
+	}
+}
+
+/* A tablet mapped to a smaller area and rotated */
+BENCH_CASE(bench_rotate_and_scale)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = { .wcmRotate = ROTATE_CW };
+
+	priv.common = &common;
+	priv.valuatorMaxX = 44800;
+	priv.valuatorMaxY = 29600;
+	priv.topX = 1000;
+	priv.bottomX = 40000;
+	priv.topY = 500;
+	priv.bottomY = 25000;
+
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		int x = i % 44800, y = i % 29600;
+
+		wcmRotateAndScaleCoordinates(&priv, &x, &y);
+		bench_keep(x);
+		bench_keep(y);
+	}
+}
+
 
 #endif
 
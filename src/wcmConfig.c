@@ -128,6 +128,7 @@ static void wcmFree(WacomDevicePtr priv)
 	wcmTimerFree(priv->serial_timer);
 	wcmTimerFree(priv->tap_timer);
 	wcmTimerFree(priv->touch_timer);
+	wcmFreePressureCurve(&priv->pPressCurve);
 	free(priv->tool);
 	wcmFreeCommon(&priv->common);
 	free(priv->name);
@@ -20,6 +20,7 @@
 #include <config.h>
 
 #include <math.h>
+#include <stdint.h>
 #include "xf86Wacom.h"
 #include "wcmFilter.h"
 #include "wcmPressureCurve.h"
@@ -36,122 +37,339 @@ int wcmCheckPressureCurveValues(int x0, int y0, int x1, int y1)
 }
 
 
+/* Curves currently in use, see wcmRefPressureCurve() */
+static WacomPressureCurvePtr pressureCurves;
+
+static WacomPressureCurvePtr wcmNewPressureCurve(const int ctrl[4], int maxCurve)
+{
+	WacomPressureCurvePtr curve;
+	int *table;
+
+	curve = calloc(1, sizeof(*curve));
+	table = calloc(maxCurve + 1, sizeof(*table));
+	if (!curve || !table)
+		goto error;
+
+	filterCurveToLine(table, maxCurve,
+			0.0, 0.0,               /* bottom left  */
+			ctrl[0]/100.0, ctrl[1]/100.0, /* control point 1 */
+			ctrl[2]/100.0, ctrl[3]/100.0, /* control point 2 */
+			1.0, 1.0);              /* top right */
+
+	/* Most curves fit into 16 bits, a quarter of the cache footprint */
+	if (maxCurve <= UINT16_MAX)
+	{
+		int i;
+
+		curve->narrow = calloc(maxCurve + 1, sizeof(*curve->narrow));
+		if (!curve->narrow)
+			goto error;
+		for (i = 0; i <= maxCurve; i++)
+			curve->narrow[i] = table[i];
+		free(table);
+	} else
+		curve->wide = table;
+
+	memcpy(curve->ctrl, ctrl, sizeof(curve->ctrl));
+	curve->maxCurve = maxCurve;
+	curve->refcnt = 1;
+
+	return curve;
+
+error:
+	free(table);
+	free(curve);
+	return NULL;
+}
+
+/**
+ * Get a reference to the curve for the given control points and range,
+ * building it if no device uses it yet. Devices with identical curves
+ * share one table. Use wcmFreePressureCurve() to drop the reference.
+ *
+ * @return The curve or NULL if out of memory.
+ */
+WacomPressureCurvePtr wcmRefPressureCurve(const int ctrl[4], int maxCurve)
+{
+	WacomPressureCurvePtr curve;
+
+	for (curve = pressureCurves; curve; curve = curve->next)
+	{
+		if (curve->maxCurve == maxCurve &&
+		    memcmp(curve->ctrl, ctrl, sizeof(curve->ctrl)) == 0)
+		{
+			curve->refcnt++;
+			return curve;
+		}
+	}
+
+	curve = wcmNewPressureCurve(ctrl, maxCurve);
+	if (curve)
+	{
+		curve->next = pressureCurves;
+		pressureCurves = curve;
+	}
+
+	return curve;
+}
+
+/**
+ * Drop a reference to a curve and free it once unused. The pointer is
+ * reset to NULL.
+ */
+void wcmFreePressureCurve(WacomPressureCurvePtr *ptr)
+{
+	WacomPressureCurvePtr curve = *ptr;
+	WacomPressureCurvePtr *prev;
+
+	if (!curve)
+		return;
+
+	__atomic_store_n(ptr, NULL, __ATOMIC_RELEASE);
+
+	if (--curve->refcnt > 0)
+		return;
+
+	for (prev = &pressureCurves; *prev; prev = &(*prev)->next)
+	{
+		if (*prev == curve)
+		{
+			*prev = curve->next;
+			break;
+		}
+	}
+
+	/* the input thread may still be looking up a value */
+	wcmSyncInputThread();
+
+	free(curve->narrow);
+	free(curve->wide);
+	free(curve);
+}
+
 /*****************************************************************************
  * wcmSetPressureCurve -- apply user-defined curve to pressure values
  ****************************************************************************/
 void wcmSetPressureCurve(WacomDevicePtr pDev, int x0, int y0,
 	int x1, int y1)
 {
+	int ctrl[4] = { x0, y0, x1, y1 };
+	WacomPressureCurvePtr curve = NULL, old;
+
 	/* sanity check values */
 	if (!wcmCheckPressureCurveValues(x0, y0, x1, y1))
 		return;
 
 	/* A NULL pPressCurve indicates the (default) linear curve */
-	if (x0 == 0 && y0 == 0 && x1 == 100 && y1 == 100) {
-		free(pDev->pPressCurve);
-		pDev->pPressCurve = NULL;
-	}
-	else if (!pDev->pPressCurve) {
-		pDev->pPressCurve = calloc(FILTER_PRESSURE_RES+1, sizeof(*pDev->pPressCurve));
+	if (!(x0 == 0 && y0 == 0 && x1 == 100 && y1 == 100)) {
+		curve = wcmRefPressureCurve(ctrl, pDev->maxCurve);
 
-		if (!pDev->pPressCurve) {
+		if (!curve) {
 			wcmLogSafe(pDev, W_WARNING,
 			       "Unable to allocate memory for pressure curve; using default.\n");
-			x0 = 0;
-			y0 = 0;
-			x1 = 100;
-			y1 = 100;
+			ctrl[0] = 0;
+			ctrl[1] = 0;
+			ctrl[2] = 100;
+			ctrl[3] = 100;
 		}
 	}
 
+	/* The input thread reads the curve without locking. The new curve
+	 * is complete before it is published, so the input thread sees
+	 * either the old or the new one. */
+	old = __atomic_exchange_n(&pDev->pPressCurve, curve, __ATOMIC_ACQ_REL);
+	wcmFreePressureCurve(&old);
+
+	memcpy(pDev->nPressCtrl, ctrl, sizeof(pDev->nPressCtrl));
+}
+
+/*****************************************************************************
+ * wcmSetPressureRange -- change the range pressure is normalized to, the
+ * pressure curve is rebuilt for it
+ ****************************************************************************/
+void wcmSetPressureRange(WacomDevicePtr pDev, int maxCurve)
+{
+	const int *ctrl = pDev->nPressCtrl;
+
+	if (pDev->maxCurve == maxCurve)
+		return;
+
+	pDev->maxCurve = maxCurve;
 	if (pDev->pPressCurve)
-		filterCurveToLine(pDev->pPressCurve,
-				pDev->maxCurve,
-				0.0, 0.0,               /* bottom left  */
-				x0/100.0, y0/100.0,     /* control point 1 */
-				x1/100.0, y1/100.0,     /* control point 2 */
-				1.0, 1.0);              /* top right */
-
-	pDev->nPressCtrl[0] = x0;
-	pDev->nPressCtrl[1] = y0;
-	pDev->nPressCtrl[2] = x1;
-	pDev->nPressCtrl[3] = y1;
+		wcmSetPressureCurve(pDev, ctrl[0], ctrl[1], ctrl[2], ctrl[3]);
 }
 
 /*
  * wcmResetSampleCounter --
  * Device specific filter routines are responcable for storing raw data
  * as well as filtering.  wcmResetSampleCounter is called to reset
- * raw counters.
+ * raw counters and restart the filter from the next sample.
  */
 void wcmResetSampleCounter(const WacomChannelPtr pChannel)
 {
 	pChannel->nSamples = 0;
 	pChannel->rawFilter.npoints = 0;
+	pChannel->rawFilter.npredict = 0;
 }
 
 
+/* Add the sample to the ring, replacing the oldest one. The running sums
+ * make the average cost independent of the window size */
 static void storeRawSample(WacomCommonPtr common, WacomChannelPtr pChannel,
-			   WacomDeviceStatePtr ds)
+			   WacomDeviceStatePtr ds, Bool tilt)
 {
 	WacomFilterState *fs;
 	int i;
 
 	fs = &pChannel->rawFilter;
-	if (!fs->npoints)
+	if (!fs->npoints || fs->mode != FILTER_AVERAGE ||
+	    fs->window != common->wcmRawSample)
 	{
 		DBG(10, common, "initialize channel data.\n");
 		/* Store initial value over whole average window */
-		for (i=common->wcmRawSample - 1; i>=0; i--)
+		fs->mode = FILTER_AVERAGE;
+		fs->window = common->wcmRawSample;
+		fs->pos = 0;
+		for (i = 0; i < fs->window; i++)
 		{
-			fs->x[i]= ds->x;
-			fs->y[i]= ds->y;
+			fs->x[i] = ds->x;
+			fs->y[i] = ds->y;
 		}
-		if (HANDLE_TILT(common) && (ds->device_type == STYLUS_ID ||
-					    ds->device_type == ERASER_ID))
+		fs->sum_x = ds->x * fs->window;
+		fs->sum_y = ds->y * fs->window;
+		if (tilt)
 		{
-			for (i=common->wcmRawSample - 1; i>=0; i--)
+			for (i = 0; i < fs->window; i++)
 			{
 				fs->tiltx[i] = ds->tiltx;
 				fs->tilty[i] = ds->tilty;
 			}
+			fs->sum_tiltx = ds->tiltx * fs->window;
+			fs->sum_tilty = ds->tilty * fs->window;
 		}
-		++fs->npoints;
+		fs->npoints = 1;
 	} else {
-		/* Shift window and insert latest sample */
-		for (i=common->wcmRawSample - 1; i>0; i--)
+		/* Replace the oldest sample with the latest one */
+		fs->sum_x += ds->x - fs->x[fs->pos];
+		fs->sum_y += ds->y - fs->y[fs->pos];
+		fs->x[fs->pos] = ds->x;
+		fs->y[fs->pos] = ds->y;
+		if (tilt)
 		{
-			fs->x[i]= fs->x[i-1];
-			fs->y[i]= fs->y[i-1];
+			fs->sum_tiltx += ds->tiltx - fs->tiltx[fs->pos];
+			fs->sum_tilty += ds->tilty - fs->tilty[fs->pos];
+			fs->tiltx[fs->pos] = ds->tiltx;
+			fs->tilty[fs->pos] = ds->tilty;
 		}
-		fs->x[0] = ds->x;
-		fs->y[0] = ds->y;
-		if (HANDLE_TILT(common) && (ds->device_type == STYLUS_ID ||
-					    ds->device_type == ERASER_ID))
-		{
-			for (i=common->wcmRawSample - 1; i>0; i--)
-			{
-				fs->tiltx[i]= fs->tiltx[i-1];
-				fs->tilty[i]= fs->tilty[i-1];
-			}
-			fs->tiltx[0] = ds->tiltx;
-			fs->tilty[0] = ds->tilty;
-		}
-		if (fs->npoints < common->wcmRawSample)
+		fs->pos = (fs->pos + 1) % fs->window;
+		if (fs->npoints < fs->window)
 			++fs->npoints;
 	}
 }
 
-static int wcmFilterAverage(int *samples, int n)
+/*****************************************************************************
+ * filterAverage -- box average over the last RawSample samples
+ ****************************************************************************/
+
+static void filterAverage(WacomCommonPtr common, WacomChannelPtr pChannel,
+			  WacomDeviceStatePtr ds, Bool tilt)
 {
-	int x = 0;
-	int i;
+	WacomFilterState *state = &pChannel->rawFilter;
 
-	for (i = 0; i < n; i++)
+	DBG(10, common, "common->wcmRawSample = %d \n", common->wcmRawSample);
+
+	storeRawSample(common, pChannel, ds, tilt);
+
+	ds->x = state->sum_x / state->window;
+	ds->y = state->sum_y / state->window;
+	if (tilt)
 	{
-		x += samples[i];
+		ds->tiltx = state->sum_tiltx / state->window;
+		ds->tilty = state->sum_tilty / state->window;
+	}
+}
+
+/*****************************************************************************
+ * filterOneEuro -- low-pass whose cutoff frequency rises with the speed
+ *
+ * See Casiez et al., "1 Euro Filter: A Simple Speed-based Low-pass Filter
+ * for Noisy Input in Interactive Systems". Slow movement and hover are
+ * smoothed with the minimum cutoff, fast strokes raise the cutoff by
+ * beta * speed and pass through with little added lag. Tilt uses the
+ * cutoff derived from the pen speed.
+ ****************************************************************************/
+
+#define ONE_EURO_DCUTOFF 1.0	/* cutoff of the speed estimate in Hz */
+
+static double oneEuroAlpha(double cutoff, double dt)
+{
+	double tau = 1.0 / (2 * M_PI * cutoff);
+
+	return 1.0 / (1.0 + tau / dt);
+}
+
+static void filterOneEuro(WacomCommonPtr common, WacomChannelPtr pChannel,
+			  WacomDeviceStatePtr ds, Bool tilt)
+{
+	WacomFilterState *fs = &pChannel->rawFilter;
+	double resx, resy; /* points/mm */
+	double dt, alpha, cutoff;
+
+	if (ds->device_type == TOUCH_ID)
+	{
+		resx = common->wcmTouchResolX / 1000.0;
+		resy = common->wcmTouchResolY / 1000.0;
+	} else {
+		resx = common->wcmResolX / 1000.0;
+		resy = common->wcmResolY / 1000.0;
+	}
+	/* without a resolution, treat one device unit as one mm */
+	if (resx <= 0)
+		resx = 1;
+	if (resy <= 0)
+		resy = 1;
+
+	if (!fs->npoints || fs->mode != FILTER_ONE_EURO)
+	{
+		DBG(10, common, "initialize channel data.\n");
+		fs->mode = FILTER_ONE_EURO;
+		fs->ex = ds->x;
+		fs->ey = ds->y;
+		fs->etiltx = ds->tiltx;
+		fs->etilty = ds->tilty;
+		fs->dx = 0;
+		fs->dy = 0;
+		fs->time = ds->time;
+		fs->npoints = 1;
+		return;
+	}
+
+	/* Several samples within the same millisecond still count */
+	dt = max((int32_t)(ds->time - fs->time), 1) / 1000.0;
+	fs->time = ds->time;
+
+	alpha = oneEuroAlpha(ONE_EURO_DCUTOFF, dt);
+	fs->dx += alpha * ((ds->x - fs->ex) / resx / dt - fs->dx);
+	fs->dy += alpha * ((ds->y - fs->ey) / resy / dt - fs->dy);
+
+	cutoff = common->wcmFilterMinCutoff / 1000.0 +
+		 common->wcmFilterBeta / 1000.0 * hypot(fs->dx, fs->dy);
+	alpha = oneEuroAlpha(cutoff, dt);
+
+	DBG(10, common, "speed %.1f mm/s, cutoff %.2f Hz\n",
+	    hypot(fs->dx, fs->dy), cutoff);
+
+	fs->ex += alpha * (ds->x - fs->ex);
+	fs->ey += alpha * (ds->y - fs->ey);
+	ds->x = lround(fs->ex);
+	ds->y = lround(fs->ey);
+	if (tilt)
+	{
+		fs->etiltx += alpha * (ds->tiltx - fs->etiltx);
+		fs->etilty += alpha * (ds->tilty - fs->etilty);
+		ds->tiltx = lround(fs->etiltx);
+		ds->tilty = lround(fs->etilty);
 	}
-	return x / n;
 }
 
 /*****************************************************************************
@@ -161,26 +379,21 @@ static int wcmFilterAverage(int *samples, int n)
 int wcmFilterCoord(WacomCommonPtr common, WacomChannelPtr pChannel,
 	WacomDeviceStatePtr ds)
 {
-	WacomFilterState *state;
-
-	DBG(10, common, "common->wcmRawSample = %d \n", common->wcmRawSample);
-
-	storeRawSample(common, pChannel, ds);
+	Bool tilt = HANDLE_TILT(common) && (ds->device_type == STYLUS_ID ||
+					    ds->device_type == ERASER_ID);
 
-	state = &pChannel->rawFilter;
+	if (common->wcmFilter == FILTER_ONE_EURO)
+		filterOneEuro(common, pChannel, ds, tilt);
+	else
+		filterAverage(common, pChannel, ds, tilt);
 
-	ds->x = wcmFilterAverage(state->x, common->wcmRawSample);
-	ds->y = wcmFilterAverage(state->y, common->wcmRawSample);
-	if (HANDLE_TILT(common) && (ds->device_type == STYLUS_ID ||
-				    ds->device_type == ERASER_ID))
+	if (tilt)
 	{
-		ds->tiltx = wcmFilterAverage(state->tiltx, common->wcmRawSample);
 		if (ds->tiltx > common->wcmTiltMaxX)
 			ds->tiltx = common->wcmTiltMaxX;
 		else if (ds->tiltx < common->wcmTiltMinX)
 			ds->tiltx = common->wcmTiltMinX;
 
-		ds->tilty = wcmFilterAverage(state->tilty, common->wcmRawSample);
 		if (ds->tilty > common->wcmTiltMaxY)
 			ds->tilty = common->wcmTiltMaxY;
 		else if (ds->tilty < common->wcmTiltMinY)
@@ -190,6 +403,70 @@ int wcmFilterCoord(WacomCommonPtr common, WacomChannelPtr pChannel,
 	return 0; /* lookin' good */
 }
 
+/* Velocity and acceleration of one axis at the newest of three samples,
+ * in units/ms and units/ms^2 */
+static void predictMotion(int p0, int p1, int p2, double dt1, double dt2,
+			  double *v, double *a)
+{
+	double v1 = (p0 - p1) / dt1;
+	double v2 = (p1 - p2) / dt2;
+
+	*a = (v1 - v2) / ((dt1 + dt2) / 2);
+	/* v1 is the velocity halfway between p1 and p0 */
+	*v = v1 + *a * dt1 / 2;
+}
+
+/*****************************************************************************
+ * wcmPredictCoord -- extrapolate the filtered position wcmPrediction ms ahead
+ *
+ * Velocity and acceleration are estimated from the last three raw states
+ * in the channel history. If snap is set, the true position is kept and
+ * prediction restarts once enough new samples are in, so clicks land
+ * where the pen actually is. The prediction never leaves the tool's axis
+ * range.
+ ****************************************************************************/
+
+void wcmPredictCoord(WacomDevicePtr priv, WacomChannelPtr pChannel,
+	WacomDeviceStatePtr ds, Bool snap)
+{
+	WacomCommonPtr common = priv->common;
+	WacomFilterState *fs = &pChannel->rawFilter;
+	const WacomDeviceState *s0, *s1, *s2;
+	double dt1, dt2, h, vx, vy, ax, ay;
+	int x, y;
+
+	if (snap)
+	{
+		fs->npredict = 0;
+		return;
+	}
+
+	if (++fs->npredict < 3)
+		return;
+	fs->npredict = 3;
+
+	s0 = wcmChannelState(pChannel, 0);
+	s1 = wcmChannelState(pChannel, 1);
+	s2 = wcmChannelState(pChannel, 2);
+
+	/* Several samples within the same millisecond still count */
+	dt1 = max((int32_t)(s0->time - s1->time), 1);
+	dt2 = max((int32_t)(s1->time - s2->time), 1);
+	h = common->wcmPrediction;
+
+	predictMotion(s0->x, s1->x, s2->x, dt1, dt2, &vx, &ax);
+	predictMotion(s0->y, s1->y, s2->y, dt1, dt2, &vy, &ay);
+
+	DBG(10, common, "predict %dms: v %.2f/%.2f a %.3f/%.3f\n",
+	    common->wcmPrediction, vx, vy, ax, ay);
+
+	x = ds->x + lround(vx * h + ax * h * h / 2);
+	y = ds->y + lround(vy * h + ay * h * h / 2);
+
+	ds->x = min(max(x, priv->minX), priv->maxX);
+	ds->y = min(max(y, priv->minY), priv->maxY);
+}
+
 /***
  * Convert a point (X/Y) in a left-handed coordinate system to a normalized
  * rotation angle.
@@ -254,6 +531,72 @@ int wcmTilt2R(int x, int y, double offset)
 
 #include "wacom-test-suite.h"
 
+TEST_CASE(test_pressure_curve_cache)
+{
+	WacomDeviceRec a = {0}, b = {0}, c = {0};
+	int ctrl[4] = { 0, 75, 25, 100 };
+	int *expected;
+
+	a.maxCurve = b.maxCurve = FILTER_PRESSURE_RES;
+	c.maxCurve = 2048;
+
+	/* identical curves share one table */
+	wcmSetPressureCurve(&a, 0, 75, 25, 100);
+	wcmSetPressureCurve(&b, 0, 75, 25, 100);
+	assert(a.pPressCurve);
+	assert(a.pPressCurve == b.pPressCurve);
+	assert(a.pPressCurve->refcnt == 2);
+	assert(a.pPressCurve->wide && !a.pPressCurve->narrow);
+
+	/* a different range gets its own, 16-bit table */
+	wcmSetPressureCurve(&c, 0, 75, 25, 100);
+	assert(c.pPressCurve != a.pPressCurve);
+	assert(c.pPressCurve->narrow && !c.pPressCurve->wide);
+
+	expected = calloc(2048 + 1, sizeof(*expected));
+	filterCurveToLine(expected, 2048, 0.0, 0.0, 0.0, 0.75, 0.25, 1.0, 1.0, 1.0);
+	for (int i = 0; i <= 2048; i++)
+		assert(wcmPressureCurveValue(c.pPressCurve, i) == expected[i]);
+	free(expected);
+
+	/* the linear curve needs no table */
+	wcmSetPressureCurve(&b, 0, 0, 100, 100);
+	assert(b.pPressCurve == NULL);
+	assert(a.pPressCurve->refcnt == 1);
+	assert(memcmp(a.nPressCtrl, ctrl, sizeof(ctrl)) == 0);
+
+	wcmFreePressureCurve(&a.pPressCurve);
+	wcmFreePressureCurve(&c.pPressCurve);
+	assert(a.pPressCurve == NULL);
+	assert(pressureCurves == NULL);
+}
+
+TEST_CASE(test_pressure_range)
+{
+	WacomDeviceRec a = {0}, b = {0};
+
+	a.maxCurve = b.maxCurve = FILTER_PRESSURE_RES;
+
+	/* Pressure2K after PressCurve rebuilds the curve for 2K */
+	wcmSetPressureCurve(&a, 0, 75, 25, 100);
+	assert(a.pPressCurve->maxCurve == FILTER_PRESSURE_RES);
+	wcmSetPressureRange(&a, 2048);
+	assert(a.maxCurve == 2048);
+	assert(a.pPressCurve->maxCurve == 2048);
+	assert(a.pPressCurve->narrow);
+
+	/* and before it builds it for 2K right away */
+	wcmSetPressureRange(&b, 2048);
+	assert(b.pPressCurve == NULL);
+	wcmSetPressureCurve(&b, 0, 75, 25, 100);
+	assert(b.pPressCurve == a.pPressCurve);
+	assert(a.pPressCurve->refcnt == 2);
+
+	wcmFreePressureCurve(&a.pPressCurve);
+	wcmFreePressureCurve(&b.pPressCurve);
+	assert(pressureCurves == NULL);
+}
+
 TEST_CASE(test_tilt_to_rotation)
 {
 #if 0
@@ -363,6 +706,231 @@ TEST_CASE(test_tilt_to_rotation)
 		assert(rotation == rotation_table[i][2]);
 	}
 }
+
+/* The shift-and-sum box filter the running sums replaced */
+static int refBoxFilter(int *samples, int n, int value, Bool init)
+{
+	int i, sum = 0;
+
+	if (init)
+	{
+		for (i = n - 1; i >= 0; i--)
+			samples[i] = value;
+	} else {
+		for (i = n - 1; i > 0; i--)
+			samples[i] = samples[i - 1];
+		samples[0] = value;
+	}
+
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+	return sum / n;
+}
+
+TEST_CASE(test_running_average)
+{
+	WacomCommonRec common = {0};
+	WacomChannel channel = {0};
+	unsigned int seed = 1;
+	int ref_x[MAX_SAMPLES], ref_y[MAX_SAMPLES];
+	int ref_tiltx[MAX_SAMPLES], ref_tilty[MAX_SAMPLES];
+
+	common.wcmFlags = TILT_ENABLED_FLAG;
+	common.wcmTiltMinX = common.wcmTiltMinY = -64;
+	common.wcmTiltMaxX = common.wcmTiltMaxY = 63;
+
+	for (int n = 1; n <= MAX_SAMPLES; n++)
+	{
+		common.wcmRawSample = n;
+		wcmResetSampleCounter(&channel);
+
+		for (int i = 0; i < 1000; i++)
+		{
+			WacomDeviceState ds = {0};
+			Bool init = (channel.rawFilter.npoints == 0);
+			int x, y, tiltx, tilty;
+
+			/* Restart the filter now and then, like a prox-out */
+			if (i % 211 == 210)
+			{
+				wcmResetSampleCounter(&channel);
+				init = TRUE;
+			}
+
+			seed = seed * 1103515245 + 12345;
+			ds.device_type = STYLUS_ID;
+			ds.x = (seed >> 8) % 100000 - 1000;
+			seed = seed * 1103515245 + 12345;
+			ds.y = (seed >> 8) % 100000 - 1000;
+			seed = seed * 1103515245 + 12345;
+			ds.tiltx = (seed >> 8) % 128 - 64;
+			ds.tilty = (seed >> 16) % 128 - 64;
+
+			x = refBoxFilter(ref_x, n, ds.x, init);
+			y = refBoxFilter(ref_y, n, ds.y, init);
+			tiltx = refBoxFilter(ref_tiltx, n, ds.tiltx, init);
+			tilty = refBoxFilter(ref_tilty, n, ds.tilty, init);
+
+			wcmFilterCoord(&common, &channel, &ds);
+
+			assert(ds.x == x);
+			assert(ds.y == y);
+			assert(ds.tiltx == tiltx);
+			assert(ds.tilty == tilty);
+		}
+	}
+}
+
+/* The default box average over a pen stroke with tilt */
+BENCH_CASE(bench_filter_coord)
+{
+	WacomCommonRec common = {0};
+	WacomChannel channel = {0};
+	WacomDeviceState ds = { .device_type = STYLUS_ID };
+
+	common.wcmRawSample = DEFAULT_SAMPLES;
+	common.wcmFlags = TILT_ENABLED_FLAG;
+	common.wcmTiltMinX = common.wcmTiltMinY = -64;
+	common.wcmTiltMaxX = common.wcmTiltMaxY = 63;
+
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		ds.x = 10000 + (i % 4096) * 5;
+		ds.y = 20000 - (i % 4096) * 3;
+		ds.tiltx = i % 64;
+		ds.tilty = -(int)(i % 64);
+		ds.time = i * 5;
+		wcmFilterCoord(&common, &channel, &ds);
+		bench_keep(ds.x);
+	}
+}
+
+TEST_CASE(test_one_euro)
+{
+	WacomCommonRec common = {0};
+	WacomChannel channel = {0};
+	WacomDeviceState ds = {0};
+	int maxdev = 0;
+
+	common.wcmFilter = FILTER_ONE_EURO;
+	common.wcmFilterMinCutoff = DEFAULT_FILTER_MIN_CUTOFF;
+	common.wcmFilterBeta = DEFAULT_FILTER_BETA;
+	common.wcmResolX = common.wcmResolY = 100000; /* 100 points/mm */
+
+	/* First sample passes through unchanged */
+	ds.device_type = STYLUS_ID;
+	ds.x = 5000;
+	ds.y = 7000;
+	ds.time = 1000;
+	wcmFilterCoord(&common, &channel, &ds);
+	assert(ds.x == 5000);
+	assert(ds.y == 7000);
+
+	/* Hovering: +-10 points of jitter at 200Hz is strongly damped */
+	for (int i = 1; i <= 200; i++)
+	{
+		ds.x = 5000 + ((i % 2) ? 10 : -10);
+		ds.y = 7000;
+		ds.time = 1000 + i * 5;
+		wcmFilterCoord(&common, &channel, &ds);
+		maxdev = max(maxdev, abs(ds.x - 5000));
+		assert(ds.y == 7000);
+	}
+	assert(maxdev <= 2);
+
+	/* A fast stroke of 500mm/s lags behind by less than a sample,
+	 * the box average lags by (RawSample - 1)/2 samples */
+	for (int i = 1; i <= 100; i++)
+	{
+		ds.x = 5000 + i * 250;
+		ds.time = 2000 + i * 5;
+		wcmFilterCoord(&common, &channel, &ds);
+	}
+	assert(5000 + 100 * 250 - ds.x < 250);
+
+	/* Switching back restarts the box average from the current sample */
+	common.wcmFilter = FILTER_AVERAGE;
+	common.wcmRawSample = DEFAULT_SAMPLES;
+	ds.x = 100;
+	wcmFilterCoord(&common, &channel, &ds);
+	assert(ds.x == 100);
+
+	/* A reset restarts the One-Euro filter too */
+	common.wcmFilter = FILTER_ONE_EURO;
+	wcmFilterCoord(&common, &channel, &ds);
+	wcmResetSampleCounter(&channel);
+	ds.x = 9000;
+	ds.time += 5;
+	wcmFilterCoord(&common, &channel, &ds);
+	assert(ds.x == 9000);
+}
+
+TEST_CASE(test_prediction)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	WacomChannel channel = {0};
+	WacomDeviceState ds = {0};
+
+	priv.common = &common;
+	priv.maxX = 10000;
+	priv.maxY = 10000;
+	common.wcmPrediction = 10;
+
+	/* x = t^2 / 4, y = 1000 - 3t: extrapolation of a constant
+	 * acceleration is exact, the first two samples are not predicted */
+	for (int t = 0; t <= 40; t += 4)
+	{
+		ds.x = t * t / 4;
+		ds.y = 1000 - 3 * t;
+		ds.time = 5000 + t;
+		wcmChannelPushState(&channel, &ds);
+
+		wcmPredictCoord(&priv, &channel, &ds, FALSE);
+		if (t < 8)
+		{
+			assert(ds.x == t * t / 4);
+			assert(ds.y == 1000 - 3 * t);
+		} else {
+			assert(ds.x == (t + 10) * (t + 10) / 4);
+			assert(ds.y == 1000 - 3 * (t + 10));
+		}
+	}
+
+	/* A button edge keeps the true position and restarts prediction */
+	ds.x = 500;
+	ds.y = 500;
+	ds.time += 4;
+	wcmChannelPushState(&channel, &ds);
+	wcmPredictCoord(&priv, &channel, &ds, TRUE);
+	assert(ds.x == 500);
+	assert(ds.y == 500);
+
+	ds.time += 4;
+	wcmChannelPushState(&channel, &ds);
+	wcmPredictCoord(&priv, &channel, &ds, FALSE);
+	assert(ds.x == 500);
+	assert(ds.y == 500);
+
+	/* Same for a reset of the filter, e.g. on tip-down */
+	wcmResetSampleCounter(&channel);
+	ds.time += 4;
+	wcmChannelPushState(&channel, &ds);
+	wcmPredictCoord(&priv, &channel, &ds, FALSE);
+	assert(channel.rawFilter.npredict == 1);
+
+	/* Heading for the corner, the prediction stops at the edges */
+	for (int t = 0; t < 3; t++)
+	{
+		ds.x = 9900 + 50 * t;
+		ds.y = 100 - 50 * t;
+		ds.time += 4;
+		wcmChannelPushState(&channel, &ds);
+		wcmPredictCoord(&priv, &channel, &ds, FALSE);
+	}
+	assert(ds.x == priv.maxX);
+	assert(ds.y == priv.minY);
+}
 #endif
 
 /* vim: set noexpandtab tabstop=8 shiftwidth=8: */
@@ -26,9 +26,20 @@
 
 void wcmSetPressureCurve(WacomDevicePtr pDev, int x0, int y0,
 	int x1, int y1);
+void wcmSetPressureRange(WacomDevicePtr pDev, int maxCurve);
+WacomPressureCurvePtr wcmRefPressureCurve(const int ctrl[4], int maxCurve);
+void wcmFreePressureCurve(WacomPressureCurvePtr *ptr);
+
+/* Look up pressure p, 0 <= p <= curve->maxCurve */
+static inline int wcmPressureCurveValue(const WacomPressureCurve *curve, int p)
+{
+	return curve->narrow ? curve->narrow[p] : curve->wide[p];
+}
 int wcmFilterCoord(WacomCommonPtr common, WacomChannelPtr pChannel,
 	WacomDeviceStatePtr ds);
 void wcmResetSampleCounter(const WacomChannelPtr pChannel);
+void wcmPredictCoord(WacomDevicePtr priv, WacomChannelPtr pChannel,
+	WacomDeviceStatePtr ds, Bool snap);
 
 /****************************************************************************/
 #endif /* __XF86_WCMFILTER_H */
@@ -24,133 +24,177 @@
 #include <math.h>
 #include <stdlib.h>
 
-static int filterOnLine(double x0, double y0, double x1, double y1,
-		double a, double b);
-static void filterLine(int* pCurve, int nMax, int x0, int y0, int x1, int y1);
+/* Number of line segments the curve is rasterised with. The output is
+ * within 1/6500 of the range of the exact curve, i.e. 10 points at 65536
+ * where the curve is steepest and about 3 elsewhere */
+#define CURVE_SEGMENTS 256
 
+static inline int filterClamp(double v, int nMax)
+{
+	int i = (int)(v * nMax);
+
+	return (i < 0) ? 0 : (i > nMax) ? nMax : i;
+}
 
-static void filterNearestPoint(double x0, double y0, double x1, double y1,
-		double a, double b, double* x, double* y)
+/* Fill the entries in (x0, x1] on the line from x0/y0 to x1/y1. The entry
+ * at x0 is left to the previous span, so where the curve is vertical the
+ * entry keeps the value at which the curve first reaches it. */
+static void filterSpan(int* pCurve, int x0, int y0, int x1, int y1)
 {
-	double vx, vy, wx, wy, d1, d2, c;
+	double y = y0, dy;
+	int x;
 
-	wx = a - x0; wy = b - y0;
-	vx = x1 - x0; vy = y1 - y0;
+	if (x1 <= x0)
+		return;
 
-	d1 = vx * wx + vy * wy;
-	if (d1 <= 0)
-	{
-		*x = x0;
-		*y = y0;
-	}
-	else
+	dy = (double)(y1 - y0) / (x1 - x0);
+	for (x = x0 + 1; x <= x1; x++)
 	{
-		d2 = vx * vx + vy * vy;
-		if (d1 >= d2)
-		{
-			*x = x1;
-			*y = y1;
-		}
-		else
-		{
-			c = d1 / d2;
-			*x = x0 + c * vx;
-			*y = y0 + c * vy;
-		}
+		y += dy;
+		pCurve[x] = (int)(y + 0.5);
 	}
 }
 
-static int filterOnLine(double x0, double y0, double x1, double y1,
-			double a, double b)
-{
-        double x, y, d;
-	filterNearestPoint(x0,y0,x1,y1,a,b,&x,&y);
-	d = (x-a)*(x-a) + (y-b)*(y-b);
-	return d < 0.00001; /* within 100th of a point (1E-2 squared) */
-}
+/*****************************************************************************
+ * filterCurveToLine -- rasterise the cubic Bezier curve p0..p3 into pCurve
+ *
+ * The curve is stepped through in CURVE_SEGMENTS equal steps of t using
+ * forward differencing, which needs three additions per coordinate and
+ * step, and each step is drawn as a line. The x coordinate of the curve
+ * never decreases for control points within [0, 1], which is all the
+ * driver allows.
+ ****************************************************************************/
 
 void filterCurveToLine(int* pCurve, int nMax, double x0, double y0,
 		       double x1, double y1, double x2, double y2,
 		       double x3, double y3)
 {
-	double x01,y01,x32,y32,xm,ym;
-	double c1,d1,c2,d2,e,f;
-
-	/* check if control points are on line */
-	if (filterOnLine(x0,y0,x3,y3,x1,y1) && filterOnLine(x0,y0,x3,y3,x2,y2))
+	const double h = 1.0 / CURVE_SEGMENTS;
+	/* polynomial coefficients, p(t) = a t^3 + b t^2 + c t + p0 */
+	double ax = x3 - 3 * x2 + 3 * x1 - x0, ay = y3 - 3 * y2 + 3 * y1 - y0;
+	double bx = 3 * x2 - 6 * x1 + 3 * x0,  by = 3 * y2 - 6 * y1 + 3 * y0;
+	double cx = 3 * x1 - 3 * x0,           cy = 3 * y1 - 3 * y0;
+	/* first, second and third forward differences at t = 0 */
+	double dx = ax * h * h * h + bx * h * h + cx * h;
+	double dy = ay * h * h * h + by * h * h + cy * h;
+	double ddx = 6 * ax * h * h * h + 2 * bx * h * h;
+	double ddy = 6 * ay * h * h * h + 2 * by * h * h;
+	double dddx = 6 * ax * h * h * h;
+	double dddy = 6 * ay * h * h * h;
+	double x = x0, y = y0;
+	int px = filterClamp(x0, nMax), py = filterClamp(y0, nMax);
+	int i;
+
+	pCurve[px] = py;
+
+	for (i = 1; i <= CURVE_SEGMENTS; i++)
 	{
-		filterLine(pCurve,nMax,
-			(int)(x0*nMax),(int)(y0*nMax),
-			(int)(x3*nMax),(int)(y3*nMax));
-		return;
+		int nx, ny;
+
+		x += dx; dx += ddx; ddx += dddx;
+		y += dy; dy += ddy; ddy += dddy;
+
+		/* don't let rounding errors move the end point */
+		if (i == CURVE_SEGMENTS)
+		{
+			x = x3;
+			y = y3;
+		}
+
+		nx = filterClamp(x, nMax);
+		ny = filterClamp(y, nMax);
+		filterSpan(pCurve, px, py, nx, ny);
+		if (nx > px)
+			px = nx;
+		py = ny;
 	}
+}
 
-	/* calculate midpoints */
-	x01 = (x0 + x1) / 2; y01 = (y0 + y1) / 2;
-	x32 = (x3 + x2) / 2; y32 = (y3 + y2) / 2;
+#ifdef ENABLE_TESTS
 
-	/* calc split point */
-	xm = (x1 + x2) / 2; ym = (y1 + y2) / 2;
+#include <assert.h>
+#include "wacom-test-suite.h"
 
-	/* calc control points and midpoint */
-	c1 = (x01 + xm) / 2; d1 = (y01 + ym) / 2;
-	c2 = (x32 + xm) / 2; d2 = (y32 + ym) / 2;
-	e = (c1 + c2) / 2; f = (d1 + d2) / 2;
+static double bezier(double p1, double p2, double t)
+{
+	double u = 1 - t;
 
-	/* do each side */
-	filterCurveToLine(pCurve,nMax,x0,y0,x01,y01,c1,d1,e,f);
-	filterCurveToLine(pCurve,nMax,e,f,c2,d2,x32,y32,x3,y3);
+	return 3 * u * u * t * p1 + 3 * u * t * t * p2 + t * t * t;
 }
 
-static void filterLine(int* pCurve, int nMax, int x0, int y0, int x1, int y1)
+TEST_CASE(test_curve_to_line)
 {
-	int dx, dy, ax, ay, sx, sy, x, y, d;
+	const int nmax = 65536;
+	const double ctrl[][4] = {
+		{ 0.0, 0.0, 1.0, 1.0 },
+		{ 0.5, 0.0, 0.5, 1.0 },
+		{ 0.3, 0.7, 0.7, 0.3 },
+		{ 0.1, 0.9, 0.9, 0.1 },
+		{ 0.0, 0.2, 0.8, 1.0 },
+	};
+	int *curve = calloc(nmax + 1, sizeof(*curve));
+
+	for (size_t i = 0; i < sizeof(ctrl)/sizeof(ctrl[0]); i++)
+	{
+		const double *c = ctrl[i];
 
-	/* sanity check */
-	if ((x0 < 0) || (y0 < 0) || (x1 < 0) || (y1 < 0) ||
-		(x0 > nMax) || (y0 > nMax) || (x1 > nMax) || (y1 > nMax))
-		return;
+		filterCurveToLine(curve, nmax, 0.0, 0.0, c[0], c[1],
+				  c[2], c[3], 1.0, 1.0);
 
-	dx = x1 - x0; ax = abs(dx) * 2; sx = (dx>0) ? 1 : -1;
-	dy = y1 - y0; ay = abs(dy) * 2; sy = (dy>0) ? 1 : -1;
-	x = x0; y = y0;
+		assert(curve[0] == 0);
+		assert(curve[nmax] == nmax);
 
-	/* x dominant */
-	if (ax > ay)
-	{
-		d = ay - ax / 2;
-		while (1)
+		/* compare against the curve, solved for t by bisection */
+		for (int p = 0; p <= nmax; p += 7)
 		{
-			pCurve[x] = y;
-			if (x == x1) break;
-			if (d >= 0)
+			double x = p / (double)nmax, lo = 0.0, hi = 1.0;
+			int expected;
+
+			for (int j = 0; j < 50; j++)
 			{
-				y += sy;
-				d -= ax;
+				double t = (lo + hi) / 2;
+				if (bezier(c[0], c[2], t) < x)
+					lo = t;
+				else
+					hi = t;
 			}
-			x += sx;
-			d += ay;
+			expected = bezier(c[1], c[3], lo) * nmax;
+			assert(abs(curve[p] - expected) <= 10);
+
+			/* none of these curves fall */
+			if (p > 0)
+				assert(curve[p] >= curve[p - 7]);
 		}
 	}
 
-	/* y dominant */
-	else
+	/* the linear curve maps every value onto itself */
+	filterCurveToLine(curve, 2048, 0.0, 0.0, 0.0, 0.0, 1.0, 1.0, 1.0, 1.0);
+	for (int p = 0; p <= 2048; p++)
+		assert(curve[p] == p);
+
+	free(curve);
+}
+
+/* Rebuilding the curve of the default resolution, as on every
+ * PressureCurve change */
+BENCH_CASE_ITERATIONS(bench_curve_to_line, 1000)
+{
+	const int nmax = 65536; /* FILTER_PRESSURE_RES */
+	int *curve = calloc(nmax + 1, sizeof(*curve));
+
+	for (unsigned int i = 0; i < iterations; i++)
 	{
-		d = ax - ay / 2;
-		while (1)
-		{
-			pCurve[x] = y;
-			if (y == y1) break;
-			if (d >= 0)
-			{
-				x += sx;
-				d -= ay;
-			}
-			y += sy;
-			d += ax;
-		}
+		double c = (i % 100) / 100.0;
+
+		filterCurveToLine(curve, nmax, 0.0, 0.0, c, 1.0 - c,
+				  1.0 - c, c, 1.0, 1.0);
+		bench_keep(curve);
 	}
+
+	free(curve);
 }
 
+#endif
+
 /* vim: set noexpandtab tabstop=8 shiftwidth=8: */
 
@@ -0,0 +1,470 @@
+/*
+ * Copyright 2024 by the xf86-input-wacom contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "xf86Wacom.h"
+#include "wcmRecorder.h"
+
+/* The file format can't depend on the driver's internal values */
+_Static_assert(STYLUS_ID == WACOM_RECORD_STYLUS &&
+	       TOUCH_ID == WACOM_RECORD_TOUCH &&
+	       CURSOR_ID == WACOM_RECORD_CURSOR &&
+	       ERASER_ID == WACOM_RECORD_ERASER &&
+	       PAD_ID == WACOM_RECORD_PAD, "device types changed");
+_Static_assert(SUPPRESS_ALL - SUPPRESS_NONE == WACOM_RECORD_SUPPRESS_ALL &&
+	       SUPPRESS_NON_MOTION - SUPPRESS_NONE == WACOM_RECORD_SUPPRESS_NON_MOTION,
+	       "suppress modes changed");
+
+/*****************************************************************************
+ * The flight recorder is a ring of fixed-size binary records describing
+ * what happened to each event on its way through the driver. It is cheap
+ * enough to always be on, so it can be dumped after a user noticed a
+ * glitch instead of asking them to reproduce it with debugging enabled.
+ *
+ * There is a single writer (the input thread, or anyone holding the input
+ * lock). The writer announces a record in begun, fills the slot and then
+ * publishes it by incrementing head. Readers never block the writer: they
+ * copy the published records and afterwards discard every record the
+ * writer may have started to overwrite while they were copying.
+ ****************************************************************************/
+
+struct _WacomRecorder
+{
+	uint32_t head;		/* records written so far, wraps */
+	uint32_t begun;		/* head, plus one while a record is written */
+	uint32_t mask;		/* size - 1, the size is a power of two */
+	struct wacom_record records[];
+};
+
+static inline uint32_t recorderSize(const WacomRecorder *rec)
+{
+	return rec->mask + 1;
+}
+
+Bool wcmRecorderInit(WacomCommonPtr common, unsigned int size)
+{
+	WacomRecorderPtr rec;
+	unsigned int n = 1;
+
+	if (common->wcmRecorder || !size)
+		return TRUE;
+
+	if (size > MAX_RECORDER_SIZE)
+		size = MAX_RECORDER_SIZE;
+	while (n < size)
+		n <<= 1;
+
+	rec = calloc(1, sizeof(*rec) + n * sizeof(rec->records[0]));
+	if (!rec)
+		return FALSE;
+
+	rec->mask = n - 1;
+	common->wcmRecorder = rec;
+	return TRUE;
+}
+
+void wcmRecorderFree(WacomCommonPtr common)
+{
+	free(common->wcmRecorder);
+	common->wcmRecorder = NULL;
+}
+
+/* Microseconds are enough to tell the stages apart, and 32 bits keep the
+ * records small. The decoder unwraps the time. */
+static inline uint32_t recorderNow(void)
+{
+	return (uint32_t)wcmTimeInMicros();
+}
+
+static inline struct wacom_record *recordBegin(WacomRecorderPtr rec,
+					       enum wacom_record_kind kind,
+					       unsigned int channel)
+{
+	uint32_t head = __atomic_load_n(&rec->head, __ATOMIC_RELAXED);
+	struct wacom_record *r = &rec->records[head & rec->mask];
+
+	__atomic_store_n(&rec->begun, head + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	r->time = recorderNow();
+	r->kind = kind;
+	r->channel = channel < WACOM_RECORD_NO_CHANNEL ? channel : WACOM_RECORD_NO_CHANNEL;
+	r->flags = 0;
+	return r;
+}
+
+static inline void recordCommit(WacomRecorderPtr rec)
+{
+	uint32_t head = __atomic_load_n(&rec->head, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&rec->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void wcmRecordEvdev(WacomCommonPtr common, const struct input_event *event)
+{
+	WacomRecorderPtr rec = common->wcmRecorder;
+	struct wacom_record *r;
+
+	if (!rec)
+		return;
+
+	r = recordBegin(rec, WACOM_RECORD_EVDEV, WACOM_RECORD_NO_CHANNEL);
+	r->v[0] = event->input_event_sec;
+	r->v[1] = event->input_event_usec;
+	r->v[2] = event->type;
+	r->v[3] = event->code;
+	r->v[4] = event->value;
+	r->v[5] = 0;
+	recordCommit(rec);
+}
+
+void wcmRecordChannel(WacomCommonPtr common, unsigned int channel,
+		      const WacomDeviceState *ds)
+{
+	WacomRecorderPtr rec = common->wcmRecorder;
+	struct wacom_record *r;
+
+	if (!rec)
+		return;
+
+	r = recordBegin(rec, WACOM_RECORD_CHANNEL, channel);
+	r->v[0] = ds->device_type;
+	r->v[1] = ds->serial_num;
+	r->v[2] = ds->device_id;
+	r->v[3] = ds->proximity;
+	r->v[4] = 0;
+	r->v[5] = 0;
+	recordCommit(rec);
+}
+
+static void recordState(WacomRecorderPtr rec, enum wacom_record_kind kind,
+			unsigned int channel, const WacomDeviceState *ds,
+			int x, int y)
+{
+	struct wacom_record *r = recordBegin(rec, kind, channel);
+
+	r->flags = (ds->device_type & 0xff) << WACOM_RECORD_TYPE_SHIFT;
+	if (ds->proximity)
+		r->flags |= WACOM_RECORD_FLAG_PROXIMITY;
+	r->v[0] = x;
+	r->v[1] = y;
+	r->v[2] = ds->pressure;
+	r->v[3] = ds->tiltx;
+	r->v[4] = ds->tilty;
+	r->v[5] = ds->buttons;
+	recordCommit(rec);
+}
+
+void wcmRecordFilter(WacomCommonPtr common, unsigned int channel,
+		     const WacomDeviceState *ds)
+{
+	if (common->wcmRecorder)
+		recordState(common->wcmRecorder, WACOM_RECORD_FILTER, channel,
+			    ds, ds->x, ds->y);
+}
+
+void wcmRecordSuppress(WacomCommonPtr common, unsigned int channel,
+		       enum WacomSuppressMode suppress)
+{
+	WacomRecorderPtr rec = common->wcmRecorder;
+	struct wacom_record *r;
+
+	if (!rec)
+		return;
+
+	r = recordBegin(rec, WACOM_RECORD_SUPPRESS, channel);
+	r->v[0] = suppress - SUPPRESS_NONE;
+	r->v[1] = r->v[2] = r->v[3] = r->v[4] = r->v[5] = 0;
+	recordCommit(rec);
+}
+
+/* x and y are the coordinates after rotation and scaling */
+void wcmRecordEmit(WacomCommonPtr common, const WacomDeviceState *ds,
+		   int x, int y)
+{
+	if (common->wcmRecorder)
+		recordState(common->wcmRecorder, WACOM_RECORD_EMIT,
+			    WACOM_RECORD_NO_CHANNEL, ds, x, y);
+}
+
+/**
+ * Copy the most recent records, oldest first.
+ *
+ * @param[out] records  At least max records
+ * @param[out] lost     Number of records that were written but are not in
+ *                      the snapshot, may be NULL
+ * @return the number of records copied
+ */
+unsigned int wcmRecorderSnapshot(WacomCommonPtr common,
+				 struct wacom_record *records,
+				 unsigned int max, unsigned int *lost)
+{
+	WacomRecorderPtr rec = common->wcmRecorder;
+	uint32_t h1, h2, start, n, i, overwritten;
+
+	if (lost)
+		*lost = 0;
+	if (!rec)
+		return 0;
+
+	h1 = __atomic_load_n(&rec->head, __ATOMIC_ACQUIRE);
+	n = min(h1, recorderSize(rec));
+	n = min(n, max);
+	start = h1 - n;
+
+	for (i = 0; i < n; i++)
+		records[i] = rec->records[(start + i) & rec->mask];
+
+	/* Any slot the writer started on while we copied may be torn */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	h2 = __atomic_load_n(&rec->begun, __ATOMIC_RELAXED);
+	overwritten = h2 - start > recorderSize(rec) ?
+		      h2 - start - recorderSize(rec) : 0;
+	if (overwritten >= n)
+		n = 0;
+	else if (overwritten)
+	{
+		n -= overwritten;
+		memmove(records, records + overwritten, n * sizeof(*records));
+	}
+
+	if (lost)
+		*lost = h1 - n;
+	return n;
+}
+
+static Bool writeAll(int fd, const void *data, size_t len)
+{
+	const char *p = data;
+
+	while (len > 0)
+	{
+		ssize_t rc;
+
+		SYSCALL(rc = write(fd, p, len));
+		if (rc < 0)
+			return FALSE;
+		p += rc;
+		len -= rc;
+	}
+	return TRUE;
+}
+
+/**
+ * Write the current contents of the recorder to fd in the format described
+ * in wacom-recorder.h. On failure, errno is set.
+ */
+Bool wcmRecorderDump(WacomCommonPtr common, int fd)
+{
+	struct wacom_recorder_header header = {
+		.version = WACOM_RECORDER_VERSION,
+		.record_size = sizeof(struct wacom_record),
+		.vendor_id = common->vendor_id,
+		.product_id = common->tablet_id,
+	};
+	struct wacom_record *records = NULL;
+	Bool rc;
+
+	if (common->wcmRecorder)
+	{
+		records = calloc(recorderSize(common->wcmRecorder), sizeof(*records));
+		if (!records)
+			return FALSE;
+		header.count = wcmRecorderSnapshot(common, records,
+						   recorderSize(common->wcmRecorder),
+						   &header.lost);
+	}
+
+	memcpy(header.magic, WACOM_RECORDER_MAGIC, sizeof(header.magic));
+	rc = writeAll(fd, &header, sizeof(header)) &&
+	     writeAll(fd, records, header.count * sizeof(*records));
+	free(records);
+	return rc;
+}
+
+#ifdef ENABLE_TESTS
+
+#include "wacom-test-suite.h"
+
+static void recordN(WacomCommonPtr common, int first, int n)
+{
+	struct input_event ev = { .type = EV_ABS, .code = ABS_X };
+
+	for (int i = 0; i < n; i++)
+	{
+		ev.value = first + i;
+		wcmRecordEvdev(common, &ev);
+	}
+}
+
+TEST_CASE(test_recorder_wrap)
+{
+	WacomCommonRec common = {0};
+	struct wacom_record records[64];
+	unsigned int n, lost;
+
+	/* disabled recorder records nothing */
+	recordN(&common, 0, 4);
+	assert(wcmRecorderSnapshot(&common, records, 64, &lost) == 0);
+	assert(lost == 0);
+
+	/* rounded up to a power of two */
+	assert(wcmRecorderInit(&common, 13));
+	assert(common.wcmRecorder->mask == 15);
+
+	n = wcmRecorderSnapshot(&common, records, 64, &lost);
+	assert(n == 0);
+
+	recordN(&common, 0, 5);
+	n = wcmRecorderSnapshot(&common, records, 64, &lost);
+	assert(n == 5);
+	assert(lost == 0);
+	for (unsigned int i = 0; i < n; i++)
+	{
+		assert(records[i].kind == WACOM_RECORD_EVDEV);
+		assert(records[i].channel == WACOM_RECORD_NO_CHANNEL);
+		assert(records[i].v[2] == EV_ABS);
+		assert(records[i].v[4] == (int)i);
+	}
+
+	/* after wrapping we get the last 16, oldest first */
+	recordN(&common, 5, 35);
+	n = wcmRecorderSnapshot(&common, records, 64, &lost);
+	assert(n == 16);
+	assert(lost == 24);
+	for (unsigned int i = 0; i < n; i++)
+		assert(records[i].v[4] == (int)(24 + i));
+
+	/* a smaller buffer gets the most recent ones */
+	n = wcmRecorderSnapshot(&common, records, 4, &lost);
+	assert(n == 4);
+	assert(records[0].v[4] == 36);
+	assert(records[3].v[4] == 39);
+
+	wcmRecorderFree(&common);
+	assert(common.wcmRecorder == NULL);
+}
+
+TEST_CASE(test_recorder_stages)
+{
+	WacomCommonRec common = {0};
+	WacomDeviceState ds = {
+		.device_type = STYLUS_ID,
+		.device_id = STYLUS_DEVICE_ID,
+		.serial_num = 0x1234,
+		.proximity = 1,
+		.x = 100, .y = 200, .pressure = 300,
+		.tiltx = -10, .tilty = 20, .buttons = 0x1,
+	};
+	struct wacom_record records[4];
+	unsigned int n;
+
+	assert(wcmRecorderInit(&common, 16));
+
+	wcmRecordChannel(&common, 3, &ds);
+	wcmRecordFilter(&common, 3, &ds);
+	wcmRecordSuppress(&common, 3, SUPPRESS_NON_MOTION);
+	ds.proximity = 0;
+	wcmRecordEmit(&common, &ds, 1000, 2000);
+
+	n = wcmRecorderSnapshot(&common, records, ARRAY_SIZE(records), NULL);
+	assert(n == 4);
+
+	assert(records[0].kind == WACOM_RECORD_CHANNEL);
+	assert(records[0].channel == 3);
+	assert(records[0].v[0] == STYLUS_ID);
+	assert(records[0].v[1] == 0x1234);
+	assert(records[0].v[2] == STYLUS_DEVICE_ID);
+	assert(records[0].v[3] == 1);
+
+	assert(records[1].kind == WACOM_RECORD_FILTER);
+	assert(records[1].flags == ((STYLUS_ID << WACOM_RECORD_TYPE_SHIFT) |
+				    WACOM_RECORD_FLAG_PROXIMITY));
+	assert(records[1].v[0] == 100);
+	assert(records[1].v[3] == -10);
+	assert(records[1].v[5] == 0x1);
+
+	assert(records[2].kind == WACOM_RECORD_SUPPRESS);
+	assert(records[2].v[0] == WACOM_RECORD_SUPPRESS_NON_MOTION);
+
+	assert(records[3].kind == WACOM_RECORD_EMIT);
+	assert(records[3].channel == WACOM_RECORD_NO_CHANNEL);
+	assert(records[3].flags == STYLUS_ID << WACOM_RECORD_TYPE_SHIFT);
+	assert(records[3].v[0] == 1000);
+	assert(records[3].v[1] == 2000);
+
+	/* time is monotonic */
+	for (unsigned int i = 1; i < n; i++)
+		assert((int32_t)(records[i].time - records[i - 1].time) >= 0);
+
+	wcmRecorderFree(&common);
+}
+
+TEST_CASE(test_recorder_dump)
+{
+	WacomCommonRec common = { .vendor_id = WACOM_VENDOR_ID, .tablet_id = 0x357 };
+	struct wacom_recorder_header header;
+	struct wacom_record record;
+	FILE *f = tmpfile();
+
+	assert(f);
+	assert(wcmRecorderInit(&common, 4));
+	recordN(&common, 0, 6);
+	assert(wcmRecorderDump(&common, fileno(f)));
+
+	rewind(f);
+	assert(fread(&header, sizeof(header), 1, f) == 1);
+	assert(memcmp(header.magic, WACOM_RECORDER_MAGIC, sizeof(header.magic)) == 0);
+	assert(header.version == WACOM_RECORDER_VERSION);
+	assert(header.record_size == sizeof(struct wacom_record));
+	assert(header.count == 4);
+	assert(header.lost == 2);
+	assert(header.vendor_id == WACOM_VENDOR_ID);
+	assert(header.product_id == 0x357);
+	for (int i = 0; i < 4; i++)
+	{
+		assert(fread(&record, sizeof(record), 1, f) == 1);
+		assert(record.v[4] == 2 + i);
+	}
+	assert(fread(&record, sizeof(record), 1, f) == 0);
+
+	fclose(f);
+	wcmRecorderFree(&common);
+}
+
+BENCH_CASE(bench_record_evdev)
+{
+	WacomCommonRec common = {0};
+	struct input_event ev = { .type = EV_ABS, .code = ABS_X };
+
+	wcmRecorderInit(&common, DEFAULT_RECORDER_SIZE);
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		ev.value = i;
+		wcmRecordEvdev(&common, &ev);
+	}
+	wcmRecorderFree(&common);
+}
+
+#endif
+
+/* vim: set noexpandtab tabstop=8 shiftwidth=8: */
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2024 by the xf86-input-wacom contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __XF86_WCMRECORDER_H
+#define __XF86_WCMRECORDER_H
+
+#include <linux/input.h>
+#include <wacom-recorder.h>
+#include "xf86Wacom.h"
+
+#define DEFAULT_RECORDER_SIZE 4096	/* records, 128kB */
+#define MAX_RECORDER_SIZE 65536
+
+/****************************************************************************/
+
+Bool wcmRecorderInit(WacomCommonPtr common, unsigned int size);
+void wcmRecorderFree(WacomCommonPtr common);
+
+/* Writers, called from the input thread or with the input lock held */
+void wcmRecordEvdev(WacomCommonPtr common, const struct input_event *event);
+void wcmRecordChannel(WacomCommonPtr common, unsigned int channel,
+		      const WacomDeviceState *ds);
+void wcmRecordFilter(WacomCommonPtr common, unsigned int channel,
+		     const WacomDeviceState *ds);
+void wcmRecordSuppress(WacomCommonPtr common, unsigned int channel,
+		       enum WacomSuppressMode suppress);
+void wcmRecordEmit(WacomCommonPtr common, const WacomDeviceState *ds,
+		   int x, int y);
+
+/* Readers, may be called from any thread */
+unsigned int wcmRecorderSnapshot(WacomCommonPtr common,
+				 struct wacom_record *records,
+				 unsigned int max, unsigned int *lost);
+Bool wcmRecorderDump(WacomCommonPtr common, int fd);
+
+#endif /* __XF86_WCMRECORDER_H */
+
+/* vim: set noexpandtab tabstop=8 shiftwidth=8: */
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2024 by the xf86-input-wacom contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include <config.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "xf86Wacom.h"
+#include "wcmSimClock.h"
+
+struct sim_timer {
+	WacomTimerPtr timer;
+	uint64_t deadline;	/* in us */
+	WacomTimerCallback func;
+	void *userdata;
+};
+
+/* A driver has a handful of timers per device, a flat array that is
+ * searched linearly is all we need */
+struct _WacomSimClock {
+	uint64_t now;		/* in us */
+	struct sim_timer *timers;
+	size_t ntimers;
+	size_t size;
+};
+
+WacomSimClockPtr wcmSimClockNew(uint64_t start_us)
+{
+	WacomSimClockPtr clock = calloc(1, sizeof(*clock));
+
+	if (clock)
+		clock->now = start_us;
+
+	return clock;
+}
+
+void wcmSimClockFree(WacomSimClockPtr clock)
+{
+	if (!clock)
+		return;
+
+	free(clock->timers);
+	free(clock);
+}
+
+uint64_t wcmSimClockMicros(WacomSimClockPtr clock)
+{
+	return clock->now;
+}
+
+uint32_t wcmSimClockMillis(WacomSimClockPtr clock)
+{
+	return (uint32_t)(clock->now / 1000);
+}
+
+static struct sim_timer *findTimer(WacomSimClockPtr clock, WacomTimerPtr timer)
+{
+	for (size_t i = 0; i < clock->ntimers; i++)
+		if (clock->timers[i].timer == timer)
+			return &clock->timers[i];
+
+	return NULL;
+}
+
+void wcmSimClockCancelTimer(WacomSimClockPtr clock, WacomTimerPtr timer)
+{
+	struct sim_timer *t = findTimer(clock, timer);
+
+	if (t)
+		*t = clock->timers[--clock->ntimers];
+}
+
+void wcmSimClockSetTimer(WacomSimClockPtr clock, WacomTimerPtr timer, uint32_t millis,
+			 WacomTimerCallback func, void *userdata)
+{
+	struct sim_timer *t = findTimer(clock, timer);
+
+	if (!t) {
+		if (clock->ntimers == clock->size) {
+			size_t size = clock->size ? clock->size * 2 : 8;
+			struct sim_timer *timers = realloc(clock->timers, size * sizeof(*timers));
+
+			if (!timers)
+				return;
+			clock->timers = timers;
+			clock->size = size;
+		}
+		t = &clock->timers[clock->ntimers++];
+	}
+
+	t->timer = timer;
+	t->deadline = clock->now + (uint64_t)millis * 1000;
+	t->func = func;
+	t->userdata = userdata;
+}
+
+void wcmSimClockAdvance(WacomSimClockPtr clock, uint64_t now_us)
+{
+	if (now_us < clock->now)
+		return;
+
+	/* A callback may set or cancel any timer, so look for the earliest
+	 * one again after each of them */
+	while (1) {
+		struct sim_timer *next = NULL;
+		struct sim_timer t;
+		uint32_t millis;
+
+		for (size_t i = 0; i < clock->ntimers; i++) {
+			struct sim_timer *cur = &clock->timers[i];
+			if (cur->deadline <= now_us &&
+			    (!next || cur->deadline < next->deadline))
+				next = cur;
+		}
+		if (!next)
+			break;
+
+		t = *next;
+		*next = clock->timers[--clock->ntimers];
+
+		if (t.deadline > clock->now)
+			clock->now = t.deadline;
+		millis = t.func(t.timer, wcmSimClockMillis(clock), t.userdata);
+		if (millis)
+			wcmSimClockSetTimer(clock, t.timer, millis, t.func, t.userdata);
+	}
+
+	clock->now = now_us;
+}
+
+void wcmSimClockNotifyEvent(WacomSimClockPtr clock, const struct input_event *event)
+{
+	if (event->type == EV_SYN && event->code == SYN_REPORT)
+		wcmSimClockAdvance(clock, (uint64_t)event->input_event_sec * 1000000 +
+					  event->input_event_usec);
+}
+
+#ifdef ENABLE_TESTS
+
+#include <assert.h>
+#include "wacom-test-suite.h"
+
+struct sim_fired {
+	WacomSimClockPtr clock;
+	int count;
+	uint32_t millis[8];
+	void *order[8];
+	uint32_t rearm;
+	WacomTimerPtr cancel;
+};
+
+static uint32_t simTimerCallback(WacomTimerPtr timer, uint32_t millis, void *userdata)
+{
+	struct sim_fired *fired = userdata;
+
+	assert(fired->count < 8);
+	fired->millis[fired->count] = millis;
+	fired->order[fired->count] = timer;
+	fired->count++;
+
+	if (fired->cancel)
+		wcmSimClockCancelTimer(fired->clock, fired->cancel);
+
+	if (fired->rearm) {
+		fired->rearm--;
+		return 10;
+	}
+
+	return 0;
+}
+
+TEST_CASE(test_sim_clock_order)
+{
+	WacomSimClockPtr clock = wcmSimClockNew(5000000);
+	WacomTimerPtr a = (WacomTimerPtr)0x1, b = (WacomTimerPtr)0x2;
+	struct sim_fired fired = { .clock = clock };
+	struct input_event ev = { .type = EV_SYN, .code = SYN_REPORT };
+
+	assert(wcmSimClockMillis(clock) == 5000);
+
+	wcmSimClockSetTimer(clock, a, 100, simTimerCallback, &fired);
+	wcmSimClockSetTimer(clock, b, 50, simTimerCallback, &fired);
+
+	wcmSimClockAdvance(clock, 5049999);
+	assert(fired.count == 0);
+
+	/* Both are due, they fire in deadline order at their deadline */
+	ev.input_event_sec = 5;
+	ev.input_event_usec = 200000;
+	wcmSimClockNotifyEvent(clock, &ev);
+	assert(fired.count == 2);
+	assert(fired.order[0] == b && fired.millis[0] == 5050);
+	assert(fired.order[1] == a && fired.millis[1] == 5100);
+	assert(wcmSimClockMicros(clock) == 5200000);
+
+	/* Only SYN_REPORT advances the clock, and never backwards */
+	ev.type = EV_ABS;
+	ev.input_event_sec = 6;
+	wcmSimClockNotifyEvent(clock, &ev);
+	assert(wcmSimClockMicros(clock) == 5200000);
+	wcmSimClockAdvance(clock, 1000);
+	assert(wcmSimClockMicros(clock) == 5200000);
+
+	/* Setting a timer again replaces it */
+	wcmSimClockSetTimer(clock, a, 10, simTimerCallback, &fired);
+	wcmSimClockSetTimer(clock, a, 30, simTimerCallback, &fired);
+	wcmSimClockAdvance(clock, 5300000);
+	assert(fired.count == 3);
+	assert(fired.millis[2] == 5230);
+
+	wcmSimClockFree(clock);
+}
+
+TEST_CASE(test_sim_clock_rearm_cancel)
+{
+	WacomSimClockPtr clock = wcmSimClockNew(0);
+	WacomTimerPtr a = (WacomTimerPtr)0x1, b = (WacomTimerPtr)0x2;
+	struct sim_fired fired = { .clock = clock };
+
+	/* A callback returning non-zero fires again within the same advance */
+	fired.rearm = 2;
+	wcmSimClockSetTimer(clock, a, 10, simTimerCallback, &fired);
+	wcmSimClockAdvance(clock, 100000);
+	assert(fired.count == 3);
+	assert(fired.millis[0] == 10 && fired.millis[1] == 20 && fired.millis[2] == 30);
+
+	/* Cancelled timers don't fire, including those cancelled from
+	 * within another timer's callback */
+	fired.count = 0;
+	wcmSimClockSetTimer(clock, a, 10, simTimerCallback, &fired);
+	wcmSimClockCancelTimer(clock, a);
+	wcmSimClockAdvance(clock, 200000);
+	assert(fired.count == 0);
+
+	fired.cancel = b;
+	wcmSimClockSetTimer(clock, a, 10, simTimerCallback, &fired);
+	wcmSimClockSetTimer(clock, b, 20, simTimerCallback, &fired);
+	wcmSimClockAdvance(clock, 300000);
+	assert(fired.count == 1);
+	assert(fired.order[0] == a);
+
+	wcmSimClockFree(clock);
+}
+
+#endif
+
+/* vim: set noexpandtab tabstop=8 shiftwidth=8: */
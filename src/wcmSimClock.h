@@ -0,0 +1,56 @@
+/*
+ * Copyright 2024 by the xf86-input-wacom contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __XF86_WCMSIMCLOCK_H
+#define __XF86_WCMSIMCLOCK_H
+
+#include <linux/input.h>
+#include "xf86Wacom.h"
+
+/**
+ * A simulated clock and timer source for frontends that replay recorded
+ * events faster than real time.
+ *
+ * The frontend returns wcmSimClockMillis() from wcmTimeInMillis(),
+ * forwards wcmTimerSet() and wcmTimerCancel() here and passes every event
+ * from wcmNotifyEvdev() to wcmSimClockNotifyEvent(). The clock then jumps
+ * to the timestamp of each SYN_REPORT before the frame is processed,
+ * firing every timer that became due on the way in deadline order. The
+ * driver makes the same timing decisions as it did in real time.
+ *
+ * The clock never goes backwards.
+ */
+typedef struct _WacomSimClock *WacomSimClockPtr;
+
+WacomSimClockPtr wcmSimClockNew(uint64_t start_us);
+void wcmSimClockFree(WacomSimClockPtr clock);
+
+uint64_t wcmSimClockMicros(WacomSimClockPtr clock);
+uint32_t wcmSimClockMillis(WacomSimClockPtr clock);
+
+void wcmSimClockSetTimer(WacomSimClockPtr clock, WacomTimerPtr timer, uint32_t millis,
+			 WacomTimerCallback func, void *userdata);
+void wcmSimClockCancelTimer(WacomSimClockPtr clock, WacomTimerPtr timer);
+
+/* Advance to now_us, firing all timers due until then */
+void wcmSimClockAdvance(WacomSimClockPtr clock, uint64_t now_us);
+void wcmSimClockNotifyEvent(WacomSimClockPtr clock, const struct input_event *event);
+
+#endif /* __XF86_WCMSIMCLOCK_H */
+
+/* vim: set noexpandtab tabstop=8 shiftwidth=8: */
@@ -58,11 +58,11 @@ static void wcmFingerZoom(WacomDevicePtr priv);
  */
 static WacomChannelPtr getContactNumber(WacomCommonPtr common, unsigned int num)
 {
-	for (size_t i = 0; i < MAX_CHANNELS; i++)
+	for (int i = 0; i < common->wcmChannelCount; i++)
 	{
 		WacomChannelPtr channel = common->wcmChannel+i;
-		WacomDeviceState state  = channel->valid.state;
-		if (state.device_type == TOUCH_ID && state.serial_num == num + 1)
+		const WacomDeviceState *state = wcmChannelState(channel, 0);
+		if (state->device_type == TOUCH_ID && state->serial_num == num + 1)
 			return channel;
 	}
 
@@ -84,12 +84,12 @@ static void getStateHistory(WacomCommonPtr common, WacomDeviceState states[], un
 	for (unsigned int i = 0; i < num; i++)
 	{
 		WacomChannelPtr channel = getContactNumber(common, i);
-		if (channel == NULL || i > ARRAY_SIZE(channel->valid.states))
+		if (channel == NULL || age >= ARRAY_SIZE(channel->valid.states))
 		{
 			DBG(7, common, "Could not get state history for contact %u, age %u.\n", i, age);
 			continue;
 		}
-		states[i] = channel->valid.states[age];
+		states[i] = *wcmChannelState(channel, age);
 	}
 }
 
@@ -106,8 +106,8 @@ static void getStateHistory(WacomCommonPtr common, WacomDeviceState states[], un
 static void
 wcmSendTouchEvent(WacomDevicePtr priv, WacomChannelPtr channel, Bool no_update)
 {
-	WacomDeviceState state = channel->valid.state;
-	WacomDeviceState oldstate = channel->valid.states[1];
+	WacomDeviceState state = *wcmChannelState(channel, 0);
+	WacomDeviceState oldstate = *wcmChannelState(channel, 1);
 	int type = -1;
 
 	wcmRotateAndScaleCoordinates (priv, &state.x, &state.y);
@@ -125,6 +125,7 @@ wcmSendTouchEvent(WacomDevicePtr priv, WacomChannelPtr channel, Bool no_update)
 		type = XI_TouchUpdate;
 	}
 
+	wcmLatencyRecord(priv, LATENCY_EMIT);
 	wcmEmitTouch(priv, type, state.serial_num - 1, state.x, state.y);
 }
 
@@ -142,9 +143,9 @@ wcmFingerMultitouch(WacomDevicePtr priv, unsigned int contact_id) {
 	Bool lag_mode = priv->common->wcmGestureMode == GESTURE_LAG_MODE;
 	Bool prox = FALSE;
 
-	for (size_t i = 0; i < MAX_CHANNELS; i++) {
+	for (int i = 0; i < priv->common->wcmChannelCount; i++) {
 		WacomChannelPtr channel = priv->common->wcmChannel+i;
-		WacomDeviceState state  = channel->valid.state;
+		WacomDeviceState state  = *wcmChannelState(channel, 0);
 		if (state.device_type != TOUCH_ID)
 			continue;
 
@@ -232,6 +233,7 @@ static void wcmSendButtonClick(WacomDevicePtr priv, int button, int state)
 	WacomAxisData axes = {0};
 
 	/* send button event in state */
+	wcmLatencyRecord(priv, LATENCY_EMIT);
 	wcmEmitButton(priv, mode, button, state, &axes);
 
 	/* We have changed the button state (from down to up) for the device
@@ -244,7 +246,7 @@ static void wcmSendButtonClick(WacomDevicePtr priv, int button, int state)
  *   translate second finger tap to right click
  ****************************************************************************/
 
-static void wcmFingerTapToClick(WacomDevicePtr priv)
+static void wcmFingerTapToClick(WacomDevicePtr priv, uint32_t time)
 {
 	WacomCommonPtr common = priv->common;
 	WacomDeviceState ds[2] = {}, dsLast[2] = {};
@@ -259,7 +261,7 @@ static void wcmFingerTapToClick(WacomDevicePtr priv)
 
 	/* process second finger tap if matched */
 	if ((ds[0].sample < ds[1].sample) &&
-	    ((wcmTimeInMillis() -
+	    ((time -
 	    dsLast[1].sample) <= common->wcmGestureParameters.wcmTapTime) &&
 	    !ds[1].proximity && dsLast[1].proximity)
 	{
@@ -293,6 +295,19 @@ static uint32_t wcmSingleFingerTapTimer(WacomTimerPtr timer, uint32_t time, poin
 	return 0;
 }
 
+/* The time left until the tap times out, counted from when the finger
+ * was lifted at time rather than from now. The kernel's timestamp may be
+ * ahead of the server clock, the finger then was lifted just now. */
+static uint32_t tapTimerDelay(uint32_t tap_time, uint32_t now, uint32_t time)
+{
+	int32_t age = (int32_t)(now - time);
+
+	if (age < 0)
+		age = 0;
+
+	return ((uint32_t)age < tap_time) ? tap_time - age : 1;
+}
+
 /* A single finger tap is defined as 1 finger tap that lasts less than
  * wcmTapTime.  It results in a left button press.
  *
@@ -304,7 +319,7 @@ static uint32_t wcmSingleFingerTapTimer(WacomTimerPtr timer, uint32_t time, poin
  * Function relies on ds[0/1].sample to be updated only when entering or
  * exiting proximity so no storage is needed when initial touch occurs.
  */
-static void wcmSingleFingerTap(WacomDevicePtr priv)
+static void wcmSingleFingerTap(WacomDevicePtr priv, uint32_t time)
 {
 	WacomCommonPtr common = priv->common;
 	WacomDeviceState ds[2] = {}, dsLast[2] = {};
@@ -328,10 +343,14 @@ static void wcmSingleFingerTap(WacomDevicePtr priv)
 		    common->wcmGestureParameters.wcmTapTime &&
 		    ds[1].sample < dsLast[0].sample)
 		{
+			uint32_t delay;
+
 			common->wcmGestureMode = GESTURE_PREDRAG_MODE;
 
 			/* Delay to detect possible drag operation */
-			wcmTimerSet(priv->tap_timer, common->wcmGestureParameters.wcmTapTime,
+			delay = tapTimerDelay(common->wcmGestureParameters.wcmTapTime,
+					      wcmTimeInMillis(), time);
+			wcmTimerSet(priv->tap_timer, delay,
 				    wcmSingleFingerTapTimer, priv);
 		}
 	}
@@ -348,8 +367,8 @@ static void wcmSingleFingerPress(WacomDevicePtr priv)
 	WacomCommonPtr common = priv->common;
 	WacomChannelPtr firstChannel = getContactNumber(common, 0);
 	WacomChannelPtr secondChannel = getContactNumber(common, 1);
-	Bool firstInProx = firstChannel && firstChannel->valid.states[0].proximity;
-	Bool secondInProx = secondChannel && secondChannel->valid.states[0].proximity;
+	Bool firstInProx = firstChannel && wcmChannelState(firstChannel, 0)->proximity;
+	Bool secondInProx = secondChannel && wcmChannelState(secondChannel, 0)->proximity;
 
 	DBG(10, priv, "\n");
 
@@ -361,11 +380,11 @@ static void wcmSingleFingerPress(WacomDevicePtr priv)
 		return;
 
 	if (firstInProx && !secondInProx) {
-		firstChannel->valid.states[0].buttons |= 1;
+		wcmChannelCurrentState(firstChannel)->buttons |= 1;
 		common->wcmGestureMode = GESTURE_DRAG_MODE;
 	}
 	else {
-		firstChannel->valid.states[0].buttons &= ~1;
+		wcmChannelCurrentState(firstChannel)->buttons &= ~1;
 		common->wcmGestureMode = GESTURE_NONE_MODE;
 	}
 }
@@ -387,8 +406,9 @@ void wcmCancelGesture(WacomDevicePtr priv)
 	common->wcmGestureMode = GESTURE_CANCEL_MODE;
 }
 
-/* parsing gesture mode according to 2FGT data */
-void wcmGestureFilter(WacomDevicePtr priv, unsigned int touch_id)
+/* parsing gesture mode according to 2FGT data. time is the timestamp of
+ * the event being processed */
+void wcmGestureFilter(WacomDevicePtr priv, unsigned int touch_id, uint32_t time)
 {
 	WacomCommonPtr common = priv->common;
 	WacomDeviceState ds[2] = {}, dsLast[2] = {};
@@ -474,9 +494,7 @@ void wcmGestureFilter(WacomDevicePtr priv, unsigned int touch_id)
 	 */
 	else if (dsLast[0].proximity && common->wcmGestureMode != GESTURE_DRAG_MODE)
 	{
-		CARD32 ms = wcmTimeInMillis();
-
-		if ((ms - ds[0].sample) < WACOM_GESTURE_LAG_TIME)
+		if ((time - ds[0].sample) < WACOM_GESTURE_LAG_TIME)
 		{
 			/* Must have recently come into proximity.  Change
 			 * into LAG mode.
@@ -543,7 +561,7 @@ void wcmGestureFilter(WacomDevicePtr priv, unsigned int touch_id)
 	}
 
 	if (!(common->wcmGestureMode & (GESTURE_SCROLL_MODE | GESTURE_ZOOM_MODE)) && touch_id == 1)
-		wcmFingerTapToClick(priv);
+		wcmFingerTapToClick(priv, time);
 
 	/* Change mode happens only when both fingers are out */
 	if (common->wcmGestureMode & GESTURE_TAP_MODE)
@@ -573,7 +591,7 @@ ret:
 	if ((common->wcmGestureMode == GESTURE_NONE_MODE || common->wcmGestureMode == GESTURE_DRAG_MODE) &&
 	    touch_id == 0)
 	{
-		wcmSingleFingerTap(priv);
+		wcmSingleFingerTap(priv, time);
 		wcmSingleFingerPress(priv);
 	}
 }
@@ -785,4 +803,29 @@ Bool wcmTouchNeedSendEvents(WacomCommonPtr common)
 	return !(common->wcmGestureMode & ~GESTURE_DRAG_MODE);
 }
 
+#ifdef ENABLE_TESTS
+
+#include <assert.h>
+#include "wacom-test-suite.h"
+
+TEST_CASE(test_tap_timer_delay)
+{
+	const uint32_t tap_time = 250;
+
+	/* the rest of the tap time after the finger was lifted */
+	assert(tapTimerDelay(tap_time, 1000, 1000) == tap_time);
+	assert(tapTimerDelay(tap_time, 1100, 1000) == 150);
+	assert(tapTimerDelay(tap_time, 1250, 1000) == 1);
+	assert(tapTimerDelay(tap_time, 5000, 1000) == 1);
+
+	/* a kernel timestamp ahead of the server clock is no age */
+	assert(tapTimerDelay(tap_time, 1000, 1005) == tap_time);
+	assert(tapTimerDelay(tap_time, UINT32_MAX - 2, 3) == tap_time);
+
+	/* the clock wrapped since the finger was lifted */
+	assert(tapTimerDelay(tap_time, 99, UINT32_MAX - 100) == 50);
+}
+
+#endif
+
 /* vim: set noexpandtab tabstop=8 shiftwidth=8: */
@@ -24,7 +24,7 @@
 
 /****************************************************************************/
 
-void wcmGestureFilter(WacomDevicePtr priv, unsigned int touch_id);
+void wcmGestureFilter(WacomDevicePtr priv, unsigned int touch_id, uint32_t time);
 Bool wcmTouchNeedSendEvents(WacomCommonPtr common);
 
 /****************************************************************************/
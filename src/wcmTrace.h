@@ -0,0 +1,66 @@
+/*
+ * Copyright 2024 by the xf86-input-wacom contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __XF86_WCMTRACE_H
+#define __XF86_WCMTRACE_H
+
+#include <config.h>
+
+/**
+ * Static tracepoints (USDT) at the boundaries of the event pipeline,
+ * enabled with the usdt build option. A probe is a single nop until a
+ * tracer attaches to it, e.g.
+ *
+ *   bpftrace -e 'usdt:/usr/lib/xorg/modules/input/wacom_drv.so:wacom:frame
+ *                { @[arg1] = count(); }' -p $(pidof Xorg)
+ *
+ * Probes of the provider "wacom", arguments in order:
+ *   read_entry		device name
+ *   read_exit		device name, bytes read or negative errno
+ *   frame		number of evdev events, channel
+ *   event		channel, device type, serial
+ *   suppress		device name, channel, enum WacomSuppressMode
+ *   send_events	device name, device type, proximity, x, y
+ *   emit_proximity	device name, proximity in
+ *   emit_motion	device name, is absolute
+ *   emit_button	device name, button, is press
+ *   emit_touch		device name, type, touch id, x, y
+ *   emit_keycode	device name, keycode, state
+ *
+ * The arguments are evaluated even without a tracer, keep them trivial.
+ */
+
+#ifdef HAVE_USDT
+#include <sys/sdt.h>
+
+#define WCM_PROBE1(name, a) DTRACE_PROBE1(wacom, name, a)
+#define WCM_PROBE2(name, a, b) DTRACE_PROBE2(wacom, name, a, b)
+#define WCM_PROBE3(name, a, b, c) DTRACE_PROBE3(wacom, name, a, b, c)
+#define WCM_PROBE4(name, a, b, c, d) DTRACE_PROBE4(wacom, name, a, b, c, d)
+#define WCM_PROBE5(name, a, b, c, d, e) DTRACE_PROBE5(wacom, name, a, b, c, d, e)
+#else
+#define WCM_PROBE1(name, a) do {} while(0)
+#define WCM_PROBE2(name, a, b) do {} while(0)
+#define WCM_PROBE3(name, a, b, c) do {} while(0)
+#define WCM_PROBE4(name, a, b, c, d) do {} while(0)
+#define WCM_PROBE5(name, a, b, c, d, e) do {} while(0)
+#endif
+
+#endif /* __XF86_WCMTRACE_H */
+
+/* vim: set noexpandtab tabstop=8 shiftwidth=8: */
@@ -20,17 +20,38 @@
 #include <config.h>
 
 #include "xf86Wacom.h"
+#include "wcmFilter.h"
+#include "wcmRecorder.h"
+#include "wcmTrace.h"
 
 #if ENABLE_TESTS
 #include "wacom-test-suite.h"
 #endif
 
+#include <fcntl.h>
 #include <math.h>
+#include <time.h>
+#include <unistd.h>
 #include <asm/types.h>
 #include <linux/input.h>
 #include <sys/utsname.h>
 
 #define MAX_USB_EVENTS 128
+#define CHANNEL_ALIGNMENT 64 /* cache line */
+
+/* Per-code event information, precomputed by usbInitEventTables() from
+ * the device's capabilities so the event path needs a single lookup */
+#define EVENT_FILTER_TOUCH	0x01	/* dropped in touch frames */
+#define EVENT_FILTER_OTHER	0x02	/* dropped in all other frames */
+#define EVENT_MT		0x04	/* handled by usbParseAbsMTEvent() */
+#define EVENT_PAD		0x08	/* may come from the pad */
+#define EVENT_TOOL_BY_ID	0x10	/* value is a tool ID (ABS_MISC) */
+
+typedef struct {
+	uint8_t flags;               /* EVENT_* */
+	uint8_t tool_type;           /* tool type announced by the code or 0 */
+	int8_t pad_index;            /* index into padkey_code or -1 */
+} usbEventInfo;
 
 typedef struct {
 	unsigned int wcmLastToolSerial;
@@ -39,15 +60,52 @@ typedef struct {
 	Bool wcmUseMT;
 	int wcmMTChannel;
 	unsigned int wcmEventCnt;
-	struct input_event wcmEvents[MAX_USB_EVENTS];
+	const struct input_event *wcmEvents; /* current frame, in wcmEventQueue or the read buffer */
+	struct input_event wcmEventQueue[MAX_USB_EVENTS];
 	uint32_t wcmEventFlags;      /* event types received in this frame */
 	int nbuttons;                /* total number of buttons */
 	int npadkeys;                /* number of pad keys in the above array */
 	int padkey_code[WCM_MAX_BUTTONS];/* hardware codes for buttons */
 	int lastChannel;
 	Bool grabDevice;
+	Bool wcmResync;              /* dropping events until SYN_REPORT */
+	Bool kernelTimestamps;       /* use the CLOCK_MONOTONIC event timestamps */
+	uint32_t wcmFrameTime;       /* timestamp of the current frame in ms */
+	uint64_t wcmChannelBusy;     /* channels handed out by usbChooseChannel */
+	struct {
+		int device_type;
+		unsigned int serial;
+	} wcmChannelKey[MAX_CHANNELS]; /* tool owning each busy channel */
+	uint8_t wcmSlotChannel[MAX_FINGERS]; /* last channel used by each MT slot */
+	usbEventInfo keyInfo[KEY_CNT];
+	usbEventInfo absInfo[ABS_CNT];
+	usbEventInfo relInfo[REL_CNT];
 } wcmUSBData;
 
+static const usbEventInfo usbNoEventInfo = { .pad_index = -1 };
+
+static inline const usbEventInfo *usbGetEventInfo(wcmUSBData *private,
+						  const struct input_event *event)
+{
+	switch (event->type)
+	{
+		case EV_KEY:
+			if (event->code < KEY_CNT)
+				return &private->keyInfo[event->code];
+			break;
+		case EV_ABS:
+			if (event->code < ABS_CNT)
+				return &private->absInfo[event->code];
+			break;
+		case EV_REL:
+			if (event->code < REL_CNT)
+				return &private->relInfo[event->code];
+			break;
+	}
+
+	return &usbNoEventInfo;
+}
+
 static Bool usbDetect(WacomDevicePtr priv);
 static Bool usbParseOptions(WacomDevicePtr priv);
 static Bool usbWcmInit(WacomDevicePtr priv);
@@ -57,15 +115,25 @@ static int usbInitProtocol5(WacomDevicePtr priv);
 static int usbInitProtocol4(WacomDevicePtr priv);
 static int usbInitialize(WacomDevicePtr priv);
 static int usbParse(WacomDevicePtr priv, const unsigned char* data, unsigned long len);
+static int usbParseFrames(WacomDevicePtr priv, const struct input_event *events,
+			  unsigned int nevents, unsigned int *nframes);
 static int usbDetectConfig(WacomDevicePtr priv);
 static void usbParseEvent(WacomDevicePtr priv,
 	const struct input_event* event);
+static void usbProcessEvent(WacomDevicePtr priv,
+			    const struct input_event *event);
 static void usbParseSynEvent(WacomDevicePtr priv,
 			     const struct input_event *event);
 static void usbParseMscEvent(WacomDevicePtr priv,
 			     const struct input_event *event);
 static void usbDispatchEvents(WacomDevicePtr priv);
+static void usbResyncState(WacomDevicePtr priv, const struct input_event *syn);
 static int usbChooseChannel(WacomCommonPtr common, int device_type, unsigned int serial);
+static int usbFilterEvent(WacomCommonPtr common, const struct input_event *event);
+static int deviceTypeFromEvent(WacomDevicePtr priv, int type, int code, int value);
+static Bool eventCouldBeFromPad(WacomDevicePtr priv,
+			       const struct input_event *event_ptr);
+static void usbInitEventTables(WacomDevicePtr priv);
 
 static WacomHWClass gWacomUSBDevice =
 {
@@ -84,6 +152,7 @@ static struct _WacomModel mname =		\
 	.DetectConfig = usbDetectConfig,	\
 	.Start = usbStart,			\
 	.Parse = usbParse,			\
+	.ParseFrames = usbParseFrames,		\
 }
 
 DEFINE_MODEL(usbUnknown,	"Unknown USB",		5);
@@ -146,6 +215,7 @@ static Bool usbParseOptions(WacomDevicePtr priv)
 
 	usbdata = common->private;
 	usbdata->grabDevice = wcmOptCheckBool(priv, "GrabDevice", FALSE);
+	usbdata->kernelTimestamps = wcmOptCheckBool(priv, "KernelTimestamps", TRUE);
 
 	return TRUE;
 }
@@ -172,6 +242,22 @@ usbStart(WacomDevicePtr priv)
 				    "Wacom X driver can't grab event device (%s)\n",
 				    strerror(errno));
 	}
+
+	if (usbdata->kernelTimestamps)
+	{
+		/* Our timestamps are compared to wcmTimeInMillis() which is
+		 * CLOCK_MONOTONIC, the kernel defaults to CLOCK_REALTIME */
+		int clockid = CLOCK_MONOTONIC;
+
+		SYSCALL(err = ioctl(wcmGetFd(priv), EVIOCSCLOCKID, &clockid));
+		if (err < 0)
+		{
+			wcmLog(priv, W_WARNING,
+			       "Unable to switch to monotonic event timestamps (%s)\n",
+			       strerror(errno));
+			usbdata->kernelTimestamps = FALSE;
+		}
+	}
 	return Success;
 }
 
@@ -552,6 +638,68 @@ static void usbWcmInitPadState(WacomDevicePtr priv)
 	ds->serial_num = channel;
 }
 
+/* Number of channels the tablet needs: the pad, the stylus or mouse
+ * (two for protocol 5 dual-track tablets) and one per touch contact.
+ * ncontacts is set to the number of touch contacts that fit. */
+static int usbChannelCount(WacomCommonPtr common, int *ncontacts)
+{
+	wcmUSBData* private = common->private;
+	int count = 2;
+
+	if (common->wcmProtocolLevel == WCM_PROTOCOL_5)
+		count++;
+
+	*ncontacts = 0;
+	if (private->wcmUseMT ||
+	    TabletHasFeature(common, WCM_1FGT) ||
+	    TabletHasFeature(common, WCM_2FGT) ||
+	    ISBITSET(common->wcmKeys, BTN_TOOL_FINGER))
+		*ncontacts = min(max(common->wcmMaxContacts, 2), MAX_CHANNELS - count);
+
+	return count + *ncontacts;
+}
+
+static Bool usbInitChannels(WacomDevicePtr priv)
+{
+	WacomCommonPtr common = priv->common;
+	wcmUSBData* private = common->private;
+	int ncontacts;
+	int count = usbChannelCount(common, &ncontacts);
+	size_t size;
+	void *channels;
+
+	/* shared by all tools on this tablet and the input thread, only the
+	 * first one allocates and the array never moves after that */
+	if (common->wcmChannel)
+	{
+		if (common->wcmChannelCount != count)
+			wcmLog(priv, W_WARNING, "needs %d channels but the tablet has %d, keeping them.\n",
+			       count, common->wcmChannelCount);
+		return TRUE;
+	}
+
+	if (ncontacts && common->wcmMaxContacts > ncontacts)
+		wcmLog(priv, W_WARNING, "tracking only %d of %d touch contacts.\n",
+		       ncontacts, common->wcmMaxContacts);
+
+	size = count * sizeof(WacomChannel);
+	if (posix_memalign(&channels, CHANNEL_ALIGNMENT, size))
+	{
+		wcmLog(priv, W_ERROR, "unable to alloc %d channels.\n", count);
+		return FALSE;
+	}
+	memset(channels, 0, size);
+
+	common->wcmChannel = channels;
+	common->wcmChannelCount = count;
+	common->wcmDirtyChannels = 0;
+	private->wcmChannelBusy = 0;
+	private->lastChannel = PAD_CHANNEL;
+
+	DBG(1, priv, "using %d channels\n", count);
+	return TRUE;
+}
+
 int usbInitialize(WacomDevicePtr priv)
 {
 	struct input_absinfo absinfo;
@@ -624,6 +772,7 @@ int usbInitialize(WacomDevicePtr priv)
 		common->wcmMaxTouchX = absinfo.maximum;
 		common->wcmTouchResolX = absinfo.resolution * 1000;
 	}
+	common->wcmAxisFuzz[SUPPRESS_AXIS_POSITION] = absinfo.fuzz;
 
 	/* max y */
 	if (ioctl(wcmGetFd(priv), EVIOCGABS(ABS_Y), &absinfo) < 0)
@@ -649,6 +798,8 @@ int usbInitialize(WacomDevicePtr priv)
 		common->wcmMaxTouchY = absinfo.maximum;
 		common->wcmTouchResolY = absinfo.resolution * 1000;
 	}
+	common->wcmAxisFuzz[SUPPRESS_AXIS_POSITION] =
+		max(common->wcmAxisFuzz[SUPPRESS_AXIS_POSITION], absinfo.fuzz);
 
 	/* max finger strip X for tablets with Expresskeys
 	 * or physical X for touch devices in hundredths of a mm */
@@ -707,6 +858,7 @@ int usbInitialize(WacomDevicePtr priv)
 		common->wcmTiltMaxX = round((absinfo.maximum +
 					     common->wcmTiltOffX) *
 					    common->wcmTiltFactX);
+		common->wcmAxisFuzz[SUPPRESS_AXIS_TILT] = absinfo.fuzz;
 	}
 
 	/* Y tilt range */
@@ -761,7 +913,23 @@ int usbInitialize(WacomDevicePtr priv)
 	/* max z cannot be configured */
 	if (ISBITSET(abs, ABS_PRESSURE) &&
 			!ioctl(wcmGetFd(priv), EVIOCGABS(ABS_PRESSURE), &absinfo))
+	{
 		common->wcmMaxZ = absinfo.maximum;
+		common->wcmAxisFuzz[SUPPRESS_AXIS_PRESSURE] = absinfo.fuzz;
+	}
+
+	/* fuzz of the remaining axes for the suppress defaults */
+	if (ISBITSET(abs, ABS_THROTTLE) &&
+			!ioctl(wcmGetFd(priv), EVIOCGABS(ABS_THROTTLE), &absinfo))
+		common->wcmAxisFuzz[SUPPRESS_AXIS_THROTTLE] = absinfo.fuzz;
+
+	if (ISBITSET(abs, ABS_RZ) &&
+			!ioctl(wcmGetFd(priv), EVIOCGABS(ABS_RZ), &absinfo))
+		common->wcmAxisFuzz[SUPPRESS_AXIS_ROTATION] = absinfo.fuzz;
+
+	if (ISBITSET(abs, ABS_WHEEL) &&
+			!ioctl(wcmGetFd(priv), EVIOCGABS(ABS_WHEEL), &absinfo))
+		common->wcmAxisFuzz[SUPPRESS_AXIS_WHEEL] = absinfo.fuzz;
 
 	/* max distance */
 	if (ISBITSET(abs, ABS_DISTANCE) &&
@@ -805,7 +973,11 @@ int usbInitialize(WacomDevicePtr priv)
 	}
 
 pad_init:
+	if (!usbInitChannels(priv))
+		return !Success;
+
 	usbWcmInitPadState(priv);
+	usbInitEventTables(priv);
 
 	return Success;
 }
@@ -843,6 +1015,60 @@ static int usbParse(WacomDevicePtr priv, const unsigned char* data, unsigned lon
 	return common->wcmPktLength;
 }
 
+/**
+ * Zero-copy counterpart to usbParse. All complete frames, i.e. all events
+ * up to and including the last SYN_REPORT, are processed in place. Events
+ * after the last SYN_REPORT are left to the caller, to be handed in again
+ * once the rest of their frame has been read.
+ *
+ * @param[in] priv
+ * @param[in] events   Events as read from the device
+ * @param[in] nevents  Number of events in events
+ * @param[out] nframes Number of complete frames processed
+ * @return             Number of events consumed
+ */
+static int usbParseFrames(WacomDevicePtr priv, const struct input_event *events,
+			  unsigned int nevents, unsigned int *nframes)
+{
+	WacomCommonPtr common = priv->common;
+	wcmUSBData* private = common->private;
+	unsigned int i, end = 0, frames = 0;
+
+	/* find the end of the last complete frame */
+	for (i = nevents; i > 0; i--)
+	{
+		if (events[i - 1].type == EV_SYN && events[i - 1].code == SYN_REPORT)
+		{
+			end = i;
+			break;
+		}
+	}
+
+	for (i = 0; i < end; i++)
+	{
+		const struct input_event *event = &events[i];
+
+		wcmNotifyEvdev(priv, event);
+		wcmRecordEvdev(common, event);
+
+		/* events of a frame are contiguous, so the frame is just
+		 * a pointer to its first event and a count */
+		if (private->wcmEventCnt == 0)
+			private->wcmEvents = event;
+		private->wcmEventCnt++;
+
+		if (event->type == EV_SYN && event->code == SYN_REPORT)
+			frames++;
+
+		usbProcessEvent(priv, event);
+	}
+
+	common->wcmEventsRead += end;
+	common->wcmFramesRead += frames;
+	*nframes = frames;
+	return end;
+}
+
 /**
  * Returns a serial number for the provided device_type and serial, as
  * through it came from from a Protocol 5 device.
@@ -876,12 +1102,102 @@ static unsigned int protocol5Serial(int device_type, unsigned int serial) {
 	}
 }
 
+static inline void usbMarkDirty(WacomCommonPtr common, int channel, Bool change)
+{
+	if (change)
+		common->wcmDirtyChannels |= 1ULL << channel;
+}
+
+/* Reset a channel for a new tool. The history ring and the filter
+ * buffers are left as they are, both are ignored until written again. */
+static void usbRecycleChannel(WacomChannelPtr channel)
+{
+	memset(&channel->work, 0, sizeof(channel->work));
+	wcmChannelClearHistory(channel);
+	wcmResetSampleCounter(channel);
+}
+
+static inline Bool usbChannelIsFree(WacomChannelPtr channel)
+{
+	return !channel->work.proximity && !wcmChannelState(channel, 0)->proximity;
+}
+
+/* All channels but the pad's */
+static inline uint64_t usbToolChannels(WacomCommonPtr common)
+{
+	return (UINT64_MAX >> (64 - common->wcmChannelCount)) & ~(1ULL << PAD_CHANNEL);
+}
+
+/* Drop the channel from the busy map once it has left proximity */
+static void usbUpdateChannelBusy(WacomCommonPtr common, int channel)
+{
+	wcmUSBData* private = common->private;
+
+	if (channel != PAD_CHANNEL && usbChannelIsFree(&common->wcmChannel[channel]))
+		private->wcmChannelBusy &= ~(1ULL << channel);
+}
+
+static inline Bool usbChannelMatches(WacomCommonPtr common, int channel,
+				     int device_type, unsigned int serial)
+{
+	wcmUSBData* private = common->private;
+
+	return (private->wcmChannelBusy & (1ULL << channel)) &&
+		private->wcmChannelKey[channel].device_type == device_type &&
+		private->wcmChannelKey[channel].serial == serial &&
+		common->wcmChannel[channel].work.proximity;
+}
+
+static void usbClaimChannel(WacomCommonPtr common, int channel,
+			    int device_type, unsigned int serial)
+{
+	wcmUSBData* private = common->private;
+
+	private->wcmChannelBusy |= 1ULL << channel;
+	private->wcmChannelKey[channel].device_type = device_type;
+	private->wcmChannelKey[channel].serial = serial;
+	if (device_type == TOUCH_ID && serial >= 1 && serial <= MAX_FINGERS)
+		private->wcmSlotChannel[serial - 1] = channel;
+}
+
+/* The lowest free tool channel, recycled, or -1 */
+static int usbFindFreeChannel(WacomCommonPtr common)
+{
+	wcmUSBData* private = common->private;
+	uint64_t mask = ~private->wcmChannelBusy & usbToolChannels(common);
+	int i;
+
+	if (!mask)
+	{
+		/* reclaim channels that left proximity without an event */
+		for (i = 0; i < common->wcmChannelCount; i++)
+			usbUpdateChannelBusy(common, i);
+		mask = ~private->wcmChannelBusy & usbToolChannels(common);
+	}
+
+	while ((i = ffsll(mask)))
+	{
+		mask &= ~(1ULL << --i);
+		if (!usbChannelIsFree(&common->wcmChannel[i]))
+		{
+			/* in use behind our back, keep it out of the free map */
+			private->wcmChannelBusy |= 1ULL << i;
+			continue;
+		}
+
+		usbRecycleChannel(&common->wcmChannel[i]);
+		return i;
+	}
+
+	return -1;
+}
+
 /**
  * Find an appropriate channel to track the specified tool's state in.
  * If the tool is already in proximity, the channel currently being used
  * to store its state will be returned. Otherwise, an arbitrary available
- * channel will be cleaned and returned. Up to MAX_CHANNEL tools can be
- * tracked concurrently by driver.
+ * channel will be cleaned and returned. Up to wcmChannelCount - 1 tools
+ * can be tracked concurrently by driver.
  *
  * @param[in] common
  * @param[in] device_type  Type of tool (e.g. STYLUS_ID, TOUCH_ID, PAD_ID)
@@ -891,71 +1207,72 @@ static unsigned int protocol5Serial(int device_type, unsigned int serial) {
 static int usbChooseChannel(WacomCommonPtr common, int device_type, unsigned int serial)
 {
 	/* figure out the channel to use based on serial number */
-	int i, channel = -1;
+	wcmUSBData* private = common->private;
+	uint64_t mask;
+	int i, channel;
 
 	/* force events from PAD device to PAD_CHANNEL */
 	if (serial == DEFAULT_TOOL_SERIAL)
-		channel = PAD_CHANNEL;
+		return PAD_CHANNEL;
 
-	/* find existing channel */
-	if (channel < 0)
+	/* find existing channel, MT slots remember theirs */
+	if (device_type == TOUCH_ID && serial >= 1 && serial <= MAX_FINGERS)
 	{
-		for (i=0; i<MAX_CHANNELS; i++)
-		{
-			if (common->wcmChannel[i].work.proximity &&
-			    common->wcmChannel[i].work.device_type == device_type &&
-			    common->wcmChannel[i].work.serial_num == serial)
-			{
-				channel = i;
-				break;
-			}
-		}
+		i = private->wcmSlotChannel[serial - 1];
+		if (usbChannelMatches(common, i, device_type, serial))
+			return i;
 	}
 
-	/* find and clean an empty channel */
-	if (channel < 0)
+	mask = private->wcmChannelBusy & usbToolChannels(common);
+	while ((i = ffsll(mask)))
 	{
-		for (i=0; i<MAX_CHANNELS; i++)
-		{
-			if (i == PAD_CHANNEL)
-				continue;
-
-			if (!common->wcmChannel[i].work.proximity &&
-			    !common->wcmChannel[i].valid.state.proximity)
-			{
-				channel = i;
-				memset(&common->wcmChannel[channel],0, sizeof(WacomChannel));
-				break;
-			}
-		}
+		mask &= ~(1ULL << --i);
+		if (usbChannelMatches(common, i, device_type, serial))
+			return i;
 	}
 
+	/* find and clean an empty channel */
+	channel = usbFindFreeChannel(common);
+
 	/* fresh out of channels */
 	if (channel < 0)
 	{
+		common->wcmChannelsExhausted++;
+
 		/* This should never happen in normal use.
 		 * Let's start over again. Force prox-out for all channels.
 		 */
-		for (i=0; i<MAX_CHANNELS; i++)
+		for (i = 0; i < common->wcmChannelCount; i++)
 		{
+			WacomChannelPtr pChannel = &common->wcmChannel[i];
+
 			if (i == PAD_CHANNEL)
 				continue;
 
-			if (common->wcmChannel[i].work.proximity &&
-			    (common->wcmChannel[i].work.serial_num != DEFAULT_TOOL_SERIAL))
+			if (pChannel->work.proximity &&
+			    (pChannel->work.serial_num != DEFAULT_TOOL_SERIAL))
 			{
-				common->wcmChannel[i].work.proximity = 0;
+				pChannel->work.proximity = 0;
 				/* dispatch event */
-				wcmEvent(common, i, &common->wcmChannel[i].work);
+				wcmEvent(common, i, &pChannel->work);
 				DBG(2, common, "free channels: dropping %u\n",
-						common->wcmChannel[i].work.serial_num);
+						pChannel->work.serial_num);
 			}
+			/* a tool without a device never got its prox-out
+			 * into the history, don't let it hold the channel */
+			wcmChannelClearHistory(pChannel);
+			usbUpdateChannelBusy(common, i);
 		}
 		DBG(1, common, "device with serial number: %u"
-		    " at %u: Exceeded channel count; ignoring the events.\n",
-		    serial, wcmTimeInMillis());
+		    " at %u: Exceeded channel count of %d.\n",
+		    serial, wcmTimeInMillis(), common->wcmChannelCount);
+
+		channel = usbFindFreeChannel(common);
 	}
 
+	if (channel >= 0)
+		usbClaimChannel(common, channel, device_type, serial);
+
 	return channel;
 }
 
@@ -975,12 +1292,18 @@ static void usbParseEvent(WacomDevicePtr priv,
 	DBG(10, common, "\n");
 
 	wcmNotifyEvdev(priv, event);
+	wcmRecordEvdev(common, event);
+
+	common->wcmEventsRead++;
+	if (event->type == EV_SYN && event->code == SYN_REPORT)
+		common->wcmFramesRead++;
 
 	/* store events until we receive a SYN_REPORT */
 
 	/* space left? bail if not. */
-	if (private->wcmEventCnt >= ARRAY_SIZE(private->wcmEvents))
+	if (private->wcmEventCnt >= ARRAY_SIZE(private->wcmEventQueue))
 	{
+		common->wcmQueueOverflows++;
 		wcmLogSafe(priv, W_ERROR, "%s: usbParse: Exceeded event queue (%u) \n",
 		       priv->name, private->wcmEventCnt);
 		usbResetEventCounter(private);
@@ -988,7 +1311,44 @@ static void usbParseEvent(WacomDevicePtr priv,
 	}
 
 	/* save it for later */
-	private->wcmEvents[private->wcmEventCnt++] = *event;
+	private->wcmEventQueue[private->wcmEventCnt++] = *event;
+	private->wcmEvents = private->wcmEventQueue;
+
+	usbProcessEvent(priv, event);
+}
+
+/**
+ * Handle an event that has just been appended to the current frame.
+ */
+static void usbProcessEvent(WacomDevicePtr priv, const struct input_event *event)
+{
+	WacomCommonPtr common = priv->common;
+	wcmUSBData* private = common->private;
+
+	/* After a SYN_DROPPED the kernel's event stream is incomplete up to
+	 * and including the next SYN_REPORT. Drop everything until then and
+	 * rebuild the state from the kernel's current state */
+	if (private->wcmResync)
+	{
+		usbResetEventCounter(private);
+		if (event->type == EV_SYN && event->code == SYN_REPORT)
+		{
+			private->wcmResync = FALSE;
+			usbResyncState(priv, event);
+		}
+		return;
+	}
+
+	if (event->type == EV_SYN && event->code == SYN_DROPPED)
+	{
+		common->wcmSynDropped++;
+		wcmLogSafe(priv, W_WARNING, "%s: SYN_DROPPED received (%u), resyncing\n",
+			   priv->name, common->wcmSynDropped);
+		private->wcmResync = TRUE;
+		usbResetEventCounter(private);
+		return;
+	}
+
 	private->wcmEventFlags |= 1 << event->type;
 
 	switch (event->type)
@@ -1036,6 +1396,30 @@ static void usbParseMscEvent(WacomDevicePtr priv,
 	}
 }
 
+/**
+ * The kernel stamps all events of a frame with the same time, the whole
+ * frame uses the timestamp of its SYN_REPORT. In us, 0 if it's not
+ * CLOCK_MONOTONIC.
+ */
+static uint64_t usbFrameTimeUs(wcmUSBData *private)
+{
+	const struct input_event *syn;
+
+	if (!private->kernelTimestamps || private->wcmEventCnt == 0)
+		return 0;
+
+	syn = &private->wcmEvents[private->wcmEventCnt - 1];
+	return (uint64_t)syn->input_event_sec * 1000000 + syn->input_event_usec;
+}
+
+/* The frame's time in wrapping ms, the server's time if it has none */
+static uint32_t usbFrameTime(wcmUSBData *private)
+{
+	uint64_t us = usbFrameTimeUs(private);
+
+	return us ? (uint32_t)(us / 1000) : wcmTimeInMillis();
+}
+
 /**
  * EV_SYN marks the end of a set of events containing axes and button info.
  * Check for valid data and hand over to dispatch to extract the actual
@@ -1070,13 +1454,16 @@ static void usbParseSynEvent(WacomDevicePtr priv,
 	}
 
 	/* dispatch all queued events */
+	common->wcmFrameTimeUs = usbFrameTimeUs(private);
+	common->wcmParseTimeUs = wcmTimeInMicros();
 	usbDispatchEvents(priv);
+	common->wcmFrameTimeUs = 0;
 
 skipEvent:
 	usbResetEventCounter(private);
 }
 
-static int usbFilterEvent(WacomCommonPtr common, struct input_event *event)
+static int usbFilterEvent(WacomCommonPtr common, const struct input_event *event)
 {
 	wcmUSBData* private = common->private;
 
@@ -1234,7 +1621,7 @@ static int usbFindDeviceTypeById(WacomCommonPtr common, int device_id)
  * @param channel_number
  */
 static int usbParseGenericAbsEvent(WacomCommonPtr common,
-			    struct input_event *event, int channel_number)
+			    const struct input_event *event, int channel_number)
 {
 	WacomChannel *channel = &common->wcmChannel[channel_number];
 	WacomDeviceState *ds = &channel->work;
@@ -1289,7 +1676,7 @@ static int usbParseGenericAbsEvent(WacomCommonPtr common,
  * @param channel_number
  */
 static int usbParseWacomAbsEvent(WacomCommonPtr common,
-			    struct input_event *event, int channel_number)
+			    const struct input_event *event, int channel_number)
 {
 	WacomChannel *channel = &common->wcmChannel[channel_number];
 	WacomDeviceState *ds = &channel->work;
@@ -1332,8 +1719,9 @@ static int usbParseWacomAbsEvent(WacomCommonPtr common,
  * @param channel_number
  */
 static void usbParseAbsEvent(WacomCommonPtr common,
-			    struct input_event *event, int channel_number)
+			    const struct input_event *event, int channel_number)
 {
+	wcmUSBData *usbdata = common->private;
 	WacomChannel *channel = &common->wcmChannel[channel_number];
 	WacomDeviceState *ds = &channel->work;
 	Bool change;
@@ -1343,8 +1731,8 @@ static void usbParseAbsEvent(WacomCommonPtr common,
 		change |= usbParseWacomAbsEvent(common, event, channel_number);
 	}
 
-	ds->time = wcmTimeInMillis();
-	channel->dirty |= change;
+	ds->time = usbdata->wcmFrameTime;
+	usbMarkDirty(common, channel_number, change);
 }
 
 /**
@@ -1379,7 +1767,7 @@ mod_buttons(WacomCommonPtr common, unsigned int buttons, unsigned int btn, Bool
 	return buttons;
 }
 
-static void usbParseAbsMTEvent(WacomCommonPtr common, struct input_event *event)
+static void usbParseAbsMTEvent(WacomCommonPtr common, const struct input_event *event)
 {
 	int change = 1;
 	wcmUSBData* private = common->private;
@@ -1402,10 +1790,15 @@ static void usbParseAbsMTEvent(WacomCommonPtr common, struct input_event *event)
 
 		case ABS_MT_TRACKING_ID:
 			ds->proximity = (event->value != -1);
+			/* a new contact may reuse the slot's channel without
+			 * another ABS_MT_SLOT, so put it back in the index */
+			if (ds->proximity)
+				usbClaimChannel(common, private->wcmMTChannel,
+						TOUCH_ID, ds->serial_num);
 			/* set this here as type for this channel doesn't get set in usbDispatchEvent() */
 			ds->device_type = TOUCH_ID;
 			ds->device_id = TOUCH_DEVICE_ID;
-			ds->sample = wcmTimeInMillis();
+			ds->sample = private->wcmFrameTime;
 			break;
 
 		case ABS_MT_POSITION_X:
@@ -1425,17 +1818,18 @@ static void usbParseAbsMTEvent(WacomCommonPtr common, struct input_event *event)
 			break;
 	}
 
-	ds->time = wcmTimeInMillis();
-	(&common->wcmChannel[private->wcmMTChannel])->dirty |= change;
+	ds->time = private->wcmFrameTime;
+	usbMarkDirty(common, private->wcmMTChannel, change);
 }
 
 static void usbParseKeyEvent(WacomCommonPtr common,
-			    struct input_event *event, int channel_number)
+			    const struct input_event *event, int channel_number)
 {
 	int change = 1;
+	wcmUSBData *usbdata = common->private;
 	WacomChannel *channel = &common->wcmChannel[channel_number];
 	WacomDeviceState *ds = &channel->work;
-	WacomDeviceState *dslast = &channel->valid.state;
+	const WacomDeviceState *dslast = wcmChannelState(channel, 0);
 
 	/* BTN_TOOL_* are sent to indicate when a specific tool is going
 	 * in our out of proximity.  When going in proximity, here we
@@ -1516,7 +1910,7 @@ static void usbParseKeyEvent(WacomCommonPtr common,
 			/* time stamp for 2FGT gesture events */
 			if ((ds->proximity && !dslast->proximity) ||
 			    (!ds->proximity && dslast->proximity))
-				ds->sample = wcmTimeInMillis();
+				ds->sample = usbdata->wcmFrameTime;
 			break;
 
 		case BTN_TOOL_TRIPLETAP:
@@ -1528,7 +1922,7 @@ static void usbParseKeyEvent(WacomCommonPtr common,
 			/* time stamp for 2GT gesture events */
 			if ((ds->proximity && !dslast->proximity) ||
 			    (!ds->proximity && dslast->proximity))
-				ds->sample = wcmTimeInMillis();
+				ds->sample = usbdata->wcmFrameTime;
 			/* Second finger events will be considered in
 			 * combination with the first finger data */
 			break;
@@ -1538,8 +1932,8 @@ static void usbParseKeyEvent(WacomCommonPtr common,
 			break;
 	}
 
-	ds->time = wcmTimeInMillis();
-	channel->dirty |= change;
+	ds->time = usbdata->wcmFrameTime;
+	usbMarkDirty(common, channel_number, change);
 
 	if (change)
 		return;
@@ -1570,13 +1964,13 @@ static void usbParseKeyEvent(WacomCommonPtr common,
 			break;
 	}
 
-	ds->time = wcmTimeInMillis();
-	channel->dirty |= change;
+	ds->time = usbdata->wcmFrameTime;
+	usbMarkDirty(common, channel_number, change);
 }
 
 /* Handle all button presses except for stylus buttons */
 static void usbParseBTNEvent(WacomCommonPtr common,
-			    struct input_event *event, int channel_number)
+			    const struct input_event *event, int channel_number)
 {
 	int nkeys;
 	int change = 1;
@@ -1620,21 +2014,16 @@ static void usbParseBTNEvent(WacomCommonPtr common,
 			ds->keys = mod_buttons(common, ds->keys, IDX_KEY_INFO, event->value);
 			break;
 		default:
-			for (nkeys = 0; nkeys < usbdata->npadkeys; nkeys++)
-			{
-				if (event->code == usbdata->padkey_code[nkeys])
-				{
-					ds->buttons = mod_buttons(common, ds->buttons, nkeys, event->value);
-					break;
-				}
-			}
-			if (nkeys >= usbdata->npadkeys)
+			nkeys = usbGetEventInfo(usbdata, event)->pad_index;
+			if (nkeys >= 0)
+				ds->buttons = mod_buttons(common, ds->buttons, nkeys, event->value);
+			else
 				change = 0;
 			break;
 	}
 
-	ds->time = wcmTimeInMillis();
-	channel->dirty |= change;
+	ds->time = usbdata->wcmFrameTime;
+	usbMarkDirty(common, channel_number, change);
 }
 
 /**
@@ -1714,6 +2103,7 @@ static int deviceTypeFromEvent(WacomDevicePtr priv, int type, int code, int valu
 static int refreshDeviceType(WacomDevicePtr priv, int fd)
 {
 	WacomCommonPtr common = priv->common;
+	wcmUSBData *usbdata = common->private;
 	int device_type = 0;
 	unsigned long keys[NBITS(KEY_MAX)] = { 0 };
 	int rc = ioctl(fd, EVIOCGKEY(sizeof(keys)), keys);
@@ -1727,7 +2117,7 @@ static int refreshDeviceType(WacomDevicePtr priv, int fd)
 	for (i = 0; i < KEY_MAX; i++)
 	{
 		if (ISBITSET(keys, i))
-			device_type = deviceTypeFromEvent(priv, EV_KEY, i, 0);
+			device_type = usbdata->keyInfo[i].tool_type;
 		if (device_type)
 			return device_type;
 	}
@@ -1783,6 +2173,94 @@ static Bool eventCouldBeFromPad(WacomDevicePtr priv,
 	return FALSE;
 }
 
+static void usbInitEventInfo(WacomDevicePtr priv, usbEventInfo *info,
+			     int type, int code)
+{
+	WacomCommonPtr common = priv->common;
+	wcmUSBData *usbdata = common->private;
+	struct input_event event = { .type = type, .code = code };
+	int device_type = usbdata->wcmDeviceType;
+
+	info->flags = 0;
+
+	/* the filter depends on the tool of the current frame */
+	usbdata->wcmDeviceType = TOUCH_ID;
+	if (usbFilterEvent(common, &event))
+		info->flags |= EVENT_FILTER_TOUCH;
+	usbdata->wcmDeviceType = 0;
+	if (usbFilterEvent(common, &event))
+		info->flags |= EVENT_FILTER_OTHER;
+	usbdata->wcmDeviceType = device_type;
+
+	if (eventCouldBeFromPad(priv, &event))
+		info->flags |= EVENT_PAD;
+
+	if (type == EV_ABS)
+	{
+		switch (code)
+		{
+			case ABS_MT_SLOT:
+			case ABS_MT_TRACKING_ID:
+			case ABS_MT_POSITION_X:
+			case ABS_MT_POSITION_Y:
+			case ABS_MT_PRESSURE:
+				info->flags |= EVENT_MT;
+				break;
+		}
+	}
+
+	if (type == EV_ABS && code == ABS_MISC)
+	{
+		info->tool_type = 0;
+		if (common->wcmProtocolLevel != WCM_PROTOCOL_GENERIC)
+			info->flags |= EVENT_TOOL_BY_ID;
+	}
+	else
+		info->tool_type = deviceTypeFromEvent(priv, type, code, 0);
+
+	info->pad_index = -1;
+	if (type == EV_KEY)
+	{
+		for (int nkeys = 0; nkeys < usbdata->npadkeys; nkeys++)
+		{
+			if (code == usbdata->padkey_code[nkeys])
+			{
+				info->pad_index = nkeys;
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Precompute what the event path needs to know about each event code.
+ * Everything this depends on (protocol level, MT support, tablet
+ * features and pad keys) is fixed once the tablet is initialized.
+ */
+static void usbInitEventTables(WacomDevicePtr priv)
+{
+	wcmUSBData *usbdata = priv->common->private;
+
+	for (int code = 0; code < KEY_CNT; code++)
+		usbInitEventInfo(priv, &usbdata->keyInfo[code], EV_KEY, code);
+	for (int code = 0; code < ABS_CNT; code++)
+		usbInitEventInfo(priv, &usbdata->absInfo[code], EV_ABS, code);
+	for (int code = 0; code < REL_CNT; code++)
+		usbInitEventInfo(priv, &usbdata->relInfo[code], EV_REL, code);
+}
+
+static int usbToolTypeFromEvent(WacomDevicePtr priv,
+				const struct input_event *event)
+{
+	WacomCommonPtr common = priv->common;
+	const usbEventInfo *info = usbGetEventInfo(common->private, event);
+
+	if (info->flags & EVENT_TOOL_BY_ID)
+		return usbFindDeviceTypeById(common, event->value);
+
+	return info->tool_type;
+}
+
 /***
  * Retrieve the tool type from an USB data packet by looking at the event
  * codes. Refer to linux/input.h for event codes that define tool types.
@@ -1806,7 +2284,7 @@ static int usbInitToolType(WacomDevicePtr priv, int fd,
 
 	for (i = 0; (i < nevents) && !device_type; ++i)
 	{
-		device_type = deviceTypeFromEvent(priv, event_ptr[i].type, event_ptr[i].code, event_ptr[i].value);
+		device_type = usbToolTypeFromEvent(priv, &event_ptr[i]);
 	}
 
 	if (!device_type)
@@ -1817,7 +2295,7 @@ static int usbInitToolType(WacomDevicePtr priv, int fd,
 
 	if (!device_type) /* expresskey pressed at startup or missing type */
 		for (i = 0; (i < nevents) && !device_type; ++i)
-			if (eventCouldBeFromPad(priv, &event_ptr[i]))
+			if (usbGetEventInfo(priv->common->private, &event_ptr[i])->flags & EVENT_PAD)
 				device_type = PAD_ID;
 
 	return device_type;
@@ -1843,14 +2321,17 @@ static void usbDispatchEvents(WacomDevicePtr priv)
 {
 	int c;
 	WacomDeviceState *ds;
-	struct input_event* event;
+	const struct input_event* event;
 	WacomCommonPtr common = priv->common;
 	int channel;
 	wcmUSBData* private = common->private;
-	WacomDeviceState dslast = common->wcmChannel[private->lastChannel].valid.state;
+	WacomDeviceState dslast = *wcmChannelState(&common->wcmChannel[private->lastChannel], 0);
+	uint8_t filter;
 
 	DBG(6, common, "%u events received\n", private->wcmEventCnt);
 
+	private->wcmFrameTime = usbFrameTime(private);
+
 	private->wcmDeviceType = usbInitToolType(priv, wcmGetFd(priv),
 	                                         private->wcmEvents,
 	                                         private->wcmEventCnt,
@@ -1882,8 +2363,10 @@ static void usbDispatchEvents(WacomDevicePtr priv)
 		return;
 	}
 
+	WCM_PROBE2(frame, private->wcmEventCnt, channel);
+
 	ds = &common->wcmChannel[channel].work;
-	dslast = common->wcmChannel[channel].valid.state;
+	dslast = *wcmChannelState(&common->wcmChannel[channel], 0);
 
 	if (ds->device_type && ds->device_type != private->wcmDeviceType)
 		wcmLogSafe(priv, W_ERROR,
@@ -1900,16 +2383,22 @@ static void usbDispatchEvents(WacomDevicePtr priv)
 	ds->relwheel2 = 0;
 	ds->serial_num = private->wcmLastToolSerial;
 
+	filter = (private->wcmDeviceType == TOUCH_ID) ?
+		 EVENT_FILTER_TOUCH : EVENT_FILTER_OTHER;
+
 	/* loop through all events in group */
 	for (unsigned int i = 0; i < private->wcmEventCnt; ++i)
 	{
+		const usbEventInfo *info;
+
 		event = private->wcmEvents + i;
 		DBG(11, common,
 			"event[%u]->type=%d code=%d value=%d\n",
 			i, event->type, event->code, event->value);
 
 		/* Check for events to be ignored and skip them up front. */
-		if (usbFilterEvent(common, event))
+		info = usbGetEventInfo(private, event);
+		if (info->flags & filter)
 			continue;
 
 		if (common->wcmHasHWTouchSwitch)
@@ -1932,23 +2421,24 @@ static void usbDispatchEvents(WacomDevicePtr priv)
 		if (event->type == EV_ABS)
 		{
 			usbParseAbsEvent(common, event, channel);
-			usbParseAbsMTEvent(common, event);
+			if (info->flags & EVENT_MT)
+				usbParseAbsMTEvent(common, event);
 		}
 		else if (event->type == EV_REL)
 		{
 			switch (event->code) {
 			case REL_WHEEL:
 				ds->relwheel = event->value;
-				ds->time = wcmTimeInMillis();
-				common->wcmChannel[channel].dirty |= TRUE;
+				ds->time = private->wcmFrameTime;
+				usbMarkDirty(common, channel, TRUE);
 				break;
 			case REL_WHEEL_HI_RES:
 				/* unsupported */
 				break;
 			case REL_HWHEEL:
 				ds->relwheel2 = event->value;
-				ds->time = wcmTimeInMillis();
-				common->wcmChannel[channel].dirty |= TRUE;
+				ds->time = private->wcmFrameTime;
+				usbMarkDirty(common, channel, TRUE);
 				break;
 			case REL_HWHEEL_HI_RES:
 				/* unsupported */
@@ -2009,18 +2499,328 @@ static void usbDispatchEvents(WacomDevicePtr priv)
 
 	private->lastChannel = channel;
 
-	for (c = 0; c < MAX_CHANNELS; c++) {
+	/* walk through the channels that changed in this frame */
+	while ((c = ffsll(common->wcmDirtyChannels))) {
+		c--;
+		common->wcmDirtyChannels &= ~(1ULL << c);
 		ds = &common->wcmChannel[c].work;
 
-		/* walk through all channels */
-		if (common->wcmChannel[c].dirty) {
-			DBG(10, common, "Dirty flag set on channel %d; sending event.\n", c);
-			common->wcmChannel[c].dirty = FALSE;
-			/* don't send touch event when touch isn't enabled */
-			if (ds->device_type != TOUCH_ID || common->wcmTouch)
-				wcmEvent(common, c, ds);
+		DBG(10, common, "Dirty flag set on channel %d; sending event.\n", c);
+		/* don't send touch event when touch isn't enabled */
+		if (ds->device_type != TOUCH_ID || common->wcmTouch)
+			wcmEvent(common, c, ds);
+		usbUpdateChannelBusy(common, c);
+	}
+	usbUpdateChannelBusy(common, channel);
+}
+
+/* Tool axes restored on resync, pad axes are left alone */
+static const int resync_tool_axes[] = {
+	ABS_X, ABS_Y, ABS_Z, ABS_PRESSURE, ABS_DISTANCE,
+	ABS_TILT_X, ABS_TILT_Y, ABS_WHEEL, ABS_THROTTLE, ABS_MISC,
+};
+
+static const int resync_tool_codes[] = {
+	BTN_TOOL_PEN, BTN_TOOL_RUBBER, BTN_TOOL_BRUSH, BTN_TOOL_PENCIL,
+	BTN_TOOL_AIRBRUSH, BTN_TOOL_MOUSE, BTN_TOOL_LENS,
+};
+
+/* The buttons and the ds->buttons bit usbParseKeyEvent and usbParseBTNEvent
+ * set for them */
+static const struct {
+	int code;
+	int button;
+} resync_stylus_buttons[] = {
+	{ BTN_STYLUS, 1 }, { BTN_STYLUS2, 2 }, { BTN_STYLUS3, 3 },
+}, resync_mouse_buttons[] = {
+	{ BTN_LEFT, 0 }, { BTN_MIDDLE, 1 }, { BTN_RIGHT, 2 }, { BTN_SIDE, 3 },
+	{ BTN_EXTRA, 4 },
+};
+
+/* Events that don't fit are counted but not stored, see usbResyncDispatch */
+static void usbResyncAppend(struct input_event *events, unsigned int size,
+			    unsigned int *nevents, int type, int code, int value)
+{
+	/* the last slot is reserved for the SYN_REPORT */
+	if (*nevents < size - 1)
+	{
+		events[*nevents].type = type;
+		events[*nevents].code = code;
+		events[*nevents].value = value;
+	}
+	(*nevents)++;
+}
+
+/**
+ * Run a synthesized frame through usbDispatchEvents as if it had come from
+ * the kernel.
+ */
+static void usbResyncDispatch(WacomDevicePtr priv, const struct input_event *syn,
+			      struct input_event *events, unsigned int size,
+			      unsigned int nevents, unsigned int serial)
+{
+	WacomCommonPtr common = priv->common;
+	wcmUSBData* private = common->private;
+
+	if (nevents > size - 1)
+	{
+		wcmLogSafe(priv, W_ERROR, "%s: resync: dropped %u of %u events\n",
+			   priv->name, nevents - (size - 1), nevents);
+		nevents = size - 1;
+	}
+
+	events[nevents] = *syn;
+	events[nevents].type = EV_SYN;
+	events[nevents].code = SYN_REPORT;
+	events[nevents].value = 0;
+	nevents++;
+
+	private->wcmEvents = events;
+	private->wcmEventCnt = nevents;
+	private->wcmLastToolSerial = serial;
+	usbDispatchEvents(priv);
+	usbResetEventCounter(private);
+}
+
+static int usbResyncToolCode(int device_type)
+{
+	switch (device_type)
+	{
+		case STYLUS_ID: return BTN_TOOL_PEN;
+		case ERASER_ID: return BTN_TOOL_RUBBER;
+		case CURSOR_ID: return BTN_TOOL_MOUSE;
+	}
+	return 0;
+}
+
+/**
+ * Rebuild the tablet tool state: tools we think are in proximity but the
+ * kernel doesn't are sent out of proximity, the tool the kernel reports
+ * gets its current buttons and axes.
+ */
+static void usbResyncTool(WacomDevicePtr priv, const struct input_event *syn,
+			  const unsigned long *keys, const unsigned long *abs)
+{
+	WacomCommonPtr common = priv->common;
+	wcmUSBData* private = common->private;
+	struct input_event events[MAX_USB_EVENTS];
+	unsigned int nevents = 0;
+	unsigned int serial = private->wcmLastToolSerial;
+	int tool_code = 0, device_type;
+
+	for (size_t i = 0; i < ARRAY_SIZE(resync_tool_codes) && !tool_code; i++)
+		if (ISBITSET(keys, resync_tool_codes[i]))
+			tool_code = resync_tool_codes[i];
+
+	device_type = tool_code ? deviceTypeFromEvent(priv, EV_KEY, tool_code, 1) : 0;
+
+	for (int c = 0; c < common->wcmChannelCount; c++)
+	{
+		WacomDeviceState *ds = &common->wcmChannel[c].work;
+		int code = usbResyncToolCode(ds->device_type);
+
+		if (c == PAD_CHANNEL || !ds->proximity || !code)
+			continue;
+
+		if (ds->device_type == device_type)
+		{
+			serial = ds->serial_num;
+			continue;
+		}
+
+		DBG(3, common, "resync: %u out of proximity\n", ds->serial_num);
+		nevents = 0;
+		usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_KEY, code, 0);
+		/* release only what the driver holds down */
+		if (ds->device_type == CURSOR_ID)
+		{
+			for (size_t i = 0; i < ARRAY_SIZE(resync_mouse_buttons); i++)
+				if (ds->buttons & (1u << resync_mouse_buttons[i].button))
+					usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_KEY,
+							resync_mouse_buttons[i].code, 0);
+		}
+		else
+		{
+			for (size_t i = 0; i < ARRAY_SIZE(resync_stylus_buttons); i++)
+				if (ds->buttons & (1u << resync_stylus_buttons[i].button))
+					usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_KEY,
+							resync_stylus_buttons[i].code, 0);
+		}
+		usbResyncDispatch(priv, syn, events, ARRAY_SIZE(events), nevents,
+				  ds->serial_num);
+	}
+
+	if (!tool_code)
+		return;
+
+	nevents = 0;
+	usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_KEY, tool_code, 1);
+	for (size_t i = 0; i < ARRAY_SIZE(resync_stylus_buttons); i++)
+	{
+		int code = resync_stylus_buttons[i].code;
+		if (ISBITSET(common->wcmKeys, code))
+			usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_KEY, code,
+					!!ISBITSET(keys, code));
+	}
+	if (device_type == CURSOR_ID)
+	{
+		for (size_t i = 0; i < ARRAY_SIZE(resync_mouse_buttons); i++)
+		{
+			int code = resync_mouse_buttons[i].code;
+			if (ISBITSET(common->wcmKeys, code))
+				usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_KEY, code,
+						!!ISBITSET(keys, code));
+		}
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(resync_tool_axes); i++)
+	{
+		struct input_absinfo absinfo;
+		int code = resync_tool_axes[i];
+
+		if (!ISBITSET(abs, code) ||
+		    ioctl(wcmGetFd(priv), EVIOCGABS(code), &absinfo) < 0)
+			continue;
+		usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_ABS, code,
+				absinfo.value);
+	}
+
+	DBG(3, common, "resync: tool %d in proximity\n", tool_code);
+	usbResyncDispatch(priv, syn, events, ARRAY_SIZE(events), nevents, serial);
+}
+
+/**
+ * Rebuild the pad button state.
+ */
+static void usbResyncPad(WacomDevicePtr priv, const struct input_event *syn,
+			 const unsigned long *keys)
+{
+	WacomCommonPtr common = priv->common;
+	wcmUSBData* private = common->private;
+	WacomDeviceState *ds = &common->wcmChannel[PAD_CHANNEL].work;
+	struct input_event events[MAX_USB_EVENTS];
+	unsigned int nevents = 0;
+	Bool down = FALSE;
+
+	for (int i = 0; i < private->npadkeys; i++)
+	{
+		int code = private->padkey_code[i];
+
+		if (!code || !ISBITSET(common->wcmKeys, code))
+			continue;
+		usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_KEY, code,
+				!!ISBITSET(keys, code));
+		down |= !!ISBITSET(keys, code);
+	}
+
+	/* nothing held down, nothing stuck */
+	if (!down && !ds->buttons && !ds->proximity)
+		return;
+
+	if (common->wcmProtocolLevel != WCM_PROTOCOL_GENERIC && !private->wcmUseMT)
+		usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_KEY,
+				BTN_TOOL_FINGER, down);
+
+	DBG(3, common, "resync: pad buttons %s\n", down ? "down" : "up");
+	/* no tool key in generic pad frames, make the pad the last tool */
+	private->lastChannel = PAD_CHANNEL;
+	usbResyncDispatch(priv, syn, events, ARRAY_SIZE(events), nevents,
+			  DEFAULT_TOOL_SERIAL);
+}
+
+/**
+ * Rebuild the multitouch state, one frame with all slots that are active
+ * either in the kernel or in the driver.
+ */
+static void usbResyncMT(WacomDevicePtr priv, const struct input_event *syn,
+			const unsigned long *abs)
+{
+	WacomCommonPtr common = priv->common;
+	wcmUSBData* private = common->private;
+	const int codes[] = {
+		ABS_MT_TRACKING_ID, ABS_MT_POSITION_X, ABS_MT_POSITION_Y, ABS_MT_PRESSURE,
+	};
+	/* ABS_MT_SLOT and the codes for each slot, then the SYN_REPORT */
+	struct input_event events[MAX_FINGERS * (ARRAY_SIZE(codes) + 1) + 1];
+	unsigned int nevents = 0, serial = private->wcmLastToolSerial;
+	/* layout expected by EVIOCGMTSLOTS: the code, followed by the values */
+	int32_t slots[ARRAY_SIZE(codes)][MAX_FINGERS + 1];
+	int nslots = min(common->wcmMaxContacts, MAX_FINGERS);
+
+	for (size_t i = 0; i < ARRAY_SIZE(codes); i++)
+	{
+		slots[i][0] = codes[i];
+		if (!ISBITSET(abs, codes[i]) ||
+		    ioctl(wcmGetFd(priv), EVIOCGMTSLOTS(sizeof(slots[i])), slots[i]) < 0)
+		{
+			/* no tracking id, no touches */
+			if (i == 0)
+				return;
+			slots[i][0] = -1;
+		}
+	}
+
+	for (int slot = 0; slot < nslots; slot++)
+	{
+		int tracking_id = slots[0][slot + 1];
+		Bool active = FALSE;
+
+		for (int c = 0; c < common->wcmChannelCount; c++)
+		{
+			WacomDeviceState *ds = &common->wcmChannel[c].work;
+
+			if (ds->device_type == TOUCH_ID && ds->proximity &&
+			    ds->serial_num == (unsigned int)slot + 1)
+				active = TRUE;
 		}
+
+		if (tracking_id == -1 && !active)
+			continue;
+
+		usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_ABS,
+				ABS_MT_SLOT, slot);
+		usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_ABS,
+				ABS_MT_TRACKING_ID, tracking_id);
+		if (tracking_id == -1)
+			continue;
+		for (size_t i = 1; i < ARRAY_SIZE(codes); i++)
+			if (slots[i][0] != -1)
+				usbResyncAppend(events, ARRAY_SIZE(events), &nevents, EV_ABS,
+						codes[i], slots[i][slot + 1]);
 	}
+
+	if (nevents == 0)
+		return;
+
+	DBG(3, common, "resync: %u touch events\n", nevents);
+	usbResyncDispatch(priv, syn, events, ARRAY_SIZE(events), nevents, 0);
+	/* touch frames carry no serial, keep the one of the last tool */
+	private->wcmLastToolSerial = serial;
+}
+
+/**
+ * Called on the SYN_REPORT after a SYN_DROPPED. Query the current key, axis
+ * and slot state from the kernel and feed the difference to our own state
+ * through usbDispatchEvents as synthetic frames.
+ */
+static void usbResyncState(WacomDevicePtr priv, const struct input_event *syn)
+{
+	WacomCommonPtr common = priv->common;
+	wcmUSBData* private = common->private;
+	unsigned long keys[NBITS(KEY_MAX)] = { 0 };
+	unsigned long abs[NBITS(ABS_MAX)] = { 0 };
+	int fd = wcmGetFd(priv);
+
+	if (ioctl(fd, EVIOCGKEY(sizeof(keys)), keys) < 0 ||
+	    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs)), abs) < 0)
+	{
+		wcmLogSafe(priv, W_ERROR, "%s: unable to resync device state\n", priv->name);
+		return;
+	}
+
+	usbResyncTool(priv, syn, keys, abs);
+	usbResyncPad(priv, syn, keys);
+	if (private->wcmUseMT && ISBITSET(abs, ABS_MT_SLOT))
+		usbResyncMT(priv, syn, abs);
 }
 
 /* Quirks to unify the tool and tablet types for GENERIC protocol tablet PCs
@@ -2128,6 +2928,578 @@ TEST_CASE(test_mod_buttons)
 	assert(mod_buttons(&common, 0, sizeof(int) * 8, 1) == 0);
 }
 
+TEST_CASE(test_parse_frames)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	wcmUSBData usbdata = {0};
+	/* frames without axis data are dropped before dispatch */
+	struct input_event events[] = {
+		{ .type = EV_MSC, .code = MSC_SERIAL, .value = 0x123 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+		{ .type = EV_MSC, .code = MSC_SERIAL, .value = 0x123 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+		{ .type = EV_MSC, .code = MSC_SERIAL, .value = 0x123 },
+	};
+	unsigned int nframes;
+	int consumed;
+
+	priv.common = &common;
+	priv.name = "Wacom test device";
+	common.private = &usbdata;
+
+	consumed = usbParseFrames(&priv, events, ARRAY_SIZE(events), &nframes);
+	assert(consumed == 4);
+	assert(nframes == 2);
+	assert(usbdata.wcmEventCnt == 0);
+	assert(usbdata.wcmLastToolSerial == 0x123);
+
+	/* a partial frame is left to the caller */
+	consumed = usbParseFrames(&priv, &events[4], 1, &nframes);
+	assert(consumed == 0);
+	assert(nframes == 0);
+	assert(usbdata.wcmEventCnt == 0);
+}
+
+TEST_CASE(test_read_overflow)
+{
+	InputInfoRec info = {0};
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	wcmUSBData usbdata = {0};
+	struct input_event events[EVENT_BUFFER_SIZE];
+	struct input_event rest[] = {
+		{ .type = EV_KEY, .code = BTN_TOOL_PEN, .value = 1 },
+		{ .type = EV_ABS, .code = ABS_Y, .value = 500 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+	};
+	struct input_event next[] = {
+		{ .type = EV_KEY, .code = BTN_TOOL_PEN, .value = 1 },
+		{ .type = EV_ABS, .code = ABS_X, .value = 42 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+	};
+	WacomDeviceState *ds;
+	int fds[2];
+
+	/* a frame that never ends fills the whole buffer */
+	for (size_t i = 0; i < ARRAY_SIZE(events); i++)
+		events[i] = (struct input_event){ .type = EV_ABS, .code = ABS_X, .value = i };
+
+	assert(pipe(fds) == 0);
+	assert(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+	info.fd = fds[0];
+	priv.frontend = &info;
+	priv.common = &common;
+	priv.name = "Wacom test device";
+	common.private = &usbdata;
+	common.wcmModel = &usbUnknown;
+	common.wcmProtocolLevel = WCM_PROTOCOL_4;
+	assert(usbInitChannels(&priv));
+	usbInitEventTables(&priv);
+	SETBIT(common.wcmKeys, BTN_TOOL_PEN);
+	ds = &common.wcmChannel[usbChooseChannel(&common, STYLUS_ID, 1)].work;
+
+	assert(write(fds[1], events, sizeof(events)) == sizeof(events));
+	assert(wcmReadPacket(&priv) == sizeof(events));
+	assert(common.evcount == EVENT_BUFFER_SIZE);
+	assert(common.wcmQueueOverflows == 0);
+
+	/* the next read drops all of it and the rest of the frame, the
+	 * kernel has no idea and sends no SYN_DROPPED. The resync fails
+	 * without a kernel device, the tool stays out of proximity */
+	assert(write(fds[1], rest, sizeof(rest)) == sizeof(rest));
+	assert(wcmReadPacket(&priv) == sizeof(rest));
+	assert(common.wcmQueueOverflows == EVENT_BUFFER_SIZE);
+	assert(!usbdata.wcmResync);
+	assert(common.evcount == 0);
+	assert(!ds->proximity);
+
+	/* the frame after it is processed as usual */
+	assert(write(fds[1], next, sizeof(next)) == sizeof(next));
+	assert(wcmReadPacket(&priv) == sizeof(next));
+	assert(ds->proximity);
+	assert(ds->x == 42);
+	assert(ds->y == 0);
+
+	close(fds[0]);
+	close(fds[1]);
+	free(common.evbuf);
+	free(common.wcmChannel);
+}
+
+TEST_CASE(test_frame_time)
+{
+	wcmUSBData usbdata = {0};
+	struct input_event events[] = {
+		{ .type = EV_ABS, .code = ABS_X, .value = 1 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+	};
+
+	events[1].input_event_sec = 4295;
+	events[1].input_event_usec = 123999;
+
+	usbdata.kernelTimestamps = TRUE;
+	usbdata.wcmEvents = events;
+	usbdata.wcmEventCnt = ARRAY_SIZE(events);
+
+	/* the frame's SYN_REPORT timestamp, in wrapping milliseconds */
+	assert(usbFrameTimeUs(&usbdata) == 4295123999ULL);
+	assert(usbFrameTime(&usbdata) == 4295123);
+
+	events[1].input_event_sec = 4294968; /* > UINT32_MAX ms */
+	events[1].input_event_usec = 0;
+	assert(usbFrameTime(&usbdata) == (uint32_t)(4294968000ULL & 0xffffffff));
+
+	/* without kernel timestamps there is no frame time */
+	usbdata.kernelTimestamps = FALSE;
+	assert(usbFrameTimeUs(&usbdata) == 0);
+}
+
+TEST_CASE(test_syn_dropped)
+{
+	InputInfoRec info = {0};
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	wcmUSBData usbdata = {0};
+	struct input_event events[] = {
+		{ .type = EV_MSC, .code = MSC_SERIAL, .value = 0x123 },
+		{ .type = EV_SYN, .code = SYN_DROPPED, .value = 0 },
+		{ .type = EV_MSC, .code = MSC_SERIAL, .value = 0x456 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+		{ .type = EV_MSC, .code = MSC_SERIAL, .value = 0x789 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+	};
+	unsigned int nframes;
+	int consumed;
+
+	info.fd = -1; /* resync fails, nothing to resync against */
+	priv.frontend = &info;
+	priv.common = &common;
+	priv.name = "Wacom test device";
+	common.private = &usbdata;
+
+	/* everything up to the next SYN_REPORT is dropped */
+	consumed = usbParseFrames(&priv, events, 4, &nframes);
+	assert(consumed == 4);
+	assert(common.wcmSynDropped == 1);
+	assert(!usbdata.wcmResync);
+	assert(usbdata.wcmLastToolSerial == 0x123);
+	assert(usbdata.wcmEventCnt == 0);
+
+	/* and we're back to normal */
+	consumed = usbParseFrames(&priv, &events[4], 2, &nframes);
+	assert(consumed == 2);
+	assert(usbdata.wcmLastToolSerial == 0x789);
+
+	/* dropped events still count as read */
+	assert(common.wcmEventsRead == 6);
+	assert(common.wcmFramesRead == 2);
+}
+
+/* The kernel's state as returned by the resync ioctls */
+#ifdef HAVE_TEST_IOCTL
+static struct {
+	unsigned long keys[NBITS(KEY_MAX)];
+	unsigned long abs[NBITS(ABS_MAX)];
+	int value[ABS_CNT];
+	int32_t slots[ABS_CNT][MAX_FINGERS];
+} resync_kernel;
+
+static int resyncIoctl(int fd, unsigned long request, void *arg)
+{
+	if (request == EVIOCGKEY(sizeof(resync_kernel.keys)))
+	{
+		memcpy(arg, resync_kernel.keys, sizeof(resync_kernel.keys));
+		return 0;
+	}
+	if (request == EVIOCGBIT(EV_ABS, sizeof(resync_kernel.abs)))
+	{
+		memcpy(arg, resync_kernel.abs, sizeof(resync_kernel.abs));
+		return 0;
+	}
+	if (request == EVIOCGMTSLOTS(sizeof(int32_t) * (MAX_FINGERS + 1)))
+	{
+		int32_t *values = arg;
+
+		memcpy(&values[1], resync_kernel.slots[values[0]], sizeof(resync_kernel.slots[0]));
+		return 0;
+	}
+	for (int code = 0; code < ABS_CNT; code++)
+	{
+		if (request == EVIOCGABS(code) && ISBITSET(resync_kernel.abs, code))
+		{
+			struct input_absinfo *absinfo = arg;
+
+			memset(absinfo, 0, sizeof(*absinfo));
+			absinfo->value = resync_kernel.value[code];
+			return 0;
+		}
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+TEST_CASE(test_syn_dropped_resync)
+{
+	InputInfoRec info = {0};
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	wcmUSBData usbdata = {0};
+	struct input_event dropped[] = {
+		{ .type = EV_SYN, .code = SYN_DROPPED, .value = 0 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+	};
+	struct input_event events[] = {
+		{ .type = EV_SYN, .code = SYN_DROPPED, .value = 0 },
+		{ .type = EV_KEY, .code = BTN_TOOL_PEN, .value = 0 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+	};
+	WacomDeviceState *ds;
+	unsigned int nframes;
+
+	info.fd = -1;
+	priv.frontend = &info;
+	priv.common = &common;
+	priv.name = "Wacom test device";
+	common.private = &usbdata;
+	common.wcmProtocolLevel = WCM_PROTOCOL_4;
+	usbdata.kernelTimestamps = TRUE;
+	assert(usbInitChannels(&priv));
+	usbInitEventTables(&priv);
+	SETBIT(common.wcmKeys, BTN_TOOL_PEN);
+	SETBIT(common.wcmKeys, BTN_STYLUS);
+	SETBIT(common.wcmKeys, BTN_STYLUS2);
+
+	wcm_test_ioctl = resyncIoctl;
+	memset(&resync_kernel, 0, sizeof(resync_kernel));
+
+	/* The pen came into proximity with a button held while we were
+	 * dropping events, it is resynced from the kernel's state */
+	SETBIT(resync_kernel.keys, BTN_TOOL_PEN);
+	SETBIT(resync_kernel.keys, BTN_STYLUS);
+	SETBIT(resync_kernel.abs, ABS_X);
+	SETBIT(resync_kernel.abs, ABS_Y);
+	SETBIT(resync_kernel.abs, ABS_PRESSURE);
+	resync_kernel.value[ABS_X] = 1000;
+	resync_kernel.value[ABS_Y] = 2000;
+	resync_kernel.value[ABS_PRESSURE] = 300;
+
+	assert(usbParseFrames(&priv, dropped, ARRAY_SIZE(dropped), &nframes) == ARRAY_SIZE(dropped));
+	assert(!usbdata.wcmResync);
+
+	/* protocol 4 has no serials, the pen gets 1 */
+	ds = &common.wcmChannel[usbChooseChannel(&common, STYLUS_ID, 1)].work;
+	assert(ds->device_type == STYLUS_ID);
+	assert(ds->proximity);
+	assert(ds->buttons == (1u << 1));
+	assert(ds->x == 1000);
+	assert(ds->y == 2000);
+	assert(ds->pressure == 300);
+
+	/* And went out of proximity in the next drop, the driver's pen and
+	 * its button are released */
+	memset(&resync_kernel, 0, sizeof(resync_kernel));
+	assert(usbParseFrames(&priv, events, ARRAY_SIZE(events), &nframes) == ARRAY_SIZE(events));
+	assert(common.wcmSynDropped == 2);
+	assert(!ds->proximity);
+	assert(ds->buttons == 0);
+
+	wcm_test_ioctl = NULL;
+	free(common.wcmChannel);
+}
+
+TEST_CASE(test_syn_dropped_resync_mt)
+{
+	InputInfoRec info = {0};
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	wcmUSBData usbdata = {0};
+	struct input_event dropped[] = {
+		{ .type = EV_SYN, .code = SYN_DROPPED, .value = 0 },
+		{ .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+	};
+	const int ncontacts = 40;
+	unsigned int nframes;
+	int ntouches = 0;
+
+	info.fd = -1;
+	priv.frontend = &info;
+	priv.common = &common;
+	priv.name = "Wacom test device";
+	common.private = &usbdata;
+	common.wcmProtocolLevel = WCM_PROTOCOL_GENERIC;
+	common.wcmMaxContacts = ncontacts;
+	usbdata.wcmUseMT = TRUE;
+	usbdata.kernelTimestamps = TRUE;
+	assert(usbInitChannels(&priv));
+	usbInitEventTables(&priv);
+	SETBIT(common.wcmKeys, BTN_TOOL_FINGER);
+
+	wcm_test_ioctl = resyncIoctl;
+	memset(&resync_kernel, 0, sizeof(resync_kernel));
+
+	/* All contacts came down while we were dropping events, more than
+	 * fit into a kernel frame of MAX_USB_EVENTS */
+	SETBIT(resync_kernel.abs, ABS_MT_SLOT);
+	SETBIT(resync_kernel.abs, ABS_MT_TRACKING_ID);
+	SETBIT(resync_kernel.abs, ABS_MT_POSITION_X);
+	SETBIT(resync_kernel.abs, ABS_MT_POSITION_Y);
+	SETBIT(resync_kernel.abs, ABS_MT_PRESSURE);
+	for (int slot = 0; slot < MAX_FINGERS; slot++)
+		resync_kernel.slots[ABS_MT_TRACKING_ID][slot] = -1;
+	for (int slot = 0; slot < ncontacts; slot++)
+	{
+		resync_kernel.slots[ABS_MT_TRACKING_ID][slot] = 100 + slot;
+		resync_kernel.slots[ABS_MT_POSITION_X][slot] = 10 * slot;
+		resync_kernel.slots[ABS_MT_POSITION_Y][slot] = 20 * slot;
+	}
+
+	/* the last tool's serial survives the touch frame */
+	usbdata.wcmLastToolSerial = 0x123;
+
+	assert(usbParseFrames(&priv, dropped, ARRAY_SIZE(dropped), &nframes) == ARRAY_SIZE(dropped));
+	assert(usbdata.wcmLastToolSerial == 0x123);
+
+	for (int c = 0; c < common.wcmChannelCount; c++)
+	{
+		WacomDeviceState *ds = &common.wcmChannel[c].work;
+		int slot = ds->serial_num - 1;
+
+		if (ds->device_type != TOUCH_ID || !ds->proximity)
+			continue;
+		assert(slot >= 0 && slot < ncontacts);
+		assert(ds->x == 10 * slot);
+		assert(ds->y == 20 * slot);
+		ntouches++;
+	}
+	assert(ntouches == ncontacts);
+
+	/* and all of them are released again */
+	for (int slot = 0; slot < ncontacts; slot++)
+		resync_kernel.slots[ABS_MT_TRACKING_ID][slot] = -1;
+	assert(usbParseFrames(&priv, dropped, ARRAY_SIZE(dropped), &nframes) == ARRAY_SIZE(dropped));
+	for (int c = 0; c < common.wcmChannelCount; c++)
+		assert(common.wcmChannel[c].work.device_type != TOUCH_ID ||
+		       !common.wcmChannel[c].work.proximity);
+
+	wcm_test_ioctl = NULL;
+	free(common.wcmChannel);
+}
+#endif
+
+TEST_CASE(test_event_tables)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	wcmUSBData *usbdata = calloc(1, sizeof(*usbdata));
+	const int protocols[] = { WCM_PROTOCOL_GENERIC, WCM_PROTOCOL_4, WCM_PROTOCOL_5 };
+	const int types[] = { EV_KEY, EV_ABS, EV_REL };
+	const int counts[] = { KEY_CNT, ABS_CNT, REL_CNT };
+
+	priv.common = &common;
+	priv.name = "Wacom test device";
+	common.private = usbdata;
+	usbdata->padkey_code[usbdata->npadkeys++] = BTN_0;
+	usbdata->padkey_code[usbdata->npadkeys++] = BTN_1;
+	usbdata->padkey_code[usbdata->npadkeys++] = BTN_BASE;
+
+	/* the tables say what the switches say */
+	for (size_t p = 0; p < ARRAY_SIZE(protocols); p++)
+	{
+		for (int mt = 0; mt <= 1; mt++)
+		{
+			common.wcmProtocolLevel = protocols[p];
+			usbdata->wcmUseMT = mt;
+			usbInitEventTables(&priv);
+
+			for (size_t t = 0; t < ARRAY_SIZE(types); t++)
+			{
+				for (int code = 0; code < counts[t]; code++)
+				{
+					struct input_event event = { .type = types[t], .code = code };
+					const usbEventInfo *info = usbGetEventInfo(usbdata, &event);
+
+					usbdata->wcmDeviceType = TOUCH_ID;
+					assert(!!(info->flags & EVENT_FILTER_TOUCH) == !!usbFilterEvent(&common, &event));
+					usbdata->wcmDeviceType = STYLUS_ID;
+					assert(!!(info->flags & EVENT_FILTER_OTHER) == !!usbFilterEvent(&common, &event));
+					assert(!!(info->flags & EVENT_PAD) == !!eventCouldBeFromPad(&priv, &event));
+					if (!(info->flags & EVENT_TOOL_BY_ID))
+						assert(usbToolTypeFromEvent(&priv, &event) ==
+						       deviceTypeFromEvent(&priv, event.type, code, 0));
+				}
+			}
+
+			assert(usbdata->keyInfo[BTN_0].pad_index == 0);
+			assert(usbdata->keyInfo[BTN_BASE].pad_index == 2);
+			assert(usbdata->keyInfo[BTN_STYLUS].pad_index == -1);
+			assert(!!(usbdata->absInfo[ABS_MISC].flags & EVENT_TOOL_BY_ID) ==
+			       (protocols[p] != WCM_PROTOCOL_GENERIC));
+			assert(usbdata->absInfo[ABS_MT_TRACKING_ID].flags & EVENT_MT);
+			assert(!(usbdata->absInfo[ABS_X].flags & EVENT_MT));
+		}
+	}
+
+	free(usbdata);
+}
+
+TEST_CASE(test_channel_count)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	wcmUSBData usbdata = {0};
+	const struct {
+		int protocol;
+		Bool mt;
+		int contacts;
+		int channels;
+		int tracked;
+	} tablets[] = {
+		/* pen only: the pen and the pad */
+		{ WCM_PROTOCOL_4, FALSE, 0, 2, 0 },
+		/* dual-track */
+		{ WCM_PROTOCOL_5, FALSE, 0, 3, 0 },
+		/* a big touch panel gets all its contacts */
+		{ WCM_PROTOCOL_GENERIC, TRUE, 40, 42, 40 },
+		/* too many contacts, the tool channels come first */
+		{ WCM_PROTOCOL_GENERIC, TRUE, 100, MAX_CHANNELS, MAX_FINGERS },
+		{ WCM_PROTOCOL_5, TRUE, 100, MAX_CHANNELS, MAX_CHANNELS - 3 },
+	};
+	WacomChannelPtr channels;
+
+	priv.common = &common;
+	priv.name = "Wacom test device";
+	common.private = &usbdata;
+
+	for (size_t i = 0; i < ARRAY_SIZE(tablets); i++)
+	{
+		int ncontacts;
+
+		common.wcmProtocolLevel = tablets[i].protocol;
+		usbdata.wcmUseMT = tablets[i].mt;
+		common.wcmMaxContacts = tablets[i].contacts;
+		assert(usbChannelCount(&common, &ncontacts) == tablets[i].channels);
+		assert(ncontacts == tablets[i].tracked);
+
+		assert(usbInitChannels(&priv));
+		assert(common.wcmChannelCount == tablets[i].channels);
+		assert(((uintptr_t)common.wcmChannel % CHANNEL_ALIGNMENT) == 0);
+		free(common.wcmChannel);
+		common.wcmChannel = NULL;
+	}
+
+	/* the other tools share the first one's channels, even if they
+	 * count differently */
+	common.wcmProtocolLevel = WCM_PROTOCOL_4;
+	usbdata.wcmUseMT = FALSE;
+	assert(usbInitChannels(&priv));
+	channels = common.wcmChannel;
+	assert(usbInitChannels(&priv));
+	assert(common.wcmChannel == channels);
+
+	common.wcmProtocolLevel = WCM_PROTOCOL_5;
+	assert(usbInitChannels(&priv));
+	assert(common.wcmChannel == channels);
+	assert(common.wcmChannelCount == 2);
+
+	free(common.wcmChannel);
+}
+
+TEST_CASE(test_choose_channel)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	wcmUSBData usbdata = {0};
+	const int ncontacts = 20;
+	int channel;
+
+	priv.common = &common;
+	priv.name = "Wacom test device";
+	common.private = &usbdata;
+	common.wcmProtocolLevel = WCM_PROTOCOL_GENERIC;
+	common.wcmMaxContacts = ncontacts;
+	usbdata.wcmUseMT = TRUE;
+	assert(usbInitChannels(&priv));
+	assert(common.wcmChannelCount == ncontacts + 2);
+
+	assert(usbChooseChannel(&common, PAD_ID, DEFAULT_TOOL_SERIAL) == PAD_CHANNEL);
+
+	/* one channel per contact, in order */
+	for (int slot = 0; slot < ncontacts; slot++)
+	{
+		channel = usbChooseChannel(&common, TOUCH_ID, slot + 1);
+		assert(channel == slot + 1);
+		common.wcmChannel[channel].work.device_type = TOUCH_ID;
+		common.wcmChannel[channel].work.serial_num = slot + 1;
+		common.wcmChannel[channel].work.proximity = 1;
+	}
+	for (int slot = 0; slot < ncontacts; slot++)
+		assert(usbChooseChannel(&common, TOUCH_ID, slot + 1) == slot + 1);
+
+	/* the pen gets the last free one */
+	channel = usbChooseChannel(&common, STYLUS_ID, 0x123);
+	assert(channel == ncontacts + 1);
+	common.wcmChannel[channel].work.device_type = STYLUS_ID;
+	common.wcmChannel[channel].work.serial_num = 0x123;
+	common.wcmChannel[channel].work.proximity = 1;
+	assert(usbChooseChannel(&common, STYLUS_ID, 0x123) == ncontacts + 1);
+
+	/* a contact leaving proximity frees its channel for the next tool */
+	common.wcmChannel[3].work.proximity = 0;
+	usbUpdateChannelBusy(&common, 3);
+	assert(!(usbdata.wcmChannelBusy & (1ULL << 3)));
+	assert(usbChooseChannel(&common, TOUCH_ID, 42) == 3);
+
+	/* not yet freed while the last dispatched state is in proximity */
+	wcmChannelPushState(&common.wcmChannel[5], &common.wcmChannel[5].work);
+	common.wcmChannel[5].work.proximity = 0;
+	usbUpdateChannelBusy(&common, 5);
+	assert(usbdata.wcmChannelBusy & (1ULL << 5));
+
+	free(common.wcmChannel);
+}
+
+/* A pen hovering over ten resting fingers, each frame looks up its channel */
+BENCH_CASE(bench_choose_channel)
+{
+	WacomDeviceRec priv = {0};
+	WacomCommonRec common = {0};
+	wcmUSBData usbdata = {0};
+	const int ncontacts = 10;
+
+	priv.common = &common;
+	priv.name = "Wacom test device";
+	common.private = &usbdata;
+	common.wcmProtocolLevel = WCM_PROTOCOL_GENERIC;
+	common.wcmMaxContacts = ncontacts;
+	usbdata.wcmUseMT = TRUE;
+	usbInitChannels(&priv);
+
+	for (int slot = 0; slot <= ncontacts; slot++)
+	{
+		Bool is_pen = slot == ncontacts;
+		int serial = is_pen ? 0x123 : slot + 1;
+		int channel = usbChooseChannel(&common, is_pen ? STYLUS_ID : TOUCH_ID, serial);
+
+		common.wcmChannel[channel].work.device_type = is_pen ? STYLUS_ID : TOUCH_ID;
+		common.wcmChannel[channel].work.serial_num = serial;
+		common.wcmChannel[channel].work.proximity = 1;
+	}
+
+	for (unsigned int i = 0; i < iterations; i++)
+	{
+		unsigned int n = i % (ncontacts + 1);
+
+		if (n == ncontacts)
+			bench_keep(usbChooseChannel(&common, STYLUS_ID, 0x123));
+		else
+			bench_keep(usbChooseChannel(&common, TOUCH_ID, n + 1));
+	}
+
+	free(common.wcmChannel);
+}
+
 
 #endif
 
@@ -20,6 +20,7 @@
 
 #include "xf86Wacom.h"
 #include "wcmFilter.h"
+#include "wcmRecorder.h"
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -530,6 +531,61 @@ Bool wcmPreInitParseOptions(WacomDevicePtr priv, Bool is_primary,
 		common->wcmRawSample = DEFAULT_SAMPLES;
 	}
 
+	s = wcmOptGetStr(priv, "Filter", NULL);
+	if (s)
+	{
+		if (strcasecmp(s, "Average") == 0)
+			common->wcmFilter = FILTER_AVERAGE;
+		else if (strcasecmp(s, "OneEuro") == 0)
+			common->wcmFilter = FILTER_ONE_EURO;
+		else
+			wcmLog(priv, W_ERROR,
+			       "invalid Filter option '%s'. Using default.\n", s);
+		free(s);
+	}
+
+	common->wcmFilterMinCutoff = wcmOptGetInt(priv, "FilterMinCutoff",
+			common->wcmFilterMinCutoff);
+	if (common->wcmFilterMinCutoff < 1 ||
+	    common->wcmFilterMinCutoff > MAX_FILTER_MIN_CUTOFF)
+	{
+		wcmLog(priv, W_ERROR,
+			    "FilterMinCutoff setting '%d' out of range [1..%d]. Using default.\n",
+			    common->wcmFilterMinCutoff, MAX_FILTER_MIN_CUTOFF);
+		common->wcmFilterMinCutoff = DEFAULT_FILTER_MIN_CUTOFF;
+	}
+
+	common->wcmFilterBeta = wcmOptGetInt(priv, "FilterBeta",
+			common->wcmFilterBeta);
+	if (common->wcmFilterBeta < 0 || common->wcmFilterBeta > MAX_FILTER_BETA)
+	{
+		wcmLog(priv, W_ERROR,
+			    "FilterBeta setting '%d' out of range [0..%d]. Using default.\n",
+			    common->wcmFilterBeta, MAX_FILTER_BETA);
+		common->wcmFilterBeta = DEFAULT_FILTER_BETA;
+	}
+
+	common->wcmPrediction = wcmOptGetInt(priv, "Prediction",
+			common->wcmPrediction);
+	if (common->wcmPrediction < 0 || common->wcmPrediction > MAX_PREDICTION)
+	{
+		wcmLog(priv, W_ERROR,
+			    "Prediction setting '%d' out of range [0..%d]. Disabling.\n",
+			    common->wcmPrediction, MAX_PREDICTION);
+		common->wcmPrediction = 0;
+	}
+
+	i = wcmOptGetInt(priv, "FlightRecorder", DEFAULT_RECORDER_SIZE);
+	if (i < 0 || i > MAX_RECORDER_SIZE)
+	{
+		wcmLog(priv, W_ERROR,
+			    "FlightRecorder setting '%d' out of range [0..%d]. Using default.\n",
+			    i, MAX_RECORDER_SIZE);
+		i = DEFAULT_RECORDER_SIZE;
+	}
+	if (!wcmRecorderInit(common, i))
+		wcmLog(priv, W_WARNING, "unable to allocate the flight recorder.\n");
+
 	common->wcmSuppress = wcmOptGetInt(priv, "Suppress",
 			common->wcmSuppress);
 	if (common->wcmSuppress != 0) /* 0 disables suppression */
@@ -540,6 +596,12 @@ Bool wcmPreInitParseOptions(WacomDevicePtr priv, Bool is_primary,
 			common->wcmSuppress = DEFAULT_SUPPRESS;
 	}
 
+	/* before PressCurve, the curve's table depends on the range */
+	if (wcmOptGetBool(priv, "Pressure2K", 0)) {
+		wcmLog(priv, W_CONFIG, "Using 2K pressure levels\n");
+		wcmSetPressureRange(priv, 2048);
+	}
+
 	/* pressure curve takes control points x1,y1,x2,y2
 	 * values in range from 0..100.
 	 * Linear curve is 0,0,100,100
@@ -558,11 +620,6 @@ Bool wcmPreInitParseOptions(WacomDevicePtr priv, Bool is_primary,
 	}
 	free(s);
 
-	if (wcmOptGetBool(priv, "Pressure2K", 0)) {
-		wcmLog(priv, W_CONFIG, "Using 2K pressure levels\n");
-		priv->maxCurve = 2048;
-	}
-
 	/*Serials of tools we want hotpluged*/
 	if (wcmParseSerials (priv) != 0)
 		goto error;
@@ -717,6 +774,65 @@ error:
 #define WCM_ZOOM_DISTANCE_MM          6.5
 #define WCM_SCROLL_DISTANCE_MM        1.8
 
+/**
+ * Set up the device's per-axis suppress thresholds. The defaults derive
+ * from the kernel's fuzz for each axis, converted to the units the axis has
+ * by the time wcmCheckSuppress looks at it; the position also suppresses
+ * movement below 1/SUPPRESS_POSITION_MM mm. The defaults depend on the tool
+ * (touch resolution, pressure range), so each device has its own. An
+ * explicit Suppress option keeps the old behavior of one threshold for all
+ * axes. A threshold of 0 falls back to the Suppress value.
+ */
+static void wcmInitSuppressAxes(WacomDevicePtr priv)
+{
+	static const char *options[SUPPRESS_AXES] = {
+		[SUPPRESS_AXIS_POSITION] = "SuppressPosition",
+		[SUPPRESS_AXIS_TILT] = "SuppressTilt",
+		[SUPPRESS_AXIS_PRESSURE] = "SuppressPressure",
+		[SUPPRESS_AXIS_THROTTLE] = "SuppressThrottle",
+		[SUPPRESS_AXIS_ROTATION] = "SuppressRotation",
+		[SUPPRESS_AXIS_WHEEL] = "SuppressWheel",
+	};
+	WacomCommonPtr common = priv->common;
+	int *suppress = priv->wcmSuppressAxis;
+	const int *fuzz = common->wcmAxisFuzz;
+	int i;
+
+	if (wcmOptCheckInt(priv, "Suppress", -1) == -1)
+	{
+		int res = IsTouch(priv) ? common->wcmTouchResolX : common->wcmResolX;
+
+		suppress[SUPPRESS_AXIS_POSITION] = max(fuzz[SUPPRESS_AXIS_POSITION],
+						       res / 1000 / SUPPRESS_POSITION_MM);
+		suppress[SUPPRESS_AXIS_TILT] = (int)(fuzz[SUPPRESS_AXIS_TILT] *
+						     common->wcmTiltFactX + 0.5);
+		if (common->wcmMaxZ)
+			suppress[SUPPRESS_AXIS_PRESSURE] =
+				(double)fuzz[SUPPRESS_AXIS_PRESSURE] *
+				priv->maxCurve / common->wcmMaxZ;
+		suppress[SUPPRESS_AXIS_THROTTLE] = fuzz[SUPPRESS_AXIS_THROTTLE];
+		suppress[SUPPRESS_AXIS_ROTATION] = fuzz[SUPPRESS_AXIS_ROTATION];
+		suppress[SUPPRESS_AXIS_WHEEL] = fuzz[SUPPRESS_AXIS_WHEEL];
+	}
+
+	for (i = 0; i < SUPPRESS_AXES; i++)
+	{
+		suppress[i] = wcmOptGetInt(priv, options[i], min(suppress[i], MAX_SUPPRESS));
+		if (suppress[i] < 0 || suppress[i] > MAX_SUPPRESS)
+		{
+			wcmLog(priv, W_ERROR,
+				    "%s setting '%d' out of range [0..%d]. Using Suppress.\n",
+				    options[i], suppress[i], MAX_SUPPRESS);
+			suppress[i] = 0;
+		}
+	}
+
+	DBG(1, priv, "suppress position %d tilt %d pressure %d throttle %d rotation %d wheel %d\n",
+	    suppress[SUPPRESS_AXIS_POSITION], suppress[SUPPRESS_AXIS_TILT],
+	    suppress[SUPPRESS_AXIS_PRESSURE], suppress[SUPPRESS_AXIS_THROTTLE],
+	    suppress[SUPPRESS_AXIS_ROTATION], suppress[SUPPRESS_AXIS_WHEEL]);
+}
+
 /**
  * Parse post-init options for this device. Useful for overriding HW
  * specific options computed during init phase (HW distances for example).
@@ -755,6 +871,7 @@ Bool wcmPostInitParseOptions(WacomDevicePtr priv, Bool is_primary,
 					 scroll_distance);
 	}
 
+	wcmInitSuppressAxes(priv);
 
 	return TRUE;
 }
@@ -41,6 +41,7 @@
 #include <unistd.h>
 
 #include "xf86Wacom.h"
+#include "wcmTrace.h"
 #include <xf86_OSproc.h>
 #include <exevents.h>           /* Needed for InitValuator/Proximity stuff */
 
@@ -367,6 +368,7 @@ void wcmEmitKeycode(WacomDevicePtr priv, int keycode, int state)
 	InputInfoPtr pInfo = priv->frontend;
 	DeviceIntPtr keydev = pInfo->dev;
 
+	WCM_PROBE3(emit_keycode, priv->name, keycode, state);
 	xf86PostKeyboardEvent (keydev, keycode, state);
 }
 
@@ -425,6 +427,7 @@ void wcmEmitProximity(WacomDevicePtr priv, bool is_proximity_in,
 	valuator_mask_zero(mask);
 	convertAxes(axes, mask);
 
+	WCM_PROBE2(emit_proximity, priv->name, is_proximity_in);
 	if (valuator_mask_num_valuators(mask))
 		xf86PostProximityEventM(pInfo->dev, is_proximity_in, mask);
 }
@@ -437,6 +440,7 @@ void wcmEmitMotion(WacomDevicePtr priv, bool is_absolute, const WacomAxisData *a
 	valuator_mask_zero(mask);
 	convertAxes(axes, mask);
 
+	WCM_PROBE2(emit_motion, priv->name, is_absolute);
 	if (valuator_mask_num_valuators(mask))
 		xf86PostMotionEventM(pInfo->dev, is_absolute, mask);
 }
@@ -449,9 +453,56 @@ void wcmEmitButton(WacomDevicePtr priv, bool is_absolute, int button, bool is_pr
 	valuator_mask_zero(mask);
 	convertAxes(axes, mask);
 
+	WCM_PROBE3(emit_button, priv->name, button, is_press);
 	xf86PostButtonEventM(pInfo->dev, is_absolute, button, is_press, mask);
 }
 
+/* The events are posted back to back, converting the axes once unless the
+ * frame mixes events with and without them */
+void wcmEmitFrame(WacomDevicePtr priv, const WacomFrame *frame)
+{
+	InputInfoPtr pInfo = priv->frontend;
+	ValuatorMask *mask = priv->valuator_mask;
+	int mask_has_axes = -1; /* -1: the mask is stale */
+	int nvaluators = 0;
+
+	for (unsigned int i = 0; i < frame->nevents; i++)
+	{
+		const WacomFrameEvent *event = &frame->events[i];
+
+		if (event->type != WACOM_FRAME_KEY && event->has_axes != mask_has_axes)
+		{
+			valuator_mask_zero(mask);
+			if (event->has_axes)
+				convertAxes(&frame->axes, mask);
+			nvaluators = valuator_mask_num_valuators(mask);
+			mask_has_axes = event->has_axes;
+		}
+
+		switch (event->type)
+		{
+		case WACOM_FRAME_PROXIMITY:
+			WCM_PROBE2(emit_proximity, priv->name, event->state);
+			if (nvaluators)
+				xf86PostProximityEventM(pInfo->dev, event->state, mask);
+			break;
+		case WACOM_FRAME_MOTION:
+			WCM_PROBE2(emit_motion, priv->name, event->is_absolute);
+			if (nvaluators)
+				xf86PostMotionEventM(pInfo->dev, event->is_absolute, mask);
+			break;
+		case WACOM_FRAME_BUTTON:
+			WCM_PROBE3(emit_button, priv->name, event->code, event->state);
+			xf86PostButtonEventM(pInfo->dev, event->is_absolute, event->code,
+					     event->state, mask);
+			break;
+		case WACOM_FRAME_KEY:
+			wcmEmitKeycode(priv, event->code, event->state);
+			break;
+		}
+	}
+}
+
 void wcmEmitTouch(WacomDevicePtr priv, int type, unsigned int touchid, int x, int y)
 {
 	InputInfoPtr pInfo = priv->frontend;
@@ -461,6 +512,7 @@ void wcmEmitTouch(WacomDevicePtr priv, int type, unsigned int touchid, int x, in
 	valuator_mask_set(mask, 0, x);
 	valuator_mask_set(mask, 1, y);
 
+	WCM_PROBE5(emit_touch, priv->name, type, touchid, x, y);
 	xf86PostTouchEvent(pInfo->dev, touchid, type, 0, mask);
 }
 
@@ -657,6 +709,15 @@ uint32_t wcmTimeInMillis(void)
 	return GetTimeInMillis();
 }
 
+void wcmSyncInputThread(void)
+{
+	/* read_input runs with the input lock held */
+#if HAVE_THREADED_INPUT
+	input_lock();
+	input_unlock();
+#endif
+}
+
 /*****************************************************************************
  * wcmOpen --
  ****************************************************************************/
@@ -741,6 +802,9 @@ static void wcmDevReadInput(InputInfoPtr pInfo)
 		}
 	}
 
+	if (loop >= MAX_READ_LOOPS)
+		priv->common->wcmReadSaturated++;
+
 #ifdef DEBUG
 	/* report how well we're doing */
 	if (loop > 0)
@@ -1128,6 +1192,61 @@ valuator_mask_get(const ValuatorMask *mask, int valuator)
 	return trunc(valuator_mask_get_double(mask, valuator));
 }
 
+// There is no server to post to, the events are recorded instead
+
+struct wcm_test_post wcm_test_posts[WCM_TEST_MAX_POSTS];
+unsigned int wcm_test_nposts;
+
+static void
+recordPost(int type, int code, int state, int is_absolute, const ValuatorMask *mask)
+{
+	struct wcm_test_post *post;
+
+	assert(wcm_test_nposts < WCM_TEST_MAX_POSTS);
+	post = &wcm_test_posts[wcm_test_nposts++];
+	memset(post, 0, sizeof(*post));
+	post->type = type;
+	post->code = code;
+	post->state = state;
+	post->is_absolute = is_absolute;
+	if (!mask)
+		return;
+
+	post->nvaluators = valuator_mask_num_valuators(mask);
+	for (int i = 0; i < (int)ARRAY_SIZE(post->valuators); i++)
+	{
+		if (!valuator_mask_isset(mask, i))
+			continue;
+		post->valuator_mask |= 1u << i;
+		post->valuators[i] = valuator_mask_get(mask, i);
+	}
+}
+
+void
+xf86PostProximityEventM(DeviceIntPtr device, int is_in, const ValuatorMask *mask)
+{
+	recordPost(WACOM_FRAME_PROXIMITY, 0, is_in, TRUE, mask);
+}
+
+void
+xf86PostMotionEventM(DeviceIntPtr device, int is_absolute, const ValuatorMask *mask)
+{
+	recordPost(WACOM_FRAME_MOTION, 0, 0, is_absolute, mask);
+}
+
+void
+xf86PostButtonEventM(DeviceIntPtr device, int is_absolute, int button,
+		     int is_down, const ValuatorMask *mask)
+{
+	recordPost(WACOM_FRAME_BUTTON, button, is_down, is_absolute, mask);
+}
+
+void
+xf86PostKeyboardEvent(DeviceIntPtr device, unsigned int key_code, int is_down)
+{
+	recordPost(WACOM_FRAME_KEY, key_code, is_down, FALSE, NULL);
+}
+
 
 TEST_CASE(test_convert_axes)
 {
@@ -21,6 +21,9 @@
 
 #include "xf86Wacom.h"
 #include "wcmFilter.h"
+#include "wcmRecorder.h"
+#include <stdlib.h>
+#include <unistd.h>
 #include <exevents.h>
 #include <xf86_OSproc.h>
 #include <X11/Xatom.h>
@@ -48,6 +51,8 @@ static Atom prop_wheel_buttons;
 static Atom prop_proxout;
 static Atom prop_threshold;
 static Atom prop_suppress;
+static Atom prop_filter;
+static Atom prop_prediction;
 static Atom prop_touch;
 static Atom prop_hardware_touch;
 static Atom prop_gesture;
@@ -58,10 +63,33 @@ static Atom prop_btnactions;
 static Atom prop_product_id;
 static Atom prop_pressure_recal;
 static Atom prop_panscroll_threshold;
+static Atom prop_flight_recorder;
+static Atom prop_statistics;
+static Atom prop_latency;
 #ifdef DEBUG
 static Atom prop_debuglevels;
 #endif
 
+#define WCM_STATISTICS 9
+
+/* Set while wcmGetProperty refreshes a read-only property */
+static Bool refreshing_property;
+
+static void wcmGetStatistics(WacomDevicePtr priv, CARD32 values[WCM_STATISTICS])
+{
+	WacomCommonPtr common = priv->common;
+
+	values[0] = common->wcmEventsRead;
+	values[1] = common->wcmFramesRead;
+	values[2] = common->wcmSynDropped;
+	values[3] = common->wcmQueueOverflows;
+	values[4] = common->wcmChannelsExhausted;
+	values[5] = common->wcmReadSaturated;
+	values[6] = priv->wcmSuppressedAll;
+	values[7] = priv->wcmSuppressedNonMotion;
+	values[8] = priv->wcmSerialMismatch;
+}
+
 /**
  * Calculate a user-visible pressure level from a driver-internal pressure
  * level. Pressure settings exposed to the user assume a range of 0-2047
@@ -229,7 +257,18 @@ void InitWcmDeviceProperties(WacomDevicePtr priv)
 
 	values[0] = common->wcmSuppress;
 	values[1] = common->wcmRawSample;
-	prop_suppress = InitWcmAtom(pInfo->dev, WACOM_PROP_SAMPLE, XA_INTEGER, 32, 2, values);
+	for (i = 0; i < SUPPRESS_AXES; i++)
+		values[2 + i] = priv->wcmSuppressAxis[i];
+	prop_suppress = InitWcmAtom(pInfo->dev, WACOM_PROP_SAMPLE, XA_INTEGER, 32,
+				    2 + SUPPRESS_AXES, values);
+
+	values[0] = common->wcmFilter;
+	values[1] = common->wcmFilterMinCutoff;
+	values[2] = common->wcmFilterBeta;
+	prop_filter = InitWcmAtom(pInfo->dev, WACOM_PROP_FILTER, XA_INTEGER, 32, 3, values);
+
+	values[0] = common->wcmPrediction;
+	prop_prediction = InitWcmAtom(pInfo->dev, WACOM_PROP_PREDICTION, XA_INTEGER, 32, 1, values);
 
 	values[0] = common->wcmTouch;
 	prop_touch = InitWcmAtom(pInfo->dev, WACOM_PROP_TOUCH, XA_INTEGER, 8, 1, values);
@@ -285,6 +324,21 @@ void InitWcmDeviceProperties(WacomDevicePtr priv)
 	values[0] = common->wcmPanscrollThreshold;
 	prop_panscroll_threshold = InitWcmAtom(pInfo->dev, WACOM_PROP_PANSCROLL_THRESHOLD, XA_INTEGER, 32, 1, values);
 
+	wcmGetStatistics(priv, (CARD32*)values);
+	prop_statistics = InitWcmAtom(pInfo->dev, WACOM_PROP_STATISTICS, XA_INTEGER, 32, WCM_STATISTICS, values);
+
+	/* too many values for InitWcmAtom */
+	prop_latency = MakeAtom(WACOM_PROP_LATENCY, strlen(WACOM_PROP_LATENCY), TRUE);
+	XIChangeDeviceProperty(pInfo->dev, prop_latency, XA_INTEGER, 32,
+			       PropModeReplace, LATENCY_STAGES * LATENCY_BUCKETS,
+			       priv->wcmLatency, FALSE);
+	XISetDevicePropertyDeletable(pInfo->dev, prop_latency, FALSE);
+
+	if (common->wcmRecorder) {
+		values[0] = 0;
+		prop_flight_recorder = InitWcmAtom(pInfo->dev, WACOM_PROP_FLIGHT_RECORDER, XA_INTEGER, 32, 1, values);
+	}
+
 	values[0] = common->vendor_id;
 	values[1] = common->tablet_id;
 	prop_product_id = InitWcmAtom(pInfo->dev, XI_PROP_PRODUCT_ID, XA_INTEGER, 32, 2, values);
@@ -668,6 +722,40 @@ static int wcmDeleteProperty(DeviceIntPtr dev, Atom property)
 	return (i >= 0) ? BadAccess : Success;
 }
 
+/* Any client can set the property, don't let them fill /tmp */
+#define FLIGHT_RECORDER_DUMP_INTERVAL 10000 /* ms */
+
+/* Write the flight recorder to a new file in /tmp and log its name */
+static void wcmDumpFlightRecorder(WacomDevicePtr priv)
+{
+	WacomCommonPtr common = priv->common;
+	char path[] = "/tmp/wacom-recorder-XXXXXX";
+	uint32_t now = wcmTimeInMillis();
+	int fd;
+
+	if (common->wcmRecorderDumpTime &&
+	    now - common->wcmRecorderDumpTime < FLIGHT_RECORDER_DUMP_INTERVAL)
+	{
+		DBG(1, priv, "flight recorder dumped less than %dms ago, ignoring\n",
+		    FLIGHT_RECORDER_DUMP_INTERVAL);
+		return;
+	}
+	common->wcmRecorderDumpTime = now ? now : 1;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+	{
+		wcmLog(priv, W_ERROR, "unable to create %s: %s\n", path, strerror(errno));
+		return;
+	}
+
+	if (wcmRecorderDump(priv->common, fd))
+		wcmLog(priv, W_INFO, "flight recorder written to %s\n", path);
+	else
+		wcmLog(priv, W_ERROR, "unable to write %s: %s\n", path, strerror(errno));
+	close(fd);
+}
+
 static int wcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
 			  BOOL checkonly)
 {
@@ -679,6 +767,8 @@ static int wcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr pr
 
 	if (property == prop_devnode || property == prop_product_id)
 		return BadValue; /* Read-only */
+	else if (property == prop_statistics || property == prop_latency)
+		return refreshing_property ? Success : BadValue; /* Read-only */
 	else if (property == prop_tablet_area)
 	{
 		INT32 *values = (INT32*)prop->data;
@@ -724,8 +814,11 @@ static int wcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr pr
 	} else if (property == prop_suppress)
 	{
 		CARD32 *values;
+		unsigned long i;
 
-		if (prop->size != 2 || prop->format != 32)
+		/* the per-axis values are optional for older clients */
+		if ((prop->size != 2 && prop->size != 2 + SUPPRESS_AXES) ||
+		    prop->format != 32)
 			return BadValue;
 
 		values = (CARD32*)prop->data;
@@ -736,11 +829,62 @@ static int wcmSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr pr
 		if ((values[1] < 1) || (values[1] > MAX_SAMPLES))
 			return BadValue;
 
+		for (i = 2; i < prop->size; i++)
+			if (values[i] > MAX_SUPPRESS)
+				return BadValue;
+
 		if (!checkonly)
 		{
 			common->wcmSuppress = values[0];
 			common->wcmRawSample = values[1];
+			for (i = 2; i < prop->size; i++)
+				priv->wcmSuppressAxis[i - 2] = values[i];
+		}
+	} else if (property == prop_filter)
+	{
+		CARD32 *values;
+
+		if (prop->size != 3 || prop->format != 32)
+			return BadValue;
+
+		values = (CARD32*)prop->data;
+
+		if (values[0] != FILTER_AVERAGE && values[0] != FILTER_ONE_EURO)
+			return BadValue;
+
+		if ((values[1] < 1) || (values[1] > MAX_FILTER_MIN_CUTOFF))
+			return BadValue;
+
+		if (values[2] > MAX_FILTER_BETA)
+			return BadValue;
+
+		if (!checkonly)
+		{
+			common->wcmFilter = values[0];
+			common->wcmFilterMinCutoff = values[1];
+			common->wcmFilterBeta = values[2];
 		}
+	} else if (property == prop_flight_recorder)
+	{
+		if (prop->size != 1 || prop->format != 32)
+			return BadValue;
+
+		if (!checkonly && *(CARD32*)prop->data)
+			wcmDumpFlightRecorder(priv);
+	} else if (property == prop_prediction)
+	{
+		CARD32 value;
+
+		if (prop->size != 1 || prop->format != 32)
+			return BadValue;
+
+		value = *(CARD32*)prop->data;
+
+		if (value > MAX_PREDICTION)
+			return BadValue;
+
+		if (!checkonly)
+			common->wcmPrediction = value;
 	} else if (property == prop_rotation)
 	{
 		CARD8 value;
@@ -981,6 +1125,31 @@ static int wcmGetProperty (DeviceIntPtr dev, Atom property)
 					      PropModeReplace, 5,
 					      values, FALSE);
 	}
+	else if (property == prop_statistics)
+	{
+		CARD32 values[WCM_STATISTICS];
+		int rc;
+
+		wcmGetStatistics(priv, values);
+
+		refreshing_property = TRUE;
+		rc = XIChangeDeviceProperty(dev, property, XA_INTEGER, 32,
+					    PropModeReplace, WCM_STATISTICS,
+					    values, FALSE);
+		refreshing_property = FALSE;
+		return rc;
+	}
+	else if (property == prop_latency)
+	{
+		int rc;
+
+		refreshing_property = TRUE;
+		rc = XIChangeDeviceProperty(dev, property, XA_INTEGER, 32,
+					    PropModeReplace, LATENCY_STAGES * LATENCY_BUCKETS,
+					    priv->wcmLatency, FALSE);
+		refreshing_property = FALSE;
+		return rc;
+	}
 	else if (property == prop_btnactions)
 	{
 		/* Convert the physical button representation used internally
@@ -26,6 +26,7 @@
 
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include <xf86.h>
 #include <xf86Xinput.h>
@@ -55,9 +56,11 @@
 #endif
 
 #ifdef DEBUG
+/* Guard for debug output that needs preparation before the DBG call */
+#define DBG_ENABLED(lvl, priv) ((lvl) <= (priv)->debugLevel)
 #define DBG(lvl, priv, ...) \
 	do { \
-		if ((lvl) <= priv->debugLevel) { \
+		if (DBG_ENABLED(lvl, priv)) { \
 			if (((WacomDeviceRec*)(priv))->is_common_rec) { \
 				wcmLogDebugCommon((WacomCommonRec*)priv, lvl, __func__, __VA_ARGS__); \
 			} else { \
@@ -66,6 +69,7 @@
 		} \
 	} while (0)
 #else
+#define DBG_ENABLED(lvl, priv) 0
 #define DBG(lvl, priv, ...) do {} while(0)
 #endif
 
@@ -114,6 +118,9 @@ void wcmEvent(WacomCommonPtr common, unsigned int channel, const WacomDeviceStat
 /* dispatches data to XInput event system */
 void wcmSendEvents(WacomDevicePtr priv, const WacomDeviceState* ds);
 
+/* adds the latency of the current frame to the stage's histogram */
+void wcmLatencyRecord(WacomDevicePtr priv, enum WacomLatencyStage stage);
+
 /* validation */
 extern Bool wcmIsAValidType(WacomDevicePtr priv, const char* type);
 extern int wcmIsDuplicate(const char* device, WacomDevicePtr priv);
@@ -181,6 +188,48 @@ static inline void wcmActionSet(WacomAction *action, unsigned idx, unsigned act)
 	action->nactions = idx + 1;
 }
 
+/* The channel state of the given age, 0 being the current state.
+ * States older than MAX_SAMPLES or the last wcmChannelClearHistory() read
+ * as zeroed, the ring is only read. */
+static inline const WacomDeviceState* wcmChannelState(const WacomChannel *channel, unsigned int age)
+{
+	static const WacomDeviceState zeroed;
+	unsigned int idx = channel->valid.head + MAX_SAMPLES - age;
+
+	if (age >= channel->valid.nstates)
+		return &zeroed;
+
+	return &channel->valid.states[idx % MAX_SAMPLES];
+}
+/* The current state for changing it in place, check wcmChannelState()
+ * first, a cleared history leaves a stale state here */
+static inline WacomDeviceState* wcmChannelCurrentState(WacomChannelPtr channel)
+{
+	return &channel->valid.states[channel->valid.head];
+}
+/* Make ds the current state, the previous states age by one */
+static inline void wcmChannelPushState(WacomChannelPtr channel, const WacomDeviceState *ds)
+{
+	channel->valid.head = (channel->valid.head + 1) % MAX_SAMPLES;
+	channel->valid.states[channel->valid.head] = *ds;
+	if (channel->valid.nstates < MAX_SAMPLES)
+		channel->valid.nstates++;
+}
+/* Forget the channel's history without touching the ring itself */
+static inline void wcmChannelClearHistory(WacomChannelPtr channel)
+{
+	channel->valid.nstates = 0;
+}
+
+/* CLOCK_MONOTONIC in us, the clock of the kernel's event timestamps */
+static inline uint64_t wcmTimeInMicros(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 enum WacomSuppressMode {
 	SUPPRESS_NONE = 8,	/* Process event normally */
 	SUPPRESS_ALL,		/* Supress and discard the whole event */
@@ -40,7 +40,10 @@
 
 #define DEFAULT_SUPPRESS 2      /* default suppress */
 #define MAX_SUPPRESS 100        /* max value of suppress */
+#define SUPPRESS_POSITION_MM 50 /* default position suppress is 1/50 mm */
 #define BUFFER_SIZE 256         /* size of reception buffer */
+#define EVENT_BUFFER_SIZE 1024  /* size of the evdev event buffer, in events */
+#define EVENT_BUFFER_ALIGN 64   /* alignment of the evdev event buffer */
 #define MAXTRY 3                /* max number of try to receive magic number */
 #define MIN_ROTATION  -900      /* the minimum value of the marker pen rotation */
 #define MAX_ROTATION_RANGE 1800 /* the maximum range of the marker pen rotation */
@@ -83,8 +86,10 @@ typedef struct _WacomDeviceState WacomDeviceState, *WacomDeviceStatePtr;
 typedef struct _WacomChannel  WacomChannel, *WacomChannelPtr;
 typedef struct _WacomCommonRec WacomCommonRec;
 typedef struct _WacomFilterState WacomFilterState, *WacomFilterStatePtr;
+typedef struct _WacomPressureCurve WacomPressureCurve, *WacomPressureCurvePtr;
 typedef struct _WacomHWClass WacomHWClass, *WacomHWClassPtr;
 typedef struct _WacomTool WacomTool, *WacomToolPtr;
+typedef struct _WacomRecorder WacomRecorder, *WacomRecorderPtr;
 
 /******************************************************************************
  * WacomModel - model-specific device capabilities
@@ -98,6 +103,11 @@ struct _WacomModel
 	int (*DetectConfig)(WacomDevicePtr priv);
 	int (*Start)(WacomDevicePtr priv);
 	int (*Parse)(WacomDevicePtr priv, const unsigned char* data, unsigned long len);
+	/* optional, takes precedence over Parse: processes all complete
+	 * SYN_REPORT frames in events in place and returns the number of
+	 * events consumed */
+	int (*ParseFrames)(WacomDevicePtr priv, const struct input_event *events,
+			   unsigned int nevents, unsigned int *nframes);
 };
 
 /******************************************************************************
@@ -188,6 +198,32 @@ struct _WacomModel
 #define IDX_KEY_BUTTONCONFIG		3
 #define IDX_KEY_INFO			4
 
+/* Stages of the latency histograms, each measures the time from the
+ * kernel timestamp of the frame's SYN_REPORT until */
+enum WacomLatencyStage {
+	LATENCY_READ,		/* read() returned the frame */
+	LATENCY_PARSE,		/* the frame was parsed */
+	LATENCY_DISPATCH,	/* the frame was dispatched to the device */
+	LATENCY_FILTER,		/* filtering and prediction were done */
+	LATENCY_EMIT,		/* an event was sent to the frontend */
+	LATENCY_STAGES
+};
+
+/* Bucket n counts latencies of [2^n, 2^(n+1)) us, bucket 0 includes 0 and
+ * the last bucket everything above */
+#define LATENCY_BUCKETS 16
+
+/* axes with their own suppress threshold */
+enum WacomSuppressAxis {
+	SUPPRESS_AXIS_POSITION,
+	SUPPRESS_AXIS_TILT,
+	SUPPRESS_AXIS_PRESSURE,
+	SUPPRESS_AXIS_THROTTLE,
+	SUPPRESS_AXIS_ROTATION,
+	SUPPRESS_AXIS_WHEEL,
+	SUPPRESS_AXES
+};
+
 /******************************************************************************
  * WacomDeviceState
  *****************************************************************************/
@@ -294,13 +330,18 @@ struct _WacomDeviceRec
 	int oldCursorHwProx;	/* previous cursor hardware proximity */
 
 	int maxCurve;		/* maximum pressure curve value */
-	int *pPressCurve;       /* pressure curve */
+	WacomPressureCurvePtr pPressCurve; /* pressure curve, NULL if linear */
 	int nPressCtrl[4];      /* control points for curve */
 	int minPressure;	/* the minimum pressure a pen may hold */
 	int oldMinPressure;     /* to record the last minPressure before going out of proximity */
 	int wcmSurfaceDist;	/* Distance reported by hardware when tool at surface */
 	int wcmProxoutDist;     /* Distance from surface when proximity-out should be triggered */
+	int wcmSuppressAxis[SUPPRESS_AXES]; /* per-axis suppress, 0 uses common->wcmSuppress */
 	unsigned int eventCnt;  /* count number of events while in proximity */
+	unsigned int wcmSuppressedAll;       /* events dropped by SUPPRESS_ALL */
+	unsigned int wcmSuppressedNonMotion; /* events reduced to motion by SUPPRESS_NON_MOTION */
+	unsigned int wcmSerialMismatch;      /* events dropped, serial didn't match */
+	unsigned int wcmLatency[LATENCY_STAGES][LATENCY_BUCKETS]; /* see wcmLatencyRecord() */
 	int maxRawPressure;     /* maximum 'raw' pressure seen until first button event */
 	WacomToolPtr tool;         /* The common tool-structure for this device */
 
@@ -311,11 +352,36 @@ struct _WacomDeviceRec
 	WacomTimerPtr touch_timer; /* timer used for touch switch property update */
 
 	ValuatorMask *valuator_mask; /* reusable valuator mask for sending events without reallocation */
+	WacomFrame *frame;	/* events collected by wcmSendEvents, or NULL */
+};
+
+/* Pressure curve lookup table, shared by all devices with the same
+ * control points and range. See wcmRefPressureCurve(). */
+struct _WacomPressureCurve
+{
+	WacomPressureCurvePtr next;	/* next curve in the cache */
+	int refcnt;
+	int ctrl[4];		/* control points, see nPressCtrl */
+	int maxCurve;		/* highest index and value of the curve */
+	uint16_t *narrow;	/* entries, if maxCurve fits into 16 bits */
+	int *wide;		/* entries otherwise */
 };
 
 #define MAX_SAMPLES	20
 #define DEFAULT_SAMPLES 4
 
+/* coordinate filter engines */
+enum WacomFilterMode {
+	FILTER_AVERAGE = 0,	/* box average over RawSample samples */
+	FILTER_ONE_EURO = 1,	/* speed-adaptive low-pass */
+};
+
+#define DEFAULT_FILTER_MIN_CUTOFF 1000	/* One-Euro minimum cutoff in mHz */
+#define DEFAULT_FILTER_BETA 50		/* One-Euro speed coefficient in 1/1000 Hz per mm/s */
+#define MAX_FILTER_MIN_CUTOFF 100000
+#define MAX_FILTER_BETA 10000
+#define MAX_PREDICTION 50		/* max prediction horizon in ms */
+
 struct _WacomFilterState
 {
         int npoints;
@@ -323,6 +389,19 @@ struct _WacomFilterState
         int y[MAX_SAMPLES];
         int tiltx[MAX_SAMPLES];
         int tilty[MAX_SAMPLES];
+        int pos;             /* ring index of the oldest sample */
+        int window;          /* number of samples in the ring */
+        int sum_x, sum_y;    /* running sums over the ring */
+        int sum_tiltx, sum_tilty;
+        int mode;            /* filter engine the state belongs to */
+
+        /* One-Euro filter state */
+        double ex, ey;       /* filtered position */
+        double etiltx, etilty; /* filtered tilt */
+        double dx, dy;       /* filtered speed in mm/s */
+        uint32_t time;       /* time of the last sample in ms */
+
+        int npredict;        /* samples since prediction was last reset */
 };
 
 struct _WacomChannel
@@ -333,15 +412,16 @@ struct _WacomChannel
 	 * the work stage and the valid state. */
 
 	WacomDeviceState work;                         /* next state */
-	Bool dirty;
 
-	/* the following union contains the current known state of the
+	/* the following ring buffer contains the current known state of the
 	 * device channel, as well as the previous MAX_SAMPLES states
-	 * for use in detecting hardware defects, jitter, trends, etc. */
-	union
+	 * for use in detecting hardware defects, jitter, trends, etc.
+	 * Use wcmChannelState() and wcmChannelPushState() to access it. */
+	struct
 	{
-		WacomDeviceState state;                /* current state */
-		WacomDeviceState states[MAX_SAMPLES];  /* states 0..MAX */
+		WacomDeviceState states[MAX_SAMPLES];  /* ring of states */
+		unsigned int head;                     /* index of the current state */
+		unsigned int nstates;                  /* states pushed, up to MAX_SAMPLES */
 	} valid;
 
 	int nSamples;
@@ -369,9 +449,12 @@ extern WacomHWClass *WacomGetClassUSB(void);
 
 #define TILT_ENABLED_FLAG       2
 
-#define MAX_FINGERS 16
-#define MAX_CHANNELS (MAX_FINGERS+2) /* one channel for stylus/mouse. The other one for pad */
-#define PAD_CHANNEL (MAX_CHANNELS-1)
+/* The channel pool is sized per tablet, see usbInitChannels(). Channel
+ * bitmasks are 64 bits wide, which limits the pool to 64 channels: the
+ * pad, the stylus/mouse and up to MAX_FINGERS touch contacts. */
+#define MAX_CHANNELS 64
+#define MAX_FINGERS (MAX_CHANNELS-2)
+#define PAD_CHANNEL 0
 
 typedef struct {
 	unsigned int wcmZoomDistance;        /* minimum distance for a zoom touch gesture */
@@ -450,7 +533,9 @@ struct _WacomCommonRec
 	float wcmVersion;            /* ROM version */
 	int wcmRotate;               /* rotate screen (for TabletPC) */
 	int wcmThreshold;            /* Threshold for button pressure */
-	WacomChannel wcmChannel[MAX_CHANNELS]; /* channel device state */
+	WacomChannelPtr wcmChannel;  /* channel device state, cache-aligned */
+	int wcmChannelCount;         /* number of channels in wcmChannel */
+	uint64_t wcmDirtyChannels;   /* bitmask of channels changed in this frame */
 
 	WacomHWClassPtr wcmDevCls; /* device class functions */
 	WacomModelPtr wcmModel;        /* model-specific functions */
@@ -459,11 +544,16 @@ struct _WacomCommonRec
 	int wcmTouchDefault;	     /* default to disable when not supported */
 	int wcmGesture;	     	     /* disable/enable touch gesture */
 	int wcmGestureMode;	       /* data is in Gesture Mode? */
-	WacomDeviceState wcmGestureState[MAX_FINGERS]; /* inital state when in gesture mode */
+	WacomDeviceState wcmGestureState[2]; /* inital state of the first two fingers when in gesture mode */
 	WacomGesturesParameters wcmGestureParameters;
 	int wcmProxoutDistDefault;   /* Default value for wcmProxoutDist */
 	int wcmSuppress;        	 /* transmit position on delta > supress */
+	int wcmAxisFuzz[SUPPRESS_AXES];	 /* kernel fuzz of the axes in device units */
 	int wcmRawSample;	     /* Number of raw data used to filter an event */
+	int wcmFilter;		     /* coordinate filter engine, see WacomFilterMode */
+	int wcmFilterMinCutoff;	     /* One-Euro minimum cutoff in mHz */
+	int wcmFilterBeta;	     /* One-Euro speed coefficient in 1/1000 Hz per mm/s */
+	int wcmPrediction;	     /* ms to extrapolate the position ahead, 0 disables */
 	int wcmPressureRecalibration; /* Determine if pressure recalibration of
 					 worn pens should be performed */
 	int wcmPanscrollThreshold;	/* distance pen must move to send a panscroll event */
@@ -471,6 +561,20 @@ struct _WacomCommonRec
 
 	int bufpos;                        /* position with buffer */
 	unsigned char buffer[BUFFER_SIZE]; /* data read from device */
+	struct input_event *evbuf;         /* events read from device, see ParseFrames */
+	unsigned int evcount;              /* events pending in evbuf */
+	unsigned int wcmFramesPerRead;     /* frames returned by the last read */
+	unsigned int wcmSynDropped;        /* number of SYN_DROPPED received */
+	unsigned int wcmEventsRead;        /* number of evdev events read */
+	unsigned int wcmFramesRead;        /* number of SYN_REPORT frames read */
+	unsigned int wcmQueueOverflows;    /* events dropped, event queue full */
+	unsigned int wcmChannelsExhausted; /* times all channels were in use */
+	unsigned int wcmReadSaturated;     /* times the read loop couldn't keep up */
+	uint64_t wcmFrameTimeUs;           /* kernel time of the frame being dispatched, 0 if none */
+	uint64_t wcmReadTimeUs;            /* time the last read() returned */
+	uint64_t wcmParseTimeUs;           /* time the frame being dispatched was parsed */
+	WacomRecorderPtr wcmRecorder;      /* flight recorder, NULL if disabled */
+	uint32_t wcmRecorderDumpTime;      /* time of the last flight recorder dump, 0 if none */
 
 	void *private;		     /* backend-specific information */
 
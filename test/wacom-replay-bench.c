@@ -0,0 +1,902 @@
+/*
+ * Copyright 2024 by the xf86-input-wacom contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Headless replay benchmark for the driver core.
+ *
+ * This links the core sources against a no-op implementation of
+ * WacomInterface.h and emulates the evdev nodes of an Intuos Pro M
+ * (PTH660, see devices/wacom-pth660.yml) by answering the core's ioctls
+ * in-process. Synthetic event streams are then handed to the model's
+ * ParseFrames one frame at a time, the way wcmReadPacket() does after
+ * each read(), without any kernel, X server or main loop involved.
+ *
+ * The ioctls are answered by overriding ioctl() itself, which needs
+ * glibc's prototype. The benchmark is only built with glibc.
+ *
+ * Time is simulated (see wcmSimClock.h): the clock jumps to the timestamp
+ * of each frame and timers fire when a frame passes their deadline, so
+ * timer-driven gestures like tap-to-click replay exactly as in real time.
+ *
+ * Usage: wacom-replay-bench [frames-per-workload]
+ */
+
+#include <config.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "xf86Wacom.h"
+#include "wcmSimClock.h"
+
+#define REPLAY_FRAMES 1000000
+#define MAX_OPTIONS 16
+#define MAX_FAKE_FDS 16
+#define NFINGERS 10
+
+/****************** Emulated evdev nodes *****************/
+
+struct fake_abs {
+	int code;
+	int min, max, res;
+};
+
+struct fake_node {
+	const char *path;
+	const int *keys;	/* terminated by -1 */
+	const struct fake_abs *abs; /* terminated by code -1 */
+	Bool has_serial;	/* MSC_SERIAL */
+	Bool has_mute;		/* SW_MUTE_DEVICE */
+};
+
+static const int pen_keys[] = {
+	BTN_TOOL_PEN, BTN_TOOL_RUBBER, BTN_TOOL_AIRBRUSH, BTN_STYLUS,
+	BTN_STYLUS2, BTN_STYLUS3, BTN_TOUCH, -1
+};
+
+static const struct fake_abs pen_abs[] = {
+	{ ABS_X, 0, 44800, 200 },
+	{ ABS_Y, 0, 29600, 200 },
+	{ ABS_Z, -900, 899, 287 },
+	{ ABS_WHEEL, 0, 2047, 0 },
+	{ ABS_PRESSURE, 0, 8191, 0 },
+	{ ABS_DISTANCE, 0, 63, 0 },
+	{ ABS_TILT_X, -64, 63, 57 },
+	{ ABS_TILT_Y, -64, 63, 57 },
+	{ ABS_MISC, INT32_MIN, INT32_MAX, 0 },
+	{ .code = -1 },
+};
+
+static const int pad_keys[] = {
+	BTN_0, BTN_1, BTN_2, BTN_3, BTN_4, BTN_5, BTN_6, BTN_7, BTN_8,
+	BTN_STYLUS, -1
+};
+
+static const struct fake_abs pad_abs[] = {
+	{ ABS_X, 0, 1, 0 },
+	{ ABS_Y, 0, 1, 0 },
+	{ ABS_WHEEL, 0, 71, 11 },
+	{ ABS_MISC, 0, 0, 0 },
+	{ .code = -1 },
+};
+
+static const int finger_keys[] = {
+	BTN_TOOL_FINGER, BTN_TOOL_DOUBLETAP, BTN_TOOL_TRIPLETAP,
+	BTN_TOOL_QUADTAP, BTN_TOOL_QUINTTAP, BTN_TOUCH, -1
+};
+
+static const struct fake_abs finger_abs[] = {
+	{ ABS_X, 0, 8960, 40 },
+	{ ABS_Y, 0, 5920, 40 },
+	{ ABS_MT_SLOT, 0, NFINGERS - 1, 0 },
+	{ ABS_MT_TOUCH_MAJOR, 0, 31, 2 },
+	{ ABS_MT_TOUCH_MINOR, 0, 31, 2 },
+	{ ABS_MT_ORIENTATION, 0, 1, 0 },
+	{ ABS_MT_POSITION_X, 0, 8960, 40 },
+	{ ABS_MT_POSITION_Y, 0, 5920, 40 },
+	{ ABS_MT_TRACKING_ID, 0, 65535, 0 },
+	{ .code = -1 },
+};
+
+static const struct fake_node pen_node = {
+	"/replay/pen", pen_keys, pen_abs, TRUE, FALSE
+};
+static const struct fake_node pad_node = {
+	"/replay/pad", pad_keys, pad_abs, TRUE, FALSE
+};
+static const struct fake_node finger_node = {
+	"/replay/finger", finger_keys, finger_abs, FALSE, TRUE
+};
+
+static const struct fake_node *nodes[] = { &pen_node, &pad_node, &finger_node };
+
+static const struct input_id fake_id = {
+	.bustype = BUS_USB,
+	.vendor = WACOM_VENDOR_ID,
+	.product = 0x357,
+	.version = 0x110,
+};
+
+static struct {
+	int fd;
+	const struct fake_node *node;
+} fake_fds[MAX_FAKE_FDS];
+
+static const struct fake_node *fake_node_for_fd(int fd)
+{
+	for (int i = 0; i < MAX_FAKE_FDS; i++)
+		if (fake_fds[i].node && fake_fds[i].fd == fd)
+			return fake_fds[i].node;
+	return NULL;
+}
+
+static const struct fake_abs *fake_abs(const struct fake_node *node, int code)
+{
+	for (const struct fake_abs *a = node->abs; a->code != -1; a++)
+		if (a->code == code)
+			return a;
+	return NULL;
+}
+
+/* Copy a bitmask the way the kernel does: at most len bytes */
+static int copy_bits(void *arg, size_t len, const unsigned long *bits, size_t size)
+{
+	size_t n = min(len, size);
+
+	memset(arg, 0, len);
+	memcpy(arg, bits, n);
+	return n;
+}
+
+static int fake_ioctl(const struct fake_node *node, unsigned long request, void *arg)
+{
+	unsigned long bits[NBITS(KEY_CNT)] = {0};
+	size_t len = _IOC_SIZE(request);
+	unsigned int nr = _IOC_NR(request);
+
+	switch (request)
+	{
+		case EVIOCGVERSION:
+			*(int*)arg = EV_VERSION;
+			return 0;
+		case EVIOCGID:
+			*(struct input_id*)arg = fake_id;
+			return 0;
+		case EVIOCGRAB:
+		case EVIOCSCLOCKID:
+			return 0;
+	}
+
+	if (_IOC_TYPE(request) != 'E' || _IOC_DIR(request) != _IOC_READ)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (nr >= 0x40 && nr < 0x40 + ABS_CNT) /* EVIOCGABS */
+	{
+		const struct fake_abs *a = fake_abs(node, nr - 0x40);
+		struct input_absinfo *absinfo = arg;
+
+		if (!a)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		memset(absinfo, 0, sizeof(*absinfo));
+		absinfo->minimum = a->min;
+		absinfo->maximum = a->max;
+		absinfo->resolution = a->res;
+		return 0;
+	}
+
+	switch (nr)
+	{
+		case 0x20: /* EVIOCGBIT(0) */
+			SETBIT(bits, EV_SYN);
+			SETBIT(bits, EV_KEY);
+			SETBIT(bits, EV_ABS);
+			if (node->has_serial)
+				SETBIT(bits, EV_MSC);
+			if (node->has_mute)
+				SETBIT(bits, EV_SW);
+			return copy_bits(arg, len, bits, NBITS(EV_CNT) * sizeof(long));
+		case 0x20 + EV_KEY:
+			for (const int *k = node->keys; *k != -1; k++)
+				SETBIT(bits, *k);
+			return copy_bits(arg, len, bits, NBITS(KEY_CNT) * sizeof(long));
+		case 0x20 + EV_ABS:
+			for (const struct fake_abs *a = node->abs; a->code != -1; a++)
+				SETBIT(bits, a->code);
+			return copy_bits(arg, len, bits, NBITS(ABS_CNT) * sizeof(long));
+		case 0x20 + EV_MSC:
+			if (node->has_serial)
+				SETBIT(bits, MSC_SERIAL);
+			return copy_bits(arg, len, bits, NBITS(MSC_CNT) * sizeof(long));
+		case 0x20 + EV_SW:
+			if (node->has_mute)
+				SETBIT(bits, SW_MUTE_DEVICE);
+			return copy_bits(arg, len, bits, NBITS(SW_CNT) * sizeof(long));
+		case 0x09: /* EVIOCGPROP */
+			SETBIT(bits, INPUT_PROP_POINTER);
+			return copy_bits(arg, len, bits, NBITS(INPUT_PROP_CNT) * sizeof(long));
+		case 0x18: /* EVIOCGKEY, nothing is pressed */
+		case 0x1b: /* EVIOCGSW */
+			memset(arg, 0, len);
+			return len;
+		case 0x0a: /* EVIOCGMTSLOTS, no contacts */
+		{
+			int32_t *values = arg;
+			int32_t code = values[0];
+
+			for (size_t i = 1; i < len / sizeof(int32_t); i++)
+				values[i] = code == ABS_MT_TRACKING_ID ? -1 : 0;
+			return 0;
+		}
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+#ifndef __GLIBC__
+#error "The replay benchmark overrides glibc's ioctl()"
+#endif
+
+/* The core's ioctls on an emulated node end up here, everything else goes
+ * to the kernel. */
+int ioctl(int fd, unsigned long request, ...)
+{
+	const struct fake_node *node = fake_node_for_fd(fd);
+	va_list args;
+	void *arg;
+
+	va_start(args, request);
+	arg = va_arg(args, void*);
+	va_end(args);
+
+	if (node)
+		return fake_ioctl(node, request, arg);
+
+	return syscall(SYS_ioctl, fd, request, arg);
+}
+
+/****************** No-op frontend *****************/
+
+struct replay_device {
+	WacomDevicePtr priv;
+	int fd;
+	char *options[MAX_OPTIONS][2];
+	struct replay_device *next;
+};
+
+static struct replay_device *replay_devices;
+static unsigned int emitted;
+
+/* The timestamp in us of the last frame replayed */
+static uint64_t replay_time;
+static WacomSimClockPtr sim_clock;
+
+static const char *replay_option(struct replay_device *device, const char *key)
+{
+	for (int i = 0; i < MAX_OPTIONS && device->options[i][0]; i++)
+		if (strcasecmp(device->options[i][0], key) == 0)
+			return device->options[i][1];
+	return NULL;
+}
+
+static void replay_set_option(struct replay_device *device, const char *key, const char *value)
+{
+	int i;
+
+	for (i = 0; i < MAX_OPTIONS && device->options[i][0]; i++)
+	{
+		if (strcasecmp(device->options[i][0], key) == 0)
+		{
+			free(device->options[i][1]);
+			device->options[i][1] = strdup(value);
+			return;
+		}
+	}
+
+	if (i == MAX_OPTIONS)
+		abort();
+
+	device->options[i][0] = strdup(key);
+	device->options[i][1] = strdup(value);
+}
+
+ValuatorMask *valuator_mask_new(int num_valuators)
+{
+	return NULL;
+}
+
+__attribute__((__format__(__printf__ , 2, 0)))
+static void replay_log(WacomLogType type, const char *format, va_list args)
+{
+	if (type == W_ERROR || type == W_WARNING)
+		vfprintf(stderr, format, args);
+}
+
+void wcmLog(WacomDevicePtr priv, WacomLogType type, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	replay_log(type, format, args);
+	va_end(args);
+}
+
+void wcmLogSafe(WacomDevicePtr priv, WacomLogType type, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	replay_log(type, format, args);
+	va_end(args);
+}
+
+void wcmLogCommon(WacomCommonPtr common, WacomLogType type, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	replay_log(type, format, args);
+	va_end(args);
+}
+
+void wcmLogCommonSafe(WacomCommonPtr common, WacomLogType type, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	replay_log(type, format, args);
+	va_end(args);
+}
+
+void wcmLogDebugDevice(WacomDevicePtr priv, int debug_level, const char *func, const char *format, ...) {}
+void wcmLogDebugCommon(WacomCommonPtr common, int debug_level, const char *func, const char *format, ...) {}
+
+int wcmForeachDevice(WacomDevicePtr priv, WacomDeviceCallback func, void *data)
+{
+	int nmatch = 0;
+
+	for (struct replay_device *d = replay_devices; d; d = d->next)
+	{
+		int rc;
+
+		if (d->priv == priv)
+			continue;
+
+		rc = func(d->priv, data);
+		if (rc == -ENODEV)
+			continue;
+		if (rc < 0)
+			return -rc;
+		nmatch += 1;
+		if (rc == 0)
+			break;
+	}
+
+	return nmatch;
+}
+
+int wcmOpen(WacomDevicePtr priv)
+{
+	struct replay_device *device = priv->frontend;
+	const char *path = replay_option(device, "Device");
+
+	for (size_t i = 0; path && i < ARRAY_SIZE(nodes); i++)
+	{
+		if (strcmp(path, nodes[i]->path) != 0)
+			continue;
+
+		for (int j = 0; j < MAX_FAKE_FDS; j++)
+		{
+			int fd;
+
+			if (fake_fds[j].node)
+				continue;
+
+			/* a real fd so that fstat() works */
+			fd = open("/dev/null", O_RDONLY|O_NONBLOCK|O_CLOEXEC);
+			if (fd < 0)
+				return -errno;
+			fake_fds[j].fd = fd;
+			fake_fds[j].node = nodes[i];
+			return fd;
+		}
+	}
+
+	return -ENODEV;
+}
+
+void wcmClose(WacomDevicePtr priv)
+{
+	struct replay_device *device = priv->frontend;
+
+	for (int i = 0; i < MAX_FAKE_FDS; i++)
+		if (fake_fds[i].node && fake_fds[i].fd == device->fd)
+			fake_fds[i].node = NULL;
+
+	if (device->fd >= 0)
+		close(device->fd);
+	device->fd = -1;
+}
+
+int wcmGetFd(WacomDevicePtr priv)
+{
+	struct replay_device *device = priv->frontend;
+	return device->fd;
+}
+
+void wcmSetFd(WacomDevicePtr priv, int fd)
+{
+	struct replay_device *device = priv->frontend;
+	device->fd = fd;
+}
+
+void wcmSetName(WacomDevicePtr priv, const char *name) {}
+
+uint32_t wcmTimeInMillis(void)
+{
+	return wcmSimClockMillis(sim_clock);
+}
+
+void wcmSyncInputThread(void) {}
+
+void wcmInitAxis(WacomDevicePtr priv, enum WacomAxisType type, int min, int max, int res) {}
+bool wcmInitButtons(WacomDevicePtr priv, unsigned int nbuttons) { return true; }
+bool wcmInitKeyboard(WacomDevicePtr priv) { return true; }
+bool wcmInitPointer(WacomDevicePtr priv, int naxes, bool is_absolute) { return true; }
+bool wcmInitTouch(WacomDevicePtr priv, int ntouches, bool is_direct_touch) { return true; }
+
+void wcmEmitKeycode(WacomDevicePtr priv, int keycode, int state) { emitted++; }
+void wcmEmitMotion(WacomDevicePtr priv, bool is_absolute, const WacomAxisData *axes) { emitted++; }
+void wcmEmitButton(WacomDevicePtr priv, bool is_absolute, int button, bool is_press,
+		   const WacomAxisData *axes) { emitted++; }
+void wcmEmitProximity(WacomDevicePtr priv, bool is_proximity_in,
+		      const WacomAxisData *axes) { emitted++; }
+void wcmEmitTouch(WacomDevicePtr priv, int type, unsigned int touchid, int x, int y) { emitted++; }
+void wcmEmitFrame(WacomDevicePtr priv, const WacomFrame *frame) { emitted += frame->nevents; }
+
+void wcmNotifyEvdev(WacomDevicePtr priv, const struct input_event *event)
+{
+	wcmSimClockNotifyEvent(sim_clock, event);
+}
+
+/* All tools are added explicitly with a type, nothing is hotplugged */
+void wcmQueueHotplug(WacomDevicePtr priv, const char *name,
+		     const char *type, unsigned int serial) {}
+
+char *wcmOptGetStr(WacomDevicePtr priv, const char *key, const char *default_value)
+{
+	const char *value = replay_option(priv->frontend, key);
+
+	if (!value)
+		value = default_value;
+	return value ? strdup(value) : NULL;
+}
+
+int wcmOptGetInt(WacomDevicePtr priv, const char *key, int default_value)
+{
+	const char *value = replay_option(priv->frontend, key);
+
+	return value ? atoi(value) : default_value;
+}
+
+bool wcmOptGetBool(WacomDevicePtr priv, const char *key, bool default_value)
+{
+	const char *value = replay_option(priv->frontend, key);
+
+	if (!value)
+		return default_value;
+
+	return strcasecmp(value, "true") == 0 || strcasecmp(value, "yes") == 0 ||
+	       strcasecmp(value, "on") == 0 || strcmp(value, "1") == 0;
+}
+
+char *wcmOptCheckStr(WacomDevicePtr priv, const char *key, const char *default_value)
+{
+	return wcmOptGetStr(priv, key, default_value);
+}
+
+int wcmOptCheckInt(WacomDevicePtr priv, const char *key, int default_value)
+{
+	return wcmOptGetInt(priv, key, default_value);
+}
+
+bool wcmOptCheckBool(WacomDevicePtr priv, const char *key, bool default_value)
+{
+	return wcmOptGetBool(priv, key, default_value);
+}
+
+void wcmOptSetStr(WacomDevicePtr priv, const char *key, const char *value)
+{
+	replay_set_option(priv->frontend, key, value);
+}
+
+void wcmOptSetInt(WacomDevicePtr priv, const char *key, int value)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%d", value);
+	wcmOptSetStr(priv, key, buf);
+}
+
+void wcmOptSetBool(WacomDevicePtr priv, const char *key, bool value)
+{
+	wcmOptSetStr(priv, key, value ? "true" : "false");
+}
+
+/* The timer itself carries no state, sim_clock tracks it by address */
+WacomTimerPtr wcmTimerNew(void)
+{
+	return calloc(1, 1);
+}
+
+void wcmTimerFree(WacomTimerPtr timer)
+{
+	wcmSimClockCancelTimer(sim_clock, timer);
+	free(timer);
+}
+
+void wcmTimerCancel(WacomTimerPtr timer)
+{
+	wcmSimClockCancelTimer(sim_clock, timer);
+}
+
+void wcmTimerSet(WacomTimerPtr timer, uint32_t millis, WacomTimerCallback func, void *userdata)
+{
+	wcmSimClockSetTimer(sim_clock, timer, millis, func, userdata);
+}
+
+void wcmUpdateRotationProperty(WacomDevicePtr priv) {}
+void wcmUpdateSerialProperty(WacomDevicePtr priv) {}
+void wcmUpdateHWTouchProperty(WacomDevicePtr priv) {}
+
+/****************** Devices *****************/
+
+static struct replay_device *replay_add_device(const struct fake_node *node, const char *type)
+{
+	struct replay_device *device = calloc(1, sizeof(*device));
+	char name[64];
+
+	snprintf(name, sizeof(name), "Wacom Intuos Pro M %s", type);
+	device->fd = -1;
+	device->priv = wcmAllocate(device, name);
+	replay_set_option(device, "Device", node->path);
+	replay_set_option(device, "Type", type);
+
+	device->next = replay_devices;
+	replay_devices = device;
+
+	if (wcmPreInit(device->priv) != Success ||
+	    !wcmDevInit(device->priv) ||
+	    !wcmDevOpen(device->priv) ||
+	    !wcmDevStart(device->priv))
+	{
+		fprintf(stderr, "Failed to set up the %s on %s\n", type, node->path);
+		exit(1);
+	}
+
+	return device;
+}
+
+static void replay_remove_devices(void)
+{
+	while (replay_devices)
+	{
+		struct replay_device *device = replay_devices;
+
+		replay_devices = device->next;
+		wcmDevStop(device->priv);
+		wcmDevClose(device->priv);
+		wcmUnInit(device->priv);
+		for (int i = 0; i < MAX_OPTIONS; i++)
+		{
+			free(device->options[i][0]);
+			free(device->options[i][1]);
+		}
+		free(device);
+	}
+}
+
+/****************** Workloads *****************/
+
+struct stream {
+	struct input_event *events;
+	unsigned int nevents, size;
+	unsigned int *frames;	/* index of each frame's first event */
+	unsigned int *delays;	/* us before each frame on top of interval */
+	unsigned int nframes, framesize;
+	unsigned int interval;	/* us between frames */
+};
+
+static void add(struct stream *s, int type, int code, int value)
+{
+	if (s->nevents == s->size)
+	{
+		s->size = s->size ? s->size * 2 : 1024;
+		s->events = realloc(s->events, s->size * sizeof(*s->events));
+	}
+	s->events[s->nevents++] = (struct input_event){ .type = type, .code = code, .value = value };
+}
+
+static void syn(struct stream *s)
+{
+	add(s, EV_SYN, SYN_REPORT, 0);
+	if (s->nframes == s->framesize)
+	{
+		s->framesize = s->framesize ? s->framesize * 2 : 256;
+		s->frames = realloc(s->frames, (s->framesize + 1) * sizeof(*s->frames));
+		s->delays = realloc(s->delays, (s->framesize + 1) * sizeof(*s->delays));
+	}
+	s->frames[++s->nframes] = s->nevents;
+	s->delays[s->nframes] = 0;
+}
+
+/* Delay the next frame by another us */
+static void pause_stream(struct stream *s, unsigned int us)
+{
+	s->delays[s->nframes] += us;
+}
+
+/* A pen stroke loop: hover in, draw with varying pressure and tilt while
+ * tapping the side button, lift and leave proximity */
+static void pen_stream(struct stream *s)
+{
+	const int serial = 0x12345678, id = 0x862;
+
+	s->interval = 5000; /* 200 Hz */
+
+	add(s, EV_KEY, BTN_TOOL_PEN, 1);
+	add(s, EV_ABS, ABS_MISC, id);
+	add(s, EV_ABS, ABS_X, 10000);
+	add(s, EV_ABS, ABS_Y, 10000);
+	add(s, EV_ABS, ABS_DISTANCE, 30);
+	add(s, EV_MSC, MSC_SERIAL, serial);
+	syn(s);
+
+	for (int i = 1; i < 1000; i++)
+	{
+		add(s, EV_ABS, ABS_X, 10000 + i * 20);
+		add(s, EV_ABS, ABS_Y, 10000 + (i % 200) * 40);
+		if (i == 10)
+			add(s, EV_KEY, BTN_TOUCH, 1);
+		if (i >= 10 && i < 990)
+			add(s, EV_ABS, ABS_PRESSURE, 1000 + (i % 100) * 50);
+		if (i == 990)
+		{
+			add(s, EV_ABS, ABS_PRESSURE, 0);
+			add(s, EV_KEY, BTN_TOUCH, 0);
+		}
+		add(s, EV_ABS, ABS_TILT_X, i % 64);
+		add(s, EV_ABS, ABS_TILT_Y, -(i % 64));
+		if (i % 100 == 50)
+			add(s, EV_KEY, BTN_STYLUS, 1);
+		if (i % 100 == 60)
+			add(s, EV_KEY, BTN_STYLUS, 0);
+		add(s, EV_MSC, MSC_SERIAL, serial);
+		syn(s);
+	}
+
+	add(s, EV_KEY, BTN_TOOL_PEN, 0);
+	add(s, EV_ABS, ABS_MISC, 0);
+	add(s, EV_MSC, MSC_SERIAL, serial);
+	syn(s);
+}
+
+/* Pressing the express keys one by one while spinning the touch ring */
+static void pad_stream(struct stream *s)
+{
+	s->interval = 8000;
+
+	for (int i = 0; i < 1000; i++)
+	{
+		int button = BTN_0 + (i / 2) % 9;
+
+		add(s, EV_KEY, button, !(i & 1));
+		add(s, EV_ABS, ABS_WHEEL, i % 72);
+		add(s, EV_ABS, ABS_MISC, PAD_DEVICE_ID);
+		add(s, EV_MSC, MSC_SERIAL, 0xffffffff);
+		syn(s);
+	}
+}
+
+/* Single finger taps, each after enough idle time for the previous tap's
+ * timer to expire and send the click */
+static void tap_stream(struct stream *s)
+{
+	s->interval = 7000;
+
+	for (int i = 0; i < 100; i++)
+	{
+		pause_stream(s, 500000);
+		add(s, EV_ABS, ABS_MT_SLOT, 0);
+		add(s, EV_ABS, ABS_MT_TRACKING_ID, i + 1);
+		add(s, EV_ABS, ABS_MT_POSITION_X, 1000 + i * 10);
+		add(s, EV_ABS, ABS_MT_POSITION_Y, 2000);
+		add(s, EV_KEY, BTN_TOUCH, 1);
+		add(s, EV_KEY, BTN_TOOL_FINGER, 1);
+		add(s, EV_ABS, ABS_X, 1000 + i * 10);
+		add(s, EV_ABS, ABS_Y, 2000);
+		syn(s);
+
+		add(s, EV_ABS, ABS_MT_POSITION_X, 1001 + i * 10);
+		add(s, EV_ABS, ABS_X, 1001 + i * 10);
+		syn(s);
+
+		add(s, EV_ABS, ABS_MT_TRACKING_ID, -1);
+		add(s, EV_KEY, BTN_TOUCH, 0);
+		add(s, EV_KEY, BTN_TOOL_FINGER, 0);
+		syn(s);
+	}
+}
+
+/* Ten fingers landing one by one, moving together and lifting */
+static void mt_stream(struct stream *s)
+{
+	static const int tools[] = {
+		BTN_TOOL_FINGER, BTN_TOOL_DOUBLETAP, BTN_TOOL_TRIPLETAP,
+		BTN_TOOL_QUADTAP, BTN_TOOL_QUINTTAP,
+	};
+
+	s->interval = 7000;
+
+	for (int f = 0; f < NFINGERS; f++)
+	{
+		add(s, EV_ABS, ABS_MT_SLOT, f);
+		add(s, EV_ABS, ABS_MT_TRACKING_ID, f + 1);
+		add(s, EV_ABS, ABS_MT_POSITION_X, 1000 + f * 600);
+		add(s, EV_ABS, ABS_MT_POSITION_Y, 2000);
+		if (f == 0)
+		{
+			add(s, EV_KEY, BTN_TOUCH, 1);
+			add(s, EV_ABS, ABS_X, 1000);
+			add(s, EV_ABS, ABS_Y, 2000);
+		}
+		else if (f < 5)
+			add(s, EV_KEY, tools[f - 1], 0);
+		if (f < 5)
+			add(s, EV_KEY, tools[f], 1);
+		syn(s);
+	}
+
+	for (int i = 1; i < 1000 - 2 * NFINGERS; i++)
+	{
+		for (int f = 0; f < NFINGERS; f++)
+		{
+			add(s, EV_ABS, ABS_MT_SLOT, f);
+			add(s, EV_ABS, ABS_MT_POSITION_X, 1000 + f * 600 + i % 500);
+			add(s, EV_ABS, ABS_MT_POSITION_Y, 2000 + i % 300);
+		}
+		add(s, EV_ABS, ABS_X, 1000 + i % 500);
+		add(s, EV_ABS, ABS_Y, 2000 + i % 300);
+		syn(s);
+	}
+
+	for (int f = NFINGERS - 1; f >= 0; f--)
+	{
+		add(s, EV_ABS, ABS_MT_SLOT, f);
+		add(s, EV_ABS, ABS_MT_TRACKING_ID, -1);
+		if (f < 5)
+		{
+			add(s, EV_KEY, tools[f], 0);
+			if (f > 0)
+				add(s, EV_KEY, tools[f - 1], 1);
+		}
+		if (f == 0)
+			add(s, EV_KEY, BTN_TOUCH, 0);
+		syn(s);
+	}
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Push the stream frame by frame until nframes were processed */
+static unsigned long replay(WacomDevicePtr priv, struct stream *s, unsigned int nframes)
+{
+	int (*parse)(WacomDevicePtr, const struct input_event*, unsigned int, unsigned int*) =
+		priv->common->wcmModel->ParseFrames;
+	unsigned long nevents = 0;
+
+	for (unsigned int i = 0; i < nframes; i++)
+	{
+		unsigned int f = i % s->nframes;
+		unsigned int first = s->frames[f];
+		unsigned int count = s->frames[f + 1] - first;
+		struct input_event *syn = &s->events[first + count - 1];
+		unsigned int n;
+
+		replay_time += s->interval + s->delays[f];
+		syn->input_event_sec = replay_time / 1000000;
+		syn->input_event_usec = replay_time % 1000000;
+
+		parse(priv, &s->events[first], count, &n);
+		nevents += count;
+	}
+
+	return nevents;
+}
+
+static void run(const char *name, const struct fake_node *node,
+		const char **types, void (*generate)(struct stream *),
+		unsigned int nframes)
+{
+	struct stream s = {0};
+	struct replay_device *device = NULL;
+	unsigned long nevents;
+	double start, elapsed;
+
+	for (const char **type = types; *type; type++)
+		device = replay_add_device(node, *type);
+
+	s.frames = calloc(1, sizeof(*s.frames));
+	s.delays = calloc(1, sizeof(*s.delays));
+	generate(&s);
+
+	printf("- replaying %-24s", name);
+	fflush(stdout);
+
+	replay(device->priv, &s, nframes / 10);
+	emitted = 0;
+	start = now_ns();
+	nevents = replay(device->priv, &s, nframes);
+	elapsed = now_ns() - start;
+
+	printf("%10.2f ns/frame %12.0f events/s %10u emitted\n",
+	       elapsed / nframes, nevents / (elapsed / 1e9), emitted);
+
+	replay_remove_devices();
+	free(s.events);
+	free(s.frames);
+	free(s.delays);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *pen_types[] = { "stylus", "eraser", NULL };
+	static const char *pad_types[] = { "pad", NULL };
+	static const char *touch_types[] = { "touch", NULL };
+	unsigned int nframes = REPLAY_FRAMES;
+
+	if (argc > 1)
+		nframes = max(atoi(argv[1]), 1);
+
+	replay_time = (uint64_t)wcmTimeInMicros();
+	sim_clock = wcmSimClockNew(replay_time);
+
+	run("pen", &pen_node, pen_types, pen_stream, nframes);
+	run("pad", &pad_node, pad_types, pad_stream, nframes);
+	run("10-finger touch", &finger_node, touch_types, mt_stream, nframes);
+	run("1-finger tap", &finger_node, touch_types, tap_stream, nframes);
+
+	wcmSimClockFree(sim_clock);
+
+	return 0;
+}
+
+/* vim: set noexpandtab tabstop=8 shiftwidth=8: */
@@ -22,18 +22,53 @@
 #endif
 
 #include <config.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include "wacom-test-suite.h"
 
+#define BENCH_ITERATIONS 1000000
+#define BENCH_SAMPLES 100
+
 void wcm_run_tests(void);
+void wcm_run_benchmarks(unsigned int iterations, const char *filter);
 
 extern const struct test_case_decl __start_test_section;
 extern const struct test_case_decl __stop_test_section;
+/* weak: a binary with tests may not have any benchmarks */
+extern const struct bench_case_decl __start_bench_section __attribute__((weak));
+extern const struct bench_case_decl __stop_bench_section __attribute__((weak));
 
 /* This one needs to be defined for dlopen to be able to load our test module,
  * RTLD_LAZY only applies to functions. */
 void *serverClient;
 
+#ifdef HAVE_TEST_IOCTL
+int (*wcm_test_ioctl)(int fd, unsigned long request, void *arg);
+
+/* hidden, so the driver's own calls bind to it rather than to libc's */
+__attribute__((visibility("hidden")))
+int ioctl(int fd, unsigned long request, ...)
+{
+	va_list args;
+	void *arg;
+
+	va_start(args, request);
+	arg = va_arg(args, void*);
+	va_end(args);
+
+	if (wcm_test_ioctl)
+		return wcm_test_ioctl(fd, request, arg);
+
+	return syscall(SYS_ioctl, fd, request, arg);
+}
+#endif
+
 /* The entry point: iterate through the tests and run them one-by-one. Any
  * test that doesn't assert is considered successful.
  */
@@ -47,3 +82,60 @@ void wcm_run_tests(void) {
 		printf("SUCCCESS\n");
 	}
 }
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double da = *(const double*)a, db = *(const double*)b;
+
+	return (da > db) - (da < db);
+}
+
+/* Run each benchmark matching the filter once for warm-up, then in
+ * BENCH_SAMPLES timed slices. iterations is the total for a BENCH_CASE,
+ * or 0 for BENCH_ITERATIONS. */
+void wcm_run_benchmarks(unsigned int iterations, const char *filter) {
+
+	const struct bench_case_decl *b;
+	double scale = iterations ? (double)iterations / BENCH_ITERATIONS : 1.0;
+
+	/* the weak section symbols are NULL without any BENCH_CASE */
+	if (!&__start_bench_section)
+		return;
+
+	for (b = &__start_bench_section; b < &__stop_bench_section; b++) {
+		double samples[BENCH_SAMPLES];
+		unsigned int total, slice;
+
+		if (filter && !strstr(b->name, filter))
+			continue;
+
+		total = (b->iterations ? b->iterations : BENCH_ITERATIONS) * scale;
+		slice = total / BENCH_SAMPLES;
+		if (slice == 0)
+			slice = 1;
+
+		printf("- running %-32s", b->name);
+		fflush(stdout);
+		b->func(total / 10 ? total / 10 : 1);
+
+		for (int i = 0; i < BENCH_SAMPLES; i++) {
+			double start = now_ns();
+
+			b->func(slice);
+			samples[i] = (now_ns() - start) / slice;
+		}
+
+		qsort(samples, BENCH_SAMPLES, sizeof(*samples), cmp_double);
+		printf("min %10.2f ns  median %10.2f ns  p99 %10.2f ns\n",
+		       samples[0], samples[BENCH_SAMPLES / 2],
+		       samples[(BENCH_SAMPLES * 99 + 99) / 100 - 1]);
+	}
+}
@@ -52,6 +52,72 @@ struct test_case_decl {
         }; \
         static void (tname)(void)
 
+struct bench_case_decl {
+	const char *name;
+	void (*func)(unsigned int iterations);
+	unsigned int iterations; /* 0 for the runner's default */
+};
+
+/**
+ * Benchmarks work like test cases but live in the "bench_section" and
+ * are run by wcm_run_benchmarks(). The function runs its workload
+ * "iterations" times. The runner warms up, then calls it repeatedly with
+ * a slice of the total iterations and reports the min, median and 99th
+ * percentile of the time per iteration over all calls.
+ */
+#define BENCH_CASE(bname) BENCH_CASE_ITERATIONS(bname, 0)
+
+/**
+ * A benchmark whose workload is too expensive for the default number of
+ * iterations, the runner's --iterations scales it by the same factor.
+ */
+#define BENCH_CASE_ITERATIONS(bname, niterations) \
+        static void (bname)(unsigned int iterations); \
+        static const struct bench_case_decl _decl_##bname \
+        attr_no_sanitize_address \
+        __attribute__((used)) \
+        __attribute__((aligned(sizeof(void*)))) /* no padding in the section */ \
+        __attribute((section("bench_section"))) = { \
+           .name = #bname, \
+           .func = bname, \
+           .iterations = niterations, \
+        }; \
+        static void (bname)(unsigned int iterations)
+
+/**
+ * Keep the compiler from optimizing away a benchmarked result.
+ */
+#define bench_keep(value_) \
+        __asm__ volatile("" : : "g"(value_) : "memory")
+
+#ifdef __GLIBC__
+/**
+ * The test module overrides ioctl(), a test may set this to answer the
+ * driver's ioctls instead of the kernel. Only available with glibc, whose
+ * ioctl() prototype the override matches.
+ */
+#define HAVE_TEST_IOCTL 1
+extern int (*wcm_test_ioctl)(int fd, unsigned long request, void *arg);
+#endif
+
+/**
+ * The driver's test module replaces the server's xf86Post*Event()
+ * functions, the events the frontend posted are recorded here in order.
+ */
+struct wcm_test_post {
+	int type;		/* enum WacomFrameEventType */
+	int code;		/* button number or keycode */
+	int state;		/* in proximity or pressed */
+	int is_absolute;
+	int nvaluators;
+	unsigned int valuator_mask; /* bit n set: valuators[n] is valid */
+	int valuators[8];
+};
+
+#define WCM_TEST_MAX_POSTS 64
+extern struct wcm_test_post wcm_test_posts[WCM_TEST_MAX_POSTS];
+extern unsigned int wcm_test_nposts;
+
 
 /**
  * These may be called by a test function - #define them so they are always
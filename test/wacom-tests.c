@@ -20,28 +20,70 @@
 
 #include <assert.h>
 #include <dlfcn.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define TESTDRV "wacom_drv_test.so"
 #define TESTFUNC "wcm_run_tests"
+#define BENCHFUNC "wcm_run_benchmarks"
 
-int main(void) {
-	void *handle = dlopen(TESTDRV, RTLD_LAZY);
-	void (*func)(void);
+static void usage(void)
+{
+	printf("Usage: wacom-tests [--benchmark [--iterations=N] [NAME]]\n");
+	printf("\n");
+	printf("Runs all test cases or, with --benchmark, all benchmarks whose\n"
+	       "name contains NAME. N is the total number of iterations of a\n"
+	       "benchmark, default 1000000, expensive benchmarks are scaled down\n"
+	       "by the same factor.\n");
+}
+
+int main(int argc, char **argv) {
+	void *handle;
+	bool benchmark = false;
+	unsigned int iterations = 0;
+	const char *filter = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--benchmark") == 0)
+			benchmark = true;
+		else if (benchmark && strncmp(argv[i], "--iterations=", 13) == 0)
+			iterations = strtoul(argv[i] + 13, NULL, 10);
+		else if (benchmark && argv[i][0] != '-' && !filter)
+			filter = argv[i];
+		else {
+			usage();
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
 
+	handle = dlopen(TESTDRV, RTLD_LAZY);
 	if (handle == NULL) {
 		fprintf(stderr, "Failed to open %s: %s\n", TESTDRV, dlerror());
 		fprintf(stderr, "This test suite relies on dlopen(RTLD_LAZY) which may be disabled by your compiler/linker flags\n");
 		return 77;
 	}
 
-	func = dlsym(handle, TESTFUNC);
-	if (func == NULL) {
-		fprintf(stderr, "Failed to load %s: %s\n", TESTFUNC, dlerror());
-		return 1;
-	}
+	if (benchmark) {
+		void (*func)(unsigned int iterations, const char *filter);
+
+		func = dlsym(handle, BENCHFUNC);
+		if (func == NULL) {
+			fprintf(stderr, "Failed to load %s: %s\n", BENCHFUNC, dlerror());
+			return 1;
+		}
+		func(iterations, filter);
+	} else {
+		void (*func)(void);
 
-	func();
+		func = dlsym(handle, TESTFUNC);
+		if (func == NULL) {
+			fprintf(stderr, "Failed to load %s: %s\n", TESTFUNC, dlerror());
+			return 1;
+		}
+		func();
+	}
 
 	return 0;
 }
@@ -22,6 +22,7 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "wcmPressureCurve.h"
 
@@ -34,7 +35,38 @@ usage(void) {
 	       "The output contains one line with input pressure and output pressure for\n"
 	       "each normalized [0.0, 1.0] input pressure value\n"
 	       "\n"
-	       "Multiple sets of 4 coordinates may be given \n");
+	       "Multiple sets of 4 coordinates may be given \n"
+	       "\n"
+	       "Options:\n"
+	       "  --benchmark  time building the driver's full-resolution curve\n");
+}
+
+/* Build the curve the way the driver does for a full-resolution device
+ * and print the average time per build */
+static int
+benchmark(double x1, double y1, double x2, double y2)
+{
+	const int nmax = 65536; /* FILTER_PRESSURE_RES */
+	const int iterations = 1000;
+	struct timespec start, end;
+	double elapsed;
+	int *curve = calloc(nmax + 1, sizeof(*curve));
+
+	if (!curve)
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < iterations; i++)
+		filterCurveToLine(curve, nmax, 0.0, 0.0, x1, y1, x2, y2, 1.0, 1.0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) * 1e6 +
+		  (end.tv_nsec - start.tv_nsec) / 1e3;
+	printf("%f/%f %f/%f: %.1f us per curve\n", x1, y1, x2, y2,
+	       elapsed / iterations);
+
+	free(curve);
+	return 0;
 }
 
 int main(int argc, char **argv)
@@ -54,12 +86,15 @@ int main(int argc, char **argv)
 
 	enum {
 		OPT_HELP,
+		OPT_BENCHMARK,
 	};
 
 	static struct option long_options[] = {
 		{"help", no_argument, 0, OPT_HELP},
+		{"benchmark", no_argument, 0, OPT_BENCHMARK},
 		{0, 0, 0, 0},
 	};
+	int do_benchmark = 0;
 
 	int c;
 	while (1)
@@ -73,23 +108,45 @@ int main(int argc, char **argv)
 		case OPT_HELP:
 			usage();
 			return 0;
+		case OPT_BENCHMARK:
+			do_benchmark = 1;
+			break;
 		default:
 			break;
 		}
 	}
 
+	/* both the plot and the benchmark consume the coordinates in sets of 4 */
 	if (optind + 4 > argc || (argc - optind) % 4 != 0) {
+		fprintf(stderr, "Expected sets of 4 coordinates, got %d values.\n\n",
+			argc - optind);
 		usage();
 		return 1;
+	}
 
+	if (do_benchmark)
+	{
+		int rc = 0;
+
+		while (optind + 4 <= argc && rc == 0)
+		{
+			double x1 = atof(argv[optind++]);
+			double y1 = atof(argv[optind++]);
+			double x2 = atof(argv[optind++]);
+			double y2 = atof(argv[optind++]);
+
+			rc = benchmark(x1, y1, x2, y2);
+		}
+		return rc;
 	}
 
 	size_t ncurves = (argc - optind) / 4;
-	int curve[ncurves][npoints];
+	/* filterCurveToLine() fills the entries 0 to npoints inclusive */
+	int curve[ncurves][npoints + 1];
 	int idx = 0;
 
 	printf("# column 0: input pressure value [0,1]\n");
-	while (optind < argc)
+	while (optind + 4 <= argc)
 	{
 		double x1 = atof(argv[optind++]);
 		double y1 = atof(argv[optind++]);
@@ -20,22 +20,35 @@
 #include "config-ver.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <glib.h>
 #include <glib-unix.h>
 #include <libudev.h>
 #include <libevdev/libevdev.h>
 #include "wacom-driver.h"
 #include "wacom-device.h"
+#include "wacom-capture.h"
 
 #define strbool(x_)  (x_) ? "true" : "false"
 
+/* Captures are written and read in chunks of this size */
+#define CAPTURE_BUFSIZE (1024 * 1024)
+
 static guint debug_level = 0;
 static gboolean print_version = false;
 static gboolean grab_device = false;
 static gboolean log_evdev = false;
 static const char *driver_options = NULL;
+static const char *capture_path = NULL;
+static const char *convert_path = NULL;
+
+static FILE *capture = NULL;
+static gboolean capture_failed = false;
+static GMainLoop *main_loop = NULL;
 
 static GOptionEntry opts[] =
 {
@@ -44,17 +57,58 @@ static GOptionEntry opts[] =
 	{ "options", 0, 0, G_OPTION_ARG_STRING, &driver_options, "Driver options in the form \"Foo=bar,Baz=bat\"", NULL },
 	{ "grab", 0, 0, G_OPTION_ARG_NONE, &grab_device, "Grab the device while recording", NULL },
 	{ "evdev", 0, 0, G_OPTION_ARG_NONE, &log_evdev, "Log evdev events", NULL },
+	{ "capture", 0, 0, G_OPTION_ARG_FILENAME, &capture_path, "Write a binary capture including evdev events to FILE instead of YAML", "FILE" },
+	{ "convert", 0, 0, G_OPTION_ARG_FILENAME, &convert_path, "Convert the binary capture FILE to YAML and exit", "FILE" },
 	{ 0 },
 };
 
+static void capture_write(enum wacom_capture_kind kind, guint source,
+			  const void *payload, size_t length)
+{
+	struct wacom_capture_record record = {
+		.length = length,
+		.kind = kind,
+		.source = source,
+		.time = g_get_monotonic_time(),
+	};
+
+	if (capture_failed)
+		return;
+
+	/* A full buffer is written out in one go by stdio */
+	if (fwrite(&record, sizeof(record), 1, capture) != 1 ||
+	    (length && fwrite(payload, length, 1, capture) != 1)) {
+		fprintf(stderr, "%s: %s, stopping the capture\n", capture_path, strerror(errno));
+		capture_failed = true;
+		if (main_loop)
+			g_main_loop_quit(main_loop);
+	}
+}
+
+/* Anything that isn't an event goes to the capture as YAML text */
+G_GNUC_PRINTF(1, 2)
+static void output(const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	if (capture) {
+		g_autofree char *text = g_strdup_vprintf(format, args);
+		capture_write(WACOM_CAPTURE_TEXT, 0, text, strlen(text));
+	} else {
+		vprintf(format, args);
+	}
+	va_end(args);
+}
+
 static void log_message(WacomDevice *device, const char *type, const char *message)
 {
-	printf("# [%s] %s: %s", type, wacom_device_get_name(device), message);
+	output("# [%s] %s: %s", type, wacom_device_get_name(device), message);
 }
 
 static void debug_message(WacomDevice *device, int debug_level, const char *func, const char *message)
 {
-	printf("# DBG%02d %-35s| %s: %s", debug_level, func, wacom_device_get_name(device), message);
+	output("# DBG%02d %-35s| %s: %s", debug_level, func, wacom_device_get_name(device), message);
 }
 
 static inline void print_axes(const WacomEventData *data)
@@ -100,49 +154,49 @@ static inline void print_axes(const WacomEventData *data)
 	       (data->mask & WAXIS_RING2) ? data->ring2 : 0);
 }
 
-static void proximity(WacomDevice *device, gboolean is_prox_in, WacomEventData *data)
+static void print_proximity(guint source, gboolean is_prox_in, const WacomEventData *data)
 {
 	printf("    - source: %u\n"
 	       "      event: proximity\n"
 	       "      proximity-in: %s\n",
-	       wacom_device_get_id(device), strbool(is_prox_in));
+	       source, strbool(is_prox_in));
 	print_axes(data);
 }
 
-static void motion(WacomDevice *device, gboolean is_absolute, WacomEventData *data)
+static void print_motion(guint source, gboolean is_absolute, const WacomEventData *data)
 {
 	printf("    - source: %u\n"
 	       "      mode: %s\n"
 	       "      event: motion\n",
-	       wacom_device_get_id(device),
+	       source,
 	       is_absolute ? "absolute" : "relative");
 	print_axes(data);
 }
 
-static void button(WacomDevice *device, gboolean is_absolute, int button,
-		   gboolean is_press, WacomEventData *data)
+static void print_button(guint source, int button, gboolean is_press,
+			 const WacomEventData *data)
 {
 	printf("    - source: %u\n"
 	       "      event: button\n"
 	       "      button: %d\n"
 	       "      is-press: %s\n",
-	       wacom_device_get_id(device), button, strbool(is_press));
+	       source, button, strbool(is_press));
 	print_axes(data);
 }
 
-static void key(WacomDevice *device, gboolean keycode, gboolean is_press)
+static void print_key(guint source, int keycode, gboolean is_press)
 {
 	printf("    - source: %u\n"
 	       "      event: key\n"
 	       "      key: %d\n"
-	       "      is-press: %s\n", wacom_device_get_id(device),
+	       "      is-press: %s\n", source,
 	       keycode, strbool(is_press));
 }
 
-static void evdev(WacomDevice *device, const struct input_event *evdev)
+static void print_evdev(guint source, const struct input_event *evdev)
 {
 	printf("    - { source: %u, event: evdev, data: [%6ld, %6ld, %3d, %3d, %10d] } # %s / %-20s %5d\n",
-	       wacom_device_get_id(device),
+	       source,
 	       evdev->input_event_sec,
 	       evdev->input_event_usec,
 	       evdev->type,
@@ -154,20 +208,124 @@ static void evdev(WacomDevice *device, const struct input_event *evdev)
 	);
 }
 
+static void capture_event(WacomDevice *device, enum wacom_capture_kind kind,
+			  int a, int b, const WacomEventData *data)
+{
+	struct wacom_capture_event event = {
+		.a = a,
+		.b = b,
+	};
+
+	if (data) {
+		event.mask = data->mask;
+		event.x = data->x;
+		event.y = data->y;
+		event.pressure = data->pressure;
+		event.tilt_x = data->tilt_x;
+		event.tilt_y = data->tilt_y;
+		event.rotation = data->rotation;
+		event.throttle = data->throttle;
+		event.wheel = data->wheel;
+		event.ring = data->ring;
+		event.ring2 = data->ring2;
+	}
+
+	capture_write(kind, wacom_device_get_id(device), &event, sizeof(event));
+}
+
+static void proximity(WacomDevice *device, gboolean is_prox_in, WacomEventData *data)
+{
+	if (capture)
+		capture_event(device, WACOM_CAPTURE_PROXIMITY, is_prox_in, 0, data);
+	else
+		print_proximity(wacom_device_get_id(device), is_prox_in, data);
+}
+
+static void motion(WacomDevice *device, gboolean is_absolute, WacomEventData *data)
+{
+	if (capture)
+		capture_event(device, WACOM_CAPTURE_MOTION, is_absolute, 0, data);
+	else
+		print_motion(wacom_device_get_id(device), is_absolute, data);
+}
+
+static void button(WacomDevice *device, gboolean is_absolute, int button,
+		   gboolean is_press, WacomEventData *data)
+{
+	if (capture)
+		capture_event(device, WACOM_CAPTURE_BUTTON, button, is_press, data);
+	else
+		print_button(wacom_device_get_id(device), button, is_press, data);
+}
+
+static void key(WacomDevice *device, gboolean keycode, gboolean is_press)
+{
+	if (capture)
+		capture_event(device, WACOM_CAPTURE_KEY, keycode, is_press, NULL);
+	else
+		print_key(wacom_device_get_id(device), keycode, is_press);
+}
+
+/* Write the events collected for the device's current frame */
+static void capture_flush_frame(WacomDevice *device)
+{
+	GArray *frame = g_object_get_data(G_OBJECT(device), "capture-frame");
+
+	if (!frame || frame->len == 0)
+		return;
+
+	capture_write(WACOM_CAPTURE_FRAME, wacom_device_get_id(device),
+		      frame->data, frame->len * sizeof(struct wacom_capture_evdev));
+	g_array_set_size(frame, 0);
+}
+
+/* Events are collected per device and written as one record per frame.
+ * The signal fires before the driver processes the event, so the frame
+ * is written before anything the driver emits for it. */
+static void capture_evdev(WacomDevice *device, const struct input_event *evdev)
+{
+	GArray *frame = g_object_get_data(G_OBJECT(device), "capture-frame");
+	struct wacom_capture_evdev e = {
+		.sec = evdev->input_event_sec,
+		.usec = evdev->input_event_usec,
+		.type = evdev->type,
+		.code = evdev->code,
+		.value = evdev->value,
+	};
+
+	if (!frame) {
+		frame = g_array_sized_new(FALSE, FALSE, sizeof(e), 64);
+		g_object_set_data_full(G_OBJECT(device), "capture-frame", frame,
+				       (GDestroyNotify)g_array_unref);
+	}
+
+	g_array_append_val(frame, e);
+	if (evdev->type == EV_SYN && evdev->code == SYN_REPORT)
+		capture_flush_frame(device);
+}
+
+static void evdev(WacomDevice *device, const struct input_event *evdev)
+{
+	if (capture)
+		capture_evdev(device, evdev);
+	else
+		print_evdev(wacom_device_get_id(device), evdev);
+}
+
 static void device_added(WacomDriver *driver, WacomDevice *device)
 {
 	WacomOptions *options = wacom_device_get_options(device);
 	GSList *opts = wacom_options_list_keys(options);
 
-	printf("    - source: %u\n"
+	output("    - source: %u\n"
 	       "      event: new-device\n"
 	       "      name: \"%s\"\n",
 	       wacom_device_get_id(device), wacom_device_get_name(device));
 
-	printf("      options:\n");
+	output("      options:\n");
 	for (guint i = 0; i < g_slist_length(opts); i++) {
 		gchar *key = g_slist_nth_data(opts, i);
-		printf("      - %s: \"%s\"\n", key, wacom_options_get(options, key));
+		output("      - %s: \"%s\"\n", key, wacom_options_get(options, key));
 	}
 
 	g_slist_free_full(g_steal_pointer(&opts), g_free);
@@ -178,7 +336,7 @@ static void device_added(WacomDriver *driver, WacomDevice *device)
 	g_signal_connect(device, "proximity", G_CALLBACK(proximity), NULL);
 	g_signal_connect(device, "button", G_CALLBACK(button), NULL);
 	g_signal_connect(device, "keycode", G_CALLBACK(key), NULL);
-	if (log_evdev)
+	if (log_evdev || capture)
 		g_signal_connect(device, "evdev-event", G_CALLBACK(evdev), NULL);
 
 	if (!wacom_device_preinit(device))
@@ -200,8 +358,8 @@ static void device_added(WacomDriver *driver, WacomDevice *device)
 
 		}
 
-		printf("      type: %s\n", typestr);
-		printf("      capabilities:\n"
+		output("      type: %s\n", typestr);
+		output("      capabilities:\n"
 		       "        keys: %s\n"
 		       "        is-absolute: %s\n"
 		       "        is-direct-touch: %s\n"
@@ -212,7 +370,7 @@ static void device_added(WacomDriver *driver, WacomDevice *device)
 		       strbool(wacom_device_is_direct_touch(device)),
 		       wacom_device_get_num_touches(device),
 		       wacom_device_get_num_axes(device));
-		printf("        axes:\n");
+		output("        axes:\n");
 		for (WacomEventAxis which = WAXIS_X; which <= _WAXIS_LAST; which <<= 1) {
 			const WacomAxis *axis = wacom_device_get_axis(device, which);
 			const char *typestr = NULL;
@@ -237,7 +395,7 @@ static void device_added(WacomDriver *driver, WacomDevice *device)
 				case WAXIS_SCROLL_Y: typestr = "scroll_y"; break;
 			}
 
-			printf("          - {type: %-12s, range: [%5d, %5d], resolution: %5d}\n",
+			output("          - {type: %-12s, range: [%5d, %5d], resolution: %5d}\n",
 			       typestr, axis->min, axis->max, axis->res);
 
 		}
@@ -250,7 +408,7 @@ static void device_added(WacomDriver *driver, WacomDevice *device)
 
 static void device_removed(WacomDriver *driver, WacomDevice *device)
 {
-	printf("    - source: %u\n"
+	output("    - source: %u\n"
 	       "      event: removed-device\n"
 	       "      name: \"%s\"\n",
 	       wacom_device_get_id(device), wacom_device_get_name(device));
@@ -331,6 +489,138 @@ static gboolean cb_sigint(gpointer loop)
 	return FALSE;
 }
 
+static void convert_event(const struct wacom_capture_record *record,
+			  const struct wacom_capture_event *event)
+{
+	const WacomEventData data = {
+		.mask = event->mask,
+		.x = event->x,
+		.y = event->y,
+		.pressure = event->pressure,
+		.tilt_x = event->tilt_x,
+		.tilt_y = event->tilt_y,
+		.rotation = event->rotation,
+		.throttle = event->throttle,
+		.wheel = event->wheel,
+		.ring = event->ring,
+		.ring2 = event->ring2,
+	};
+
+	switch (record->kind) {
+	case WACOM_CAPTURE_PROXIMITY:
+		print_proximity(record->source, event->a, &data);
+		break;
+	case WACOM_CAPTURE_MOTION:
+		print_motion(record->source, event->a, &data);
+		break;
+	case WACOM_CAPTURE_BUTTON:
+		print_button(record->source, event->a, event->b, &data);
+		break;
+	case WACOM_CAPTURE_KEY:
+		print_key(record->source, event->a, event->b);
+		break;
+	}
+}
+
+static void convert_frame(const struct wacom_capture_record *record,
+			  const struct wacom_capture_evdev *events)
+{
+	for (size_t i = 0; i < record->length / sizeof(*events); i++) {
+		struct input_event evdev = {
+			.type = events[i].type,
+			.code = events[i].code,
+			.value = events[i].value,
+		};
+
+		evdev.input_event_sec = events[i].sec;
+		evdev.input_event_usec = events[i].usec;
+		print_evdev(record->source, &evdev);
+	}
+}
+
+/* Print a capture as the YAML the live recording would have printed */
+static int convert(const char *path)
+{
+	g_autofree char *payload = g_malloc(CAPTURE_BUFSIZE);
+	struct wacom_capture_header header;
+	struct wacom_capture_record record;
+	FILE *f = fopen(path, "rb");
+	size_t n;
+	int rc = 1;
+
+	if (!f) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	setvbuf(f, NULL, _IOFBF, CAPTURE_BUFSIZE);
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, WACOM_CAPTURE_MAGIC, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "%s: not a wacom-record capture\n", path);
+		goto out;
+	}
+
+	if (header.version != WACOM_CAPTURE_VERSION) {
+		fprintf(stderr, "%s: unsupported version %u\n", path, header.version);
+		goto out;
+	}
+
+	while ((n = fread(&record, 1, sizeof(record), f)) == sizeof(record)) {
+		gboolean valid = record.length <= CAPTURE_BUFSIZE;
+
+		switch (record.kind) {
+		case WACOM_CAPTURE_FRAME:
+			valid &= record.length % sizeof(struct wacom_capture_evdev) == 0;
+			break;
+		case WACOM_CAPTURE_PROXIMITY:
+		case WACOM_CAPTURE_MOTION:
+		case WACOM_CAPTURE_BUTTON:
+		case WACOM_CAPTURE_KEY:
+			valid &= record.length == sizeof(struct wacom_capture_event);
+			break;
+		}
+
+		if (!valid) {
+			fprintf(stderr, "%s: invalid record of kind %u, length %u\n",
+				path, record.kind, record.length);
+			goto out;
+		}
+
+		if (record.length && fread(payload, record.length, 1, f) != 1) {
+			n = 1;
+			break;
+		}
+
+		switch (record.kind) {
+		case WACOM_CAPTURE_TEXT:
+			fwrite(payload, record.length, 1, stdout);
+			break;
+		case WACOM_CAPTURE_FRAME:
+			convert_frame(&record, (struct wacom_capture_evdev *)payload);
+			break;
+		case WACOM_CAPTURE_PROXIMITY:
+		case WACOM_CAPTURE_MOTION:
+		case WACOM_CAPTURE_BUTTON:
+		case WACOM_CAPTURE_KEY:
+			convert_event(&record, (struct wacom_capture_event *)payload);
+			break;
+		default:
+			printf("# unknown record of kind %u\n", record.kind);
+			break;
+		}
+	}
+
+	/* A capture ends between records, anything else was cut off */
+	if (n != 0 || ferror(f)) {
+		fprintf(stderr, "%s: truncated capture\n", path);
+		goto out;
+	}
+
+	rc = 0;
+out:
+	fclose(f);
+	return rc;
+}
 
 int main(int argc, char **argv)
 {
@@ -353,6 +643,9 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	if (convert_path)
+		return convert(convert_path);
+
 	if (argc <= 1) {
 		autopath = find_device();
 		if (!autopath) {
@@ -361,9 +654,28 @@ int main(int argc, char **argv)
 		}
 	}
 
-	printf("wacom-record:\n");
-	printf("  version: %s\n", PACKAGE_VERSION);
-	printf("  git: %s\n", BUILD_VERSION);
+	if (capture_path) {
+		struct wacom_capture_header header = {
+			.version = WACOM_CAPTURE_VERSION,
+		};
+
+		capture = fopen(capture_path, "wb");
+		if (!capture) {
+			fprintf(stderr, "%s: %s\n", capture_path, strerror(errno));
+			return 1;
+		}
+		memcpy(header.magic, WACOM_CAPTURE_MAGIC, sizeof(header.magic));
+		setvbuf(capture, NULL, _IOFBF, CAPTURE_BUFSIZE);
+		if (fwrite(&header, sizeof(header), 1, capture) != 1) {
+			fprintf(stderr, "%s: %s\n", capture_path, strerror(errno));
+			fclose(capture);
+			return 1;
+		}
+	}
+
+	output("wacom-record:\n");
+	output("  version: %s\n", PACKAGE_VERSION);
+	output("  git: %s\n", BUILD_VERSION);
 
 	driver = wacom_driver_new();
 	options	= wacom_options_new(NULL, NULL);
@@ -388,7 +700,7 @@ int main(int argc, char **argv)
 		}
 	}
 
-	printf("  events:\n");
+	output("  events:\n");
 
 	g_signal_connect(driver, "device-added", G_CALLBACK(device_added), NULL);
 	g_signal_connect(driver, "device-removed", G_CALLBACK(device_removed), NULL);
@@ -414,8 +726,26 @@ int main(int argc, char **argv)
 
 
 	loop = g_main_loop_new(NULL, FALSE);
+	main_loop = loop;
 	g_unix_signal_add(SIGINT, cb_sigint, loop);
-	g_main_loop_run(loop);
+	if (!capture_failed)
+		g_main_loop_run(loop);
+	main_loop = NULL;
+
+	if (capture) {
+		g_autoptr(GList) devices = wacom_driver_get_devices(driver);
+
+		/* Keep the events of the frames cut off by the exit */
+		for (GList *l = devices; l; l = l->next)
+			capture_flush_frame(l->data);
+
+		if (fclose(capture) != 0) {
+			fprintf(stderr, "%s: %s\n", capture_path, strerror(errno));
+			return 1;
+		}
+		if (capture_failed)
+			return 1;
+	}
 
 	return 0;
 }
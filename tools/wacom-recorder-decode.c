@@ -0,0 +1,209 @@
+/*
+ * Copyright 2024 by the xf86-input-wacom contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* Converts a flight recorder dump into the YAML format of wacom-record */
+
+#include <config.h>
+#include "config-ver.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libevdev/libevdev.h>
+
+#include "wacom-recorder.h"
+
+#define strbool(x_)  (x_) ? "true" : "false"
+
+static const char *device_type_name(int type)
+{
+	switch (type) {
+	case WACOM_RECORD_STYLUS: return "stylus";
+	case WACOM_RECORD_TOUCH: return "touch";
+	case WACOM_RECORD_CURSOR: return "cursor";
+	case WACOM_RECORD_ERASER: return "eraser";
+	case WACOM_RECORD_PAD: return "pad";
+	}
+	return "unknown";
+}
+
+static const char *suppress_name(int suppress)
+{
+	switch (suppress) {
+	case WACOM_RECORD_SUPPRESS_NONE: return "none";
+	case WACOM_RECORD_SUPPRESS_ALL: return "all";
+	case WACOM_RECORD_SUPPRESS_NON_MOTION: return "non-motion";
+	}
+	return "unknown";
+}
+
+/* libevdev doesn't know the names of all types and codes */
+static const char *event_type_name(int type)
+{
+	const char *name = libevdev_event_type_get_name(type);
+
+	return name ? name : "?";
+}
+
+static const char *event_code_name(int type, int code)
+{
+	const char *name = libevdev_event_code_get_name(type, code);
+
+	return name ? name : "?";
+}
+
+static void print_channel(const struct wacom_record *r)
+{
+	if (r->channel == WACOM_RECORD_NO_CHANNEL)
+		printf("channel: null");
+	else
+		printf("channel: %2u", r->channel);
+}
+
+static void print_state(const char *event, uint64_t time, const struct wacom_record *r)
+{
+	printf("    - { source: 0, event: %s, time: %10" PRIu64 ", ", event, time);
+	print_channel(r);
+	printf(", type: %s, proximity: %s, axes: { x: %5d, y: %5d, pressure: %4d, tilt: [%3d,%3d] }, buttons: 0x%x }\n",
+	       device_type_name(r->flags >> WACOM_RECORD_TYPE_SHIFT),
+	       strbool(r->flags & WACOM_RECORD_FLAG_PROXIMITY),
+	       r->v[0], r->v[1], r->v[2], r->v[3], r->v[4], (unsigned int)r->v[5]);
+}
+
+static void print_record(uint64_t time, const struct wacom_record *r)
+{
+	switch (r->kind) {
+	case WACOM_RECORD_EVDEV:
+		printf("    - { source: 0, event: evdev, time: %10" PRIu64 ", data: [%6d, %6d, %3d, %3d, %10d] } # %s / %-20s %5d\n",
+		       time, r->v[0], r->v[1], r->v[2], r->v[3], r->v[4],
+		       event_type_name(r->v[2]),
+		       event_code_name(r->v[2], r->v[3]),
+		       r->v[4]);
+		break;
+	case WACOM_RECORD_CHANNEL:
+		printf("    - { source: 0, event: channel, time: %10" PRIu64 ", ", time);
+		print_channel(r);
+		printf(", type: %s, serial: 0x%x, id: 0x%x, proximity: %s }\n",
+		       device_type_name(r->v[0]), (unsigned int)r->v[1],
+		       (unsigned int)r->v[2], strbool(r->v[3]));
+		break;
+	case WACOM_RECORD_FILTER:
+		print_state("filter", time, r);
+		break;
+	case WACOM_RECORD_SUPPRESS:
+		printf("    - { source: 0, event: suppress, time: %10" PRIu64 ", ", time);
+		print_channel(r);
+		printf(", suppress: %s }\n", suppress_name(r->v[0]));
+		break;
+	case WACOM_RECORD_EMIT:
+		print_state("emit", time, r);
+		break;
+	default:
+		printf("    - { source: 0, event: unknown, time: %10" PRIu64 ", kind: %u }\n",
+		       time, r->kind);
+		break;
+	}
+}
+
+static int decode(FILE *f, const char *path)
+{
+	struct wacom_recorder_header header;
+	struct wacom_record r;
+	uint64_t time = 0;
+	uint32_t last = 0;
+
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, WACOM_RECORDER_MAGIC, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "%s: not a flight recorder dump\n", path);
+		return 1;
+	}
+
+	if (header.version != WACOM_RECORDER_VERSION ||
+	    header.record_size != sizeof(r)) {
+		fprintf(stderr, "%s: unsupported version %u (record size %u)\n",
+			path, header.version, header.record_size);
+		return 1;
+	}
+
+	printf("wacom-record:\n");
+	printf("  version: %s\n", PACKAGE_VERSION);
+	printf("  git: %s\n", BUILD_VERSION);
+	printf("  flight-recorder:\n");
+	printf("    vendor: 0x%04x\n", header.vendor_id);
+	printf("    product: 0x%04x\n", header.product_id);
+	printf("    records: %u\n", header.count);
+	printf("    lost: %u\n", header.lost);
+	printf("  events:\n");
+
+	/* Times are printed in us since the first record */
+	for (uint32_t i = 0; i < header.count; i++) {
+		if (fread(&r, sizeof(r), 1, f) != 1) {
+			fprintf(stderr, "%s: truncated after %u records\n", path, i);
+			return 1;
+		}
+
+		if (i > 0)
+			time += (uint32_t)(r.time - last);
+		last = r.time;
+
+		print_record(time, &r);
+	}
+
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: wacom-recorder-decode [FILE]\n");
+	printf("\n");
+	printf("Converts a dump of the driver's flight recorder into YAML.\n"
+	       "The dump is created by writing 1 to the \"Wacom Flight Recorder\"\n"
+	       "property of the device, the driver logs the file name.\n"
+	       "Reads from stdin if no file is given.\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "<stdin>";
+	FILE *f = stdin;
+	int rc;
+
+	if (argc > 2 || (argc == 2 && (strcmp(argv[1], "--help") == 0 ||
+				       strcmp(argv[1], "-h") == 0))) {
+		usage();
+		return argc > 2;
+	}
+
+	if (argc == 2) {
+		path = argv[1];
+		f = fopen(path, "rb");
+		if (!f) {
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			return 1;
+		}
+	}
+
+	rc = decode(f, path);
+
+	if (f != stdin)
+		fclose(f);
+
+	return rc;
+}
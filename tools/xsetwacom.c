@@ -112,6 +112,8 @@ static int get_mode(Display *dpy, XDevice *dev, param_t *param, int argc, char *
 static int get_map(Display *dpy, XDevice *dev, param_t *param, int argc, char **argv);
 static int set_rotate(Display *dpy, XDevice *dev, param_t *param, int argc, char **argv);
 static int get_rotate(Display *dpy, XDevice *dev, param_t *param, int argc, char **argv);
+static int set_filter(Display *dpy, XDevice *dev, param_t *param, int argc, char **argv);
+static int get_filter(Display *dpy, XDevice *dev, param_t *param, int argc, char **argv);
 static int set_xydefault(Display *dpy, XDevice *dev, param_t *param, int argc, char **argv);
 static int get_all(Display *dpy, XDevice *dev, param_t *param, int argc, char **argv);
 static int get_param(Display *dpy, XDevice *dev, param_t *param, int argc, char **argv);
@@ -179,6 +181,108 @@ static param_t parameters[] =
 		.prop_offset = 1,
 		.arg_count = 1,
 	},
+	{
+		.name = "SuppressPosition",
+		.x11name = "SuppressPosition",
+		.desc = "Suppress threshold for movement in x/y "
+		"(default depends on the device, 0 uses Suppress). ",
+		.prop_name = WACOM_PROP_SAMPLE,
+		.prop_format = 32,
+		.prop_offset = 2,
+		.arg_count = 1,
+	},
+	{
+		.name = "SuppressTilt",
+		.x11name = "SuppressTilt",
+		.desc = "Suppress threshold for tilt changes "
+		"(default depends on the device, 0 uses Suppress). ",
+		.prop_name = WACOM_PROP_SAMPLE,
+		.prop_format = 32,
+		.prop_offset = 3,
+		.arg_count = 1,
+	},
+	{
+		.name = "SuppressPressure",
+		.x11name = "SuppressPressure",
+		.desc = "Suppress threshold for pressure changes "
+		"(default depends on the device, 0 uses Suppress). ",
+		.prop_name = WACOM_PROP_SAMPLE,
+		.prop_format = 32,
+		.prop_offset = 4,
+		.arg_count = 1,
+	},
+	{
+		.name = "SuppressThrottle",
+		.x11name = "SuppressThrottle",
+		.desc = "Suppress threshold for throttle changes "
+		"(default depends on the device, 0 uses Suppress). ",
+		.prop_name = WACOM_PROP_SAMPLE,
+		.prop_format = 32,
+		.prop_offset = 5,
+		.arg_count = 1,
+	},
+	{
+		.name = "SuppressRotation",
+		.x11name = "SuppressRotation",
+		.desc = "Suppress threshold for rotation changes "
+		"(default depends on the device, 0 uses Suppress). ",
+		.prop_name = WACOM_PROP_SAMPLE,
+		.prop_format = 32,
+		.prop_offset = 6,
+		.arg_count = 1,
+	},
+	{
+		.name = "SuppressWheel",
+		.x11name = "SuppressWheel",
+		.desc = "Suppress threshold for absolute wheel changes "
+		"(default depends on the device, 0 uses Suppress). ",
+		.prop_name = WACOM_PROP_SAMPLE,
+		.prop_format = 32,
+		.prop_offset = 7,
+		.arg_count = 1,
+	},
+	{
+		.name = "Filter",
+		.x11name = "Filter",
+		.desc = "Coordinate filter. "
+		"Values = average, oneeuro (default is average). ",
+		.prop_name = WACOM_PROP_FILTER,
+		.prop_format = 32,
+		.prop_offset = 0,
+		.set_func = set_filter,
+		.get_func = get_filter,
+		.arg_count = 1,
+	},
+	{
+		.name = "FilterMinCutoff",
+		.x11name = "FilterMinCutoff",
+		.desc = "Minimum cutoff of the oneeuro filter in mHz "
+		"(default is 1000). ",
+		.prop_name = WACOM_PROP_FILTER,
+		.prop_format = 32,
+		.prop_offset = 1,
+		.arg_count = 1,
+	},
+	{
+		.name = "FilterBeta",
+		.x11name = "FilterBeta",
+		.desc = "Speed coefficient of the oneeuro filter in 1/1000 Hz per mm/s "
+		"(default is 50). ",
+		.prop_name = WACOM_PROP_FILTER,
+		.prop_format = 32,
+		.prop_offset = 2,
+		.arg_count = 1,
+	},
+	{
+		.name = "Prediction",
+		.x11name = "Prediction",
+		.desc = "Milliseconds to extrapolate the position ahead "
+		"(default is 0 [off]). ",
+		.prop_name = WACOM_PROP_PREDICTION,
+		.prop_format = 32,
+		.prop_offset = 0,
+		.arg_count = 1,
+	},
 	{
 		.name = "PressureCurve",
 		.x11name = "PressCurve",
@@ -524,6 +628,15 @@ static param_t parameters[] =
 		.arg_count = 1,
 		.prop_flags = PROP_FLAG_READONLY
 	},
+	{
+		.name = "Statistics",
+		.desc = "Returns the event processing statistics of the device. ",
+		.prop_name = WACOM_PROP_STATISTICS,
+		.prop_format = 32,
+		.prop_offset = 0,
+		.arg_count = 9,
+		.prop_flags = PROP_FLAG_READONLY
+	},
 	{
 		.name = "PressureRecalibration",
 		.x11name = "PressureRecalibration",
@@ -1778,6 +1891,63 @@ out:
 	return status;
 }
 
+static int set_filter(Display *dpy, XDevice *dev, param_t* param, int argc, char **argv)
+{
+	int filter = 0;
+	Atom prop, type;
+	int format;
+	unsigned char* data;
+	unsigned long nitems, bytes_after;
+	int status = EXIT_SUCCESS;
+
+	if (argc != param->arg_count)
+	{
+		fprintf(stderr, "'%s' requires exactly %d value(s).\n", param->name,
+			param->arg_count);
+		return EXIT_INVALID_USAGE;
+	}
+
+	TRACE("Filter '%s' for device %lu.\n", argv[0], dev->device_id);
+
+	if (strcasecmp(argv[0], "average") == 0 || strcasecmp(argv[0], "0") == 0)
+		filter = 0;
+	else if (strcasecmp(argv[0], "oneeuro") == 0 || strcasecmp(argv[0], "1") == 0)
+		filter = 1;
+	else
+	{
+		fprintf(stderr, "'%s' is not a valid value for the '%s' property.\n",
+		        argv[0], param->name);
+		return EXIT_INVALID_USAGE;
+	}
+
+	prop = XInternAtom(dpy, param->prop_name, True);
+	if (!prop)
+	{
+		fprintf(stderr, "Property for '%s' not available.\n",
+			param->name);
+		return EXIT_FAILURE;
+	}
+
+	XGetDeviceProperty(dpy, dev, prop, 0, 1000, False, AnyPropertyType,
+				&type, &format, &nitems, &bytes_after, &data);
+
+	if (nitems <= param->prop_offset || format != 32)
+	{
+		fprintf(stderr, "Property for '%s' has no or wrong value - this is a bug.\n",
+			param->name);
+		status = EXIT_FAILURE;
+		goto out;
+	}
+
+	((long*)data)[param->prop_offset] = filter;
+	XChangeDeviceProperty(dpy, dev, prop, type, format,
+				PropModeReplace, data, nitems);
+	XFlush(dpy);
+out:
+	XFree(data);
+	return status;
+}
+
 
 /**
  * Performs intelligent string->int conversion. In addition to converting strings
@@ -2058,6 +2228,63 @@ out:
 	return status;
 }
 
+static int get_filter(Display *dpy, XDevice *dev, param_t* param, int argc, char **argv)
+{
+	const char *filter = NULL;
+	Atom prop, type;
+	int format;
+	unsigned char* data;
+	unsigned long nitems, bytes_after;
+	int status = EXIT_SUCCESS;
+
+	if (argc != 0)
+	{
+		fprintf(stderr, "Incorrect number of arguments supplied.\n");
+		return EXIT_INVALID_USAGE;
+	}
+
+	prop = XInternAtom(dpy, param->prop_name, True);
+	if (!prop)
+	{
+		fprintf(stderr, "Property for '%s' not available.\n",
+			param->name);
+		return EXIT_FAILURE;
+	}
+
+	TRACE("Getting filter for device %lu.\n", dev->device_id);
+
+	XGetDeviceProperty(dpy, dev, prop, 0, 1000, False, AnyPropertyType,
+				&type, &format, &nitems, &bytes_after, &data);
+
+	if (nitems <= param->prop_offset || format != 32)
+	{
+		fprintf(stderr, "Property for '%s' has no or wrong value - this is a bug.\n",
+			param->name);
+		status = EXIT_FAILURE;
+		goto out;
+	}
+
+	switch(((long*)data)[param->prop_offset])
+	{
+		case 0:
+			filter = "average";
+			break;
+		case 1:
+			filter = "oneeuro";
+			break;
+	}
+
+	/* a filter this xsetwacom doesn't know about */
+	if (filter)
+		print_value(param, "%s", filter);
+	else
+		print_value(param, "%ld", ((long*)data)[param->prop_offset]);
+
+out:
+	XFree(data);
+	return status;
+}
+
 /**
  * Try to print the value of the action mapped to the given parameter's
  * property. If the property contains data in the wrong format/type then
@@ -3139,7 +3366,7 @@ TEST_CASE(test_parameter_number)
 	 * deprecated them.
 	 * Numbers include trailing NULL entry.
 	 */
-	assert(ARRAY_SIZE(parameters) == 46);
+	assert(ARRAY_SIZE(parameters) == 57);
 	assert(ARRAY_SIZE(deprecated_parameters) == 17);
 }
 